@@ -0,0 +1,247 @@
+#include "asset_archive.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+#include "hash.h"
+
+static const unsigned char asset_archive_identifier[12] = { 0xAB, 'M', 'P', 'K', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+/* Entries at least this large start on their own page */
+static const uint64_t page_aligned_entry_size = 64 * 1024;
+
+static uint64_t AlignEntry(uint64_t offset, uint64_t size)
+{
+	uint64_t alignment = size >= page_aligned_entry_size ? 4096 : 16;
+	return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+uint64_t AssetContentHash(const unsigned char* data, size_t size)
+{
+	return HashBytes(data, size);
+}
+
+std::string NormalizeAssetName(const std::string& name)
+{
+	std::string normalized = name;
+	std::replace(normalized.begin(), normalized.end(), '\\', '/');
+	while (normalized.compare(0, 2, "./") == 0)
+		normalized.erase(0, 2);
+	return normalized;
+}
+
+bool WriteAssetArchive(const std::string& path, const std::vector<std::string>& files, std::string& error)
+{
+	struct Input
+	{
+		std::string name;
+		std::unique_ptr<MappedFile> file;
+	};
+
+	std::vector<Input> inputs;
+	for (const std::string& file : files)
+	{
+		Input input;
+		input.name = NormalizeAssetName(file);
+		input.file.reset(new MappedFile());
+		if (!input.file->Open(file))
+		{
+			error = file + " is missing or empty";
+			return false;
+		}
+		inputs.push_back(std::move(input));
+	}
+
+	std::sort(inputs.begin(), inputs.end(), [](const Input& a, const Input& b) { return a.name < b.name; });
+	for (size_t i = 1; i < inputs.size(); ++i)
+		if (inputs[i].name == inputs[i - 1].name)
+		{
+			error = inputs[i].name + " is listed twice";
+			return false;
+		}
+
+	AssetArchiveHeader header;
+	std::memcpy(header.identifier, asset_archive_identifier, sizeof(header.identifier));
+	header.entry_count = uint32_t(inputs.size());
+	header.names_offset = sizeof(header) + sizeof(AssetArchiveEntry) * inputs.size();
+	header.names_size = 0;
+
+	std::vector<AssetArchiveEntry> entries(inputs.size());
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		entries[i].name_offset = uint32_t(header.names_size);
+		entries[i].name_length = uint32_t(inputs[i].name.size());
+		header.names_size += inputs[i].name.size();
+	}
+
+	/* Identical content is stored once, the hash only picks the candidates to compare */
+	std::unordered_multimap<uint64_t, size_t> stored;
+	std::vector<size_t> unique_inputs;
+	uint64_t offset = header.names_offset + header.names_size;
+	for (size_t i = 0; i < inputs.size(); ++i)
+	{
+		const MappedFile& file = *inputs[i].file;
+		entries[i].content_hash = AssetContentHash(file.Data(), file.Size());
+		entries[i].size = file.Size();
+
+		bool duplicate = false;
+		auto candidates = stored.equal_range(entries[i].content_hash);
+		for (auto candidate = candidates.first; candidate != candidates.second && !duplicate; ++candidate)
+		{
+			const MappedFile& other = *inputs[candidate->second].file;
+			if (other.Size() == file.Size() && std::memcmp(other.Data(), file.Data(), file.Size()) == 0)
+			{
+				entries[i].offset = entries[candidate->second].offset;
+				duplicate = true;
+			}
+		}
+		if (duplicate)
+			continue;
+
+		offset = AlignEntry(offset, file.Size());
+		entries[i].offset = offset;
+		offset += file.Size();
+		stored.emplace(entries[i].content_hash, i);
+		unique_inputs.push_back(i);
+	}
+
+	std::ofstream output(path, std::ios::binary);
+	if (!output)
+	{
+		error = "could not create " + path;
+		return false;
+	}
+
+	output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	output.write(reinterpret_cast<const char*>(entries.data()), std::streamsize(sizeof(AssetArchiveEntry) * entries.size()));
+	for (const Input& input : inputs)
+		output.write(input.name.data(), std::streamsize(input.name.size()));
+
+	static const char padding[4096] = {};
+	uint64_t written = header.names_offset + header.names_size;
+	for (size_t i : unique_inputs)
+	{
+		output.write(padding, std::streamsize(entries[i].offset - written));
+		output.write(reinterpret_cast<const char*>(inputs[i].file->Data()), std::streamsize(entries[i].size));
+		written = entries[i].offset + entries[i].size;
+	}
+
+	if (!output)
+	{
+		error = "could not write " + path;
+		return false;
+	}
+	return true;
+}
+
+/* Asset Archive */
+bool AssetArchive::Open(const std::string& path)
+{
+	Close();
+	if (!file.Open(path) || file.Size() < sizeof(AssetArchiveHeader))
+	{
+		Close();
+		return false;
+	}
+
+	const unsigned char* data = file.Data();
+	const AssetArchiveHeader* candidate = reinterpret_cast<const AssetArchiveHeader*>(data);
+	uint64_t index_end = sizeof(AssetArchiveHeader) + sizeof(AssetArchiveEntry) * uint64_t(candidate->entry_count);
+	if (std::memcmp(candidate->identifier, asset_archive_identifier, sizeof(asset_archive_identifier)) != 0 ||
+		index_end > file.Size() || candidate->names_offset < index_end ||
+		candidate->names_offset > file.Size() || candidate->names_size > file.Size() - candidate->names_offset)
+	{
+		Close();
+		return false;
+	}
+
+	const AssetArchiveEntry* candidate_entries = reinterpret_cast<const AssetArchiveEntry*>(data + sizeof(AssetArchiveHeader));
+	for (uint32_t i = 0; i < candidate->entry_count; ++i)
+	{
+		const AssetArchiveEntry& entry = candidate_entries[i];
+		if (entry.offset > file.Size() || entry.size > file.Size() - entry.offset ||
+			uint64_t(entry.name_offset) + entry.name_length > candidate->names_size)
+		{
+			Close();
+			return false;
+		}
+	}
+
+	header = candidate;
+	entries = candidate_entries;
+	names = reinterpret_cast<const char*>(data + candidate->names_offset);
+	return true;
+}
+
+void AssetArchive::Close()
+{
+	file.Close();
+	header = nullptr;
+	entries = nullptr;
+	names = nullptr;
+}
+
+std::string AssetArchive::EntryName(size_t index) const
+{
+	return std::string(names + entries[index].name_offset, entries[index].name_length);
+}
+
+const unsigned char* AssetArchive::Find(const std::string& name, size_t& size) const
+{
+	if (header == nullptr)
+		return nullptr;
+
+	/* The index is sorted by name */
+	std::string normalized = NormalizeAssetName(name);
+	size_t first = 0, count = header->entry_count;
+	while (count > 0)
+	{
+		size_t half = count / 2;
+		const AssetArchiveEntry& entry = entries[first + half];
+		int order = normalized.compare(0, std::string::npos, names + entry.name_offset, entry.name_length);
+		if (order == 0)
+		{
+			size = size_t(entry.size);
+			return file.Data() + entry.offset;
+		}
+		if (order > 0)
+		{
+			first += half + 1;
+			count -= half + 1;
+		}
+		else
+			count = half;
+	}
+	return nullptr;
+}
+
+/* Mounted archive */
+static AssetArchive mounted_archive;
+
+bool MountAssetArchive(const std::string& path)
+{
+	return mounted_archive.Open(path);
+}
+
+const AssetArchive& MountedAssetArchive()
+{
+	return mounted_archive;
+}
+
+AssetData OpenAsset(const std::string& name)
+{
+	AssetData asset;
+	asset.data = mounted_archive.Find(name, asset.size);
+	if (asset.data != nullptr)
+		return asset;
+
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	if (file->Open(name))
+	{
+		asset.data = file->Data();
+		asset.size = file->Size();
+		asset.loose = std::move(file);
+	}
+	return asset;
+}
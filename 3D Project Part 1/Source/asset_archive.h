@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+/*
+	Asset Archive: every asset file packed into one file, opened once and memory mapped.
+	- An index of entries sorted by name, each pointing at its bytes inside the archive.
+	- Entries are aligned (16 bytes, 4096 for large ones so their pages are not shared)
+	  and carry a 64-bit content hash. Files with identical content are stored once and
+	  their entries share the bytes.
+	- Lookups return pointers into the mapping, nothing is copied. No GL.
+*/
+struct AssetArchiveHeader
+{
+	unsigned char identifier[12];
+	uint32_t entry_count;
+	/* The names of all entries, back to back, not terminated */
+	uint64_t names_offset;
+	uint64_t names_size;
+};
+
+struct AssetArchiveEntry
+{
+	uint64_t content_hash;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t name_offset;
+	uint32_t name_length;
+};
+
+/* FNV-1a, 64-bit */
+uint64_t AssetContentHash(const unsigned char* data, size_t size);
+
+/* Archive names use forward slashes and no leading "./" */
+std::string NormalizeAssetName(const std::string& name);
+
+/* Packs the files under their normalized names, prints nothing, false when a file can't be read or the archive written */
+bool WriteAssetArchive(const std::string& path, const std::vector<std::string>& files, std::string& error);
+
+/* A read only archive, lookups are safe from any thread */
+class AssetArchive
+{
+public:
+	/* Closes any previous archive, false when the file is missing or invalid */
+	bool Open(const std::string& path);
+	void Close();
+	bool IsOpen() const { return header != nullptr; }
+
+	/* Bytes of the named asset inside the mapping, NULL when the archive has no such entry */
+	const unsigned char* Find(const std::string& name, size_t& size) const;
+
+	size_t EntryCount() const { return header ? header->entry_count : 0; }
+	const AssetArchiveEntry& Entry(size_t index) const { return entries[index]; }
+	std::string EntryName(size_t index) const;
+	size_t FileSize() const { return file.Size(); }
+
+private:
+	MappedFile file;
+	const AssetArchiveHeader* header = nullptr;
+	const AssetArchiveEntry* entries = nullptr;
+	const char* names = nullptr;
+};
+
+/*
+	Asset Data: the bytes of one asset, a view into the mounted archive or a mapping of the
+	loose file when the archive has no such entry. Valid until it is destroyed.
+*/
+class AssetData
+{
+public:
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+	bool IsValid() const { return data != nullptr; }
+	bool FromArchive() const { return data != nullptr && !loose; }
+
+private:
+	friend AssetData OpenAsset(const std::string& name);
+
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+	std::unique_ptr<MappedFile> loose;
+};
+
+/* Mounts the archive every OpenAsset looks in first, call before any asset is opened */
+bool MountAssetArchive(const std::string& path);
+const AssetArchive& MountedAssetArchive();
+
+/* The game reads all its asset files through here */
+AssetData OpenAsset(const std::string& name);
@@ -0,0 +1,292 @@
+#include "broadphase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include "job_system.h"
+
+static const float quarter_pi = 0.785398163f;
+static const float half_pi = 1.570796327f;
+/* Points and occupied cells per job */
+static const size_t point_grain = 4096;
+static const size_t cell_grain = 64;
+
+/* Cube face coordinates: face 2 * axis (+1) or 2 * axis + 1 (-1), u and v along the next two axes */
+static glm::vec3 FacePoint(int face, float u, float v)
+{
+	int axis = face / 2;
+	glm::vec3 point;
+	point[axis] = face % 2 == 0 ? 1.0f : -1.0f;
+	point[(axis + 1) % 3] = u;
+	point[(axis + 2) % 3] = v;
+	return point;
+}
+
+/* Direction of the cell corner or center at fractions s and t across the face, in angle */
+static glm::vec3 CellDirection(int face, int resolution, float s, float t)
+{
+	float u = std::tan(s / resolution * half_pi - quarter_pi);
+	float v = std::tan(t / resolution * half_pi - quarter_pi);
+	return glm::normalize(FacePoint(face, u, v));
+}
+
+static float AngleBetween(const glm::vec3& a, const glm::vec3& b)
+{
+	return std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f));
+}
+
+CubeSphereGrid::CubeSphereGrid(int resolution, float radius, float reach)
+	: resolution(std::max(1, resolution)),
+	moved(0)
+{
+	int face_cells = this->resolution * this->resolution;
+	cells.resize(6 * size_t(face_cells));
+
+	/* Every cell lies inside the cap around its center that reaches its farthest corner */
+	std::vector<glm::vec3> centers(cells.size());
+	std::vector<float> caps(cells.size());
+	for (int face = 0; face < 6; ++face)
+		for (int j = 0; j < this->resolution; ++j)
+			for (int i = 0; i < this->resolution; ++i)
+			{
+				size_t cell = size_t(face) * face_cells + size_t(j) * this->resolution + i;
+				centers[cell] = CellDirection(face, this->resolution, i + 0.5f, j + 0.5f);
+				float cap = 0.0f;
+				for (int corner = 0; corner < 4; ++corner)
+				{
+					glm::vec3 direction = CellDirection(face, this->resolution, float(i + corner % 2), float(j + corner / 2));
+					cap = std::max(cap, AngleBetween(centers[cell], direction));
+				}
+				caps[cell] = cap;
+			}
+
+	/* Two points within reach are at most this angle apart seen from the center */
+	float reach_angle = 2.0f * std::asin(std::min(1.0f, reach / (2.0f * radius)));
+	float largest_cap = *std::max_element(caps.begin(), caps.end());
+	float far_cos = std::cos(std::min(2.0f * half_pi, 2.0f * largest_cap + reach_angle));
+	for (size_t a = 0; a < cells.size(); ++a)
+		for (size_t b = a + 1; b < cells.size(); ++b)
+		{
+			/* Most cells are rejected by the dot product alone */
+			if (glm::dot(centers[a], centers[b]) < far_cos)
+				continue;
+			if (AngleBetween(centers[a], centers[b]) <= caps[a] + caps[b] + reach_angle)
+			{
+				cells[a].neighbors.push_back(uint32_t(b));
+				cells[b].lower_neighbors.push_back(uint32_t(a));
+			}
+		}
+}
+
+int CubeSphereGrid::ResolutionFor(float radius, float reach)
+{
+	float reach_angle = 2.0f * std::asin(std::min(1.0f, reach / (2.0f * radius)));
+	return std::max(1, int(std::ceil(3.0f * half_pi / reach_angle)));
+}
+
+int CubeSphereGrid::CellOf(const glm::vec3& position) const
+{
+	glm::vec3 magnitude = glm::abs(position);
+	int axis = magnitude.x >= magnitude.y && magnitude.x >= magnitude.z ? 0 : magnitude.y >= magnitude.z ? 1 : 2;
+	int face = 2 * axis + (position[axis] < 0.0f ? 1 : 0);
+
+	float major = std::max(magnitude[axis], 1e-20f);
+	float u = position[(axis + 1) % 3] / major;
+	float v = position[(axis + 2) % 3] / major;
+	int i = int((std::atan(u) + quarter_pi) / half_pi * resolution);
+	int j = int((std::atan(v) + quarter_pi) / half_pi * resolution);
+	i = glm::clamp(i, 0, resolution - 1);
+	j = glm::clamp(j, 0, resolution - 1);
+	return (face * resolution + j) * resolution + i;
+}
+
+void CubeSphereGrid::Insert(uint32_t point, uint32_t cell)
+{
+	Cell& target = cells[cell];
+	if (target.points.empty())
+	{
+		target.occupied_slot = uint32_t(occupied.size());
+		occupied.push_back(cell);
+	}
+	point_cell[point] = cell;
+	point_slot[point] = uint32_t(target.points.size());
+	target.points.push_back(point);
+}
+
+void CubeSphereGrid::Remove(uint32_t point)
+{
+	/* Swap remove from the cell, and the cell from the occupied list once it is empty */
+	Cell& source = cells[point_cell[point]];
+	uint32_t last = source.points.back();
+	source.points[point_slot[point]] = last;
+	point_slot[last] = point_slot[point];
+	source.points.pop_back();
+
+	if (source.points.empty())
+	{
+		uint32_t last_cell = occupied.back();
+		occupied[source.occupied_slot] = last_cell;
+		cells[last_cell].occupied_slot = source.occupied_slot;
+		occupied.pop_back();
+	}
+}
+
+size_t CubeSphereGrid::Update(const float* x, const float* y, const float* z, size_t count, JobSystem* jobs)
+{
+	/* Runs body(begin, end) over [0, count) on the jobs when there are any */
+	auto forRange = [jobs](const char* name, size_t size, size_t grain, const std::function<void(size_t, size_t)>& body)
+	{
+		if (jobs)
+			jobs->ParallelFor(name, size, grain, body);
+		else
+			body(0, size);
+	};
+
+	moved = 0;
+	if (point_cell.size() != count)
+	{
+		for (Cell& cell : cells)
+			cell.points.clear();
+		occupied.clear();
+		point_cell.assign(count, 0);
+		point_slot.assign(count, 0);
+		for (size_t i = 0; i < count; ++i)
+			Insert(uint32_t(i), uint32_t(CellOf(glm::vec3(x[i], y[i], z[i]))));
+		moved = count;
+	}
+	else
+	{
+		/* Most points stay in their cell from one tick to the next. The moves are made in point order, so the cells fill the same way on any thread count */
+		new_cell.resize(count);
+		forRange("grid cells", count, point_grain, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+				new_cell[i] = uint32_t(CellOf(glm::vec3(x[i], y[i], z[i])));
+		});
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t cell = new_cell[i];
+			if (cell == point_cell[i])
+				continue;
+			Remove(uint32_t(i));
+			Insert(uint32_t(i), cell);
+			++moved;
+		}
+	}
+
+	forRange("grid copy", occupied.size(), cell_grain, [&](size_t begin, size_t end)
+	{
+		for (size_t slot = begin; slot < end; ++slot)
+		{
+			Cell& cell = cells[occupied[slot]];
+			size_t size = cell.points.size();
+			cell.x.resize(size);
+			cell.y.resize(size);
+			cell.z.resize(size);
+			cell.hit.resize(size);
+			for (size_t k = 0; k < size; ++k)
+			{
+				uint32_t point = cell.points[k];
+				cell.x[k] = x[point];
+				cell.y[k] = y[point];
+				cell.z[k] = z[point];
+			}
+		}
+	});
+	return moved;
+}
+
+BroadphaseStats CubeSphereGrid::Overlaps(float reach, uint8_t* overlapping, JobSystem* jobs)
+{
+	BroadphaseStats stats = { moved, 0, 0 };
+
+	/* Branch free inner loops so the compiler can vectorize them. b's flags are only written when mark_b is set */
+	auto testCells = [reach](Cell& a, Cell& b, bool same, bool mark_b, BroadphaseStats* counted)
+	{
+		size_t a_size = a.points.size(), b_size = b.points.size();
+		const float* bx = b.x.data();
+		const float* by = b.y.data();
+		const float* bz = b.z.data();
+		uint8_t* b_hit = b.hit.data();
+		for (size_t k = 0; k < a_size; ++k)
+		{
+			float ax = a.x[k], ay = a.y[k], az = a.z[k];
+			size_t first = same ? k + 1 : 0;
+			unsigned a_hits = 0;
+			if (mark_b)
+			{
+				for (size_t m = first; m < b_size; ++m)
+				{
+					uint8_t overlap = std::fabs(bx[m] - ax) <= reach && std::fabs(by[m] - ay) <= reach && std::fabs(bz[m] - az) <= reach;
+					b_hit[m] |= overlap;
+					a_hits += overlap;
+				}
+			}
+			else
+			{
+				for (size_t m = first; m < b_size; ++m)
+					a_hits += std::fabs(bx[m] - ax) <= reach && std::fabs(by[m] - ay) <= reach && std::fabs(bz[m] - az) <= reach;
+			}
+			a.hit[k] |= a_hits != 0;
+			if (counted)
+			{
+				counted->overlapping_pairs += a_hits;
+				counted->tested_pairs += b_size - first;
+			}
+		}
+	};
+
+	if (!jobs || jobs->ThreadCount() == 1)
+	{
+		for (uint32_t index : occupied)
+		{
+			Cell& cell = cells[index];
+			std::fill(cell.hit.begin(), cell.hit.end(), uint8_t(0));
+		}
+
+		for (uint32_t index : occupied)
+		{
+			Cell& cell = cells[index];
+			testCells(cell, cell, true, true, &stats);
+			for (uint32_t neighbor : cell.neighbors)
+				if (!cells[neighbor].points.empty())
+					testCells(cell, cells[neighbor], false, true, &stats);
+		}
+
+		for (uint32_t index : occupied)
+		{
+			const Cell& cell = cells[index];
+			for (size_t k = 0; k < cell.points.size(); ++k)
+				overlapping[cell.points[k]] = cell.hit[k];
+		}
+		return stats;
+	}
+
+	/* Pairs are counted from the cell with the lower index only, as above */
+	std::atomic<size_t> tested_pairs(0), overlapping_pairs(0);
+	jobs->ParallelFor("broadphase", occupied.size(), cell_grain, [&](size_t begin, size_t end)
+	{
+		BroadphaseStats counted = { 0, 0, 0 };
+		for (size_t slot = begin; slot < end; ++slot)
+		{
+			Cell& cell = cells[occupied[slot]];
+			std::fill(cell.hit.begin(), cell.hit.end(), uint8_t(0));
+			testCells(cell, cell, true, true, &counted);
+			for (uint32_t neighbor : cell.neighbors)
+				if (!cells[neighbor].points.empty())
+					testCells(cell, cells[neighbor], false, false, &counted);
+			for (uint32_t neighbor : cell.lower_neighbors)
+				if (!cells[neighbor].points.empty())
+					testCells(cell, cells[neighbor], false, false, nullptr);
+
+			for (size_t k = 0; k < cell.points.size(); ++k)
+				overlapping[cell.points[k]] = cell.hit[k];
+		}
+		tested_pairs += counted.tested_pairs;
+		overlapping_pairs += counted.overlapping_pairs;
+	});
+	stats.tested_pairs = tested_pairs;
+	stats.overlapping_pairs = overlapping_pairs;
+	return stats;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "GLM/glm.hpp"
+
+class JobSystem;
+
+struct BroadphaseStats
+{
+	/* Rovers that changed cell this update */
+	size_t moved;
+	/* Pairs given to the box test, out of count * (count - 1) / 2 */
+	size_t tested_pairs;
+	size_t overlapping_pairs;
+};
+
+/*
+	Cube Sphere Grid: buckets points near a sphere into cells for the collision broadphase.
+	- The sphere is split like a cube, each face into resolution x resolution cells of
+	  equal angle, so cells cover about the same area anywhere on the sphere.
+	- Every cell knows the cells that can hold a point within reach of one of its own,
+	  across face edges and corners as well, from the caps around the cells.
+	- Update only moves the points that changed cell and visits only occupied cells.
+	  Positions are copied per cell every update so the pair tests read contiguous arrays.
+	- With a job system the cells are tested in parallel. Each cell then tests its points
+	  against all its neighbors and marks only its own, so no two jobs write the same
+	  flags. That tests every pair between cells twice, for the same result and stats.
+	No GL.
+*/
+class CubeSphereGrid
+{
+public:
+	/* reach is the largest distance between two points that can overlap, radius the sphere the points lie near */
+	CubeSphereGrid(int resolution, float radius, float reach);
+
+	/* Picks the resolution whose cells are about a third of the reach across */
+	static int ResolutionFor(float radius, float reach);
+
+	int Resolution() const { return resolution; }
+	size_t CellCount() const { return cells.size(); }
+	int CellOf(const glm::vec3& position) const;
+
+	/* The first update inserts every point, later ones expect the same count. jobs may be NULL */
+	size_t Update(const float* x, const float* y, const float* z, size_t count, JobSystem* jobs = nullptr);
+
+	/*
+		Tests every pair of points in the same or neighboring cells as axis aligned boxes
+		that overlap when every axis is within reach, and writes 1 into overlapping[i] for
+		every point with at least one overlap, 0 otherwise. jobs may be NULL.
+	*/
+	BroadphaseStats Overlaps(float reach, uint8_t* overlapping, JobSystem* jobs = nullptr);
+
+private:
+	struct Cell
+	{
+		std::vector<uint32_t> points;
+		std::vector<float> x, y, z;
+		std::vector<uint8_t> hit;
+		/* Neighbors with a higher index, each pair of cells is visited once */
+		std::vector<uint32_t> neighbors;
+		/* And the ones with a lower index, for the parallel tests */
+		std::vector<uint32_t> lower_neighbors;
+		/* Index in occupied while the cell has points */
+		uint32_t occupied_slot;
+	};
+
+	void Insert(uint32_t point, uint32_t cell);
+	void Remove(uint32_t point);
+
+	int resolution;
+	std::vector<Cell> cells;
+	/* Only cells with points are visited per update */
+	std::vector<uint32_t> occupied;
+	std::vector<uint32_t> point_cell;
+	std::vector<uint32_t> point_slot;
+	/* Cell of every point this update, found in parallel before the points move */
+	std::vector<uint32_t> new_cell;
+	size_t moved;
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+	Collision Kernel Batch: the kernels of collision_kernels.h written once over a lane type,
+	instantiated per instruction set. Only collision_kernels.cpp and
+	collision_kernels_avx2.cpp include this. Everything is in an unnamed namespace, so the
+	AVX2 file keeps its own copies and the linker can never hand AVX2 code to other callers.
+
+	A lane type L provides + - * and the statics width, Set, Load, Abs, LessEqual, Greater,
+	And, Or and MaskBits (one bit per lane, lane 0 lowest). The mask operations are members
+	since the SIMD mask types are built in and argument lookup would not find them.
+*/
+
+/* Plain arrays, the AVX2 file does not include GLM */
+struct OrientedBoxQuery
+{
+	float center[3];
+	/* axes[k][c] is component c of axis k */
+	float axes[3][3];
+	float half_size[3];
+};
+
+struct OrientedBoxArrays
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* axis[9];
+	const float* half_size[3];
+	size_t count;
+};
+
+/* Defined in collision_kernels_avx2.cpp, only called when the CPU has AVX2 */
+size_t SphereOverlapsAvx2(const float* center, float radius, const float* x, const float* y, const float* z, const float* radii, size_t count, uint32_t* hits);
+size_t BoxOverlapsAvx2(const float* center, const float* reach, const float* x, const float* y, const float* z, size_t count, uint32_t* hits);
+size_t OrientedBoxOverlapsAvx2(const OrientedBoxQuery& box, const OrientedBoxArrays& boxes, uint32_t* hits);
+
+namespace
+{
+	struct ScalarLane
+	{
+		typedef bool Mask;
+		static const int width = 1;
+
+		float v;
+
+		static ScalarLane Set(float value) { ScalarLane lane = { value }; return lane; }
+		static ScalarLane Load(const float* values) { ScalarLane lane = { *values }; return lane; }
+		static ScalarLane Abs(ScalarLane a) { return Set(std::fabs(a.v)); }
+		static bool LessEqual(ScalarLane a, ScalarLane b) { return a.v <= b.v; }
+		static bool Greater(ScalarLane a, ScalarLane b) { return a.v > b.v; }
+		static bool And(bool a, bool b) { return a && b; }
+		static bool Or(bool a, bool b) { return a || b; }
+		static unsigned MaskBits(bool mask) { return mask ? 1u : 0u; }
+	};
+
+	inline ScalarLane operator+(ScalarLane a, ScalarLane b) { return ScalarLane::Set(a.v + b.v); }
+	inline ScalarLane operator-(ScalarLane a, ScalarLane b) { return ScalarLane::Set(a.v - b.v); }
+	inline ScalarLane operator*(ScalarLane a, ScalarLane b) { return ScalarLane::Set(a.v * b.v); }
+
+	inline unsigned LowestBit(unsigned bits)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, bits);
+		return unsigned(index);
+#else
+		return unsigned(__builtin_ctz(bits));
+#endif
+	}
+
+	/* Appends base + lane for every set bit */
+	inline size_t AppendHits(unsigned bits, size_t base, uint32_t* hits, size_t count)
+	{
+		while (bits != 0)
+		{
+			hits[count++] = uint32_t(base + LowestBit(bits));
+			bits &= bits - 1;
+		}
+		return count;
+	}
+
+	/* The lanes left over after the last full vector go through the scalar lane */
+	template <typename Batch>
+	size_t FinishTail(size_t done, size_t count, uint32_t* hits, size_t written, Batch batch)
+	{
+		if (done == count)
+			return written;
+		size_t tail = batch(done, count - done, hits + written);
+		for (size_t k = written; k < written + tail; ++k)
+			hits[k] += uint32_t(done);
+		return written + tail;
+	}
+
+	template <typename L>
+	size_t SphereBatch(const float* center, float radius, const float* x, const float* y, const float* z, const float* radii, size_t count, uint32_t* hits)
+	{
+		const L cx = L::Set(center[0]), cy = L::Set(center[1]), cz = L::Set(center[2]), r = L::Set(radius);
+		size_t written = 0, i = 0;
+		for (; i + L::width <= count; i += L::width)
+		{
+			L dx = L::Load(x + i) - cx;
+			L dy = L::Load(y + i) - cy;
+			L dz = L::Load(z + i) - cz;
+			L reach = L::Load(radii + i) + r;
+			written = AppendHits(L::MaskBits(L::LessEqual(dx * dx + dy * dy + dz * dz, reach * reach)), i, hits, written);
+		}
+		return FinishTail(i, count, hits, written, [&](size_t first, size_t left, uint32_t* out)
+		{
+			return SphereBatch<ScalarLane>(center, radius, x + first, y + first, z + first, radii + first, left, out);
+		});
+	}
+
+	template <typename L>
+	size_t BoxBatch(const float* center, const float* reach, const float* x, const float* y, const float* z, size_t count, uint32_t* hits)
+	{
+		const L cx = L::Set(center[0]), cy = L::Set(center[1]), cz = L::Set(center[2]);
+		const L rx = L::Set(reach[0]), ry = L::Set(reach[1]), rz = L::Set(reach[2]);
+		size_t written = 0, i = 0;
+		for (; i + L::width <= count; i += L::width)
+		{
+			typename L::Mask inside = L::And(L::And(
+				L::LessEqual(L::Abs(L::Load(x + i) - cx), rx),
+				L::LessEqual(L::Abs(L::Load(y + i) - cy), ry)),
+				L::LessEqual(L::Abs(L::Load(z + i) - cz), rz));
+			written = AppendHits(L::MaskBits(inside), i, hits, written);
+		}
+		return FinishTail(i, count, hits, written, [&](size_t first, size_t left, uint32_t* out)
+		{
+			return BoxBatch<ScalarLane>(center, reach, x + first, y + first, z + first, left, out);
+		});
+	}
+
+	/* Keeps the cross product axes of nearly parallel edges from separating touching boxes */
+	const float parallel_epsilon = 1e-6f;
+
+	template <typename L>
+	size_t OrientedBoxBatch(const OrientedBoxQuery& box, const OrientedBoxArrays& boxes, uint32_t* hits)
+	{
+		L a[3], a_axis[3][3], a_center[3];
+		for (int k = 0; k < 3; ++k)
+		{
+			a[k] = L::Set(box.half_size[k]);
+			a_center[k] = L::Set(box.center[k]);
+			for (int c = 0; c < 3; ++c)
+				a_axis[k][c] = L::Set(box.axes[k][c]);
+		}
+		const L epsilon = L::Set(parallel_epsilon);
+
+		size_t written = 0, i = 0;
+		for (; i + L::width <= boxes.count; i += L::width)
+		{
+			L b[3], b_axis[3][3];
+			for (int k = 0; k < 3; ++k)
+			{
+				b[k] = L::Load(boxes.half_size[k] + i);
+				for (int c = 0; c < 3; ++c)
+					b_axis[k][c] = L::Load(boxes.axis[k * 3 + c] + i);
+			}
+			L d[3] = { L::Load(boxes.x + i) - a_center[0], L::Load(boxes.y + i) - a_center[1], L::Load(boxes.z + i) - a_center[2] };
+
+			/* Everything in the frame of the query box: t is the offset, r[i][j] the cosine between axis i and the other box's axis j */
+			L t[3], r[3][3], abs_r[3][3];
+			for (int k = 0; k < 3; ++k)
+			{
+				t[k] = d[0] * a_axis[k][0] + d[1] * a_axis[k][1] + d[2] * a_axis[k][2];
+				for (int j = 0; j < 3; ++j)
+				{
+					r[k][j] = a_axis[k][0] * b_axis[j][0] + a_axis[k][1] * b_axis[j][1] + a_axis[k][2] * b_axis[j][2];
+					abs_r[k][j] = L::Abs(r[k][j]) + epsilon;
+				}
+			}
+
+			/* The query box's axes */
+			typename L::Mask separated = L::Greater(L::Abs(t[0]), a[0] + b[0] * abs_r[0][0] + b[1] * abs_r[0][1] + b[2] * abs_r[0][2]);
+			for (int k = 1; k < 3; ++k)
+				separated = L::Or(separated, L::Greater(L::Abs(t[k]), a[k] + b[0] * abs_r[k][0] + b[1] * abs_r[k][1] + b[2] * abs_r[k][2]));
+
+			/* The other box's axes */
+			for (int j = 0; j < 3; ++j)
+				separated = L::Or(separated, L::Greater(
+					L::Abs(t[0] * r[0][j] + t[1] * r[1][j] + t[2] * r[2][j]),
+					a[0] * abs_r[0][j] + a[1] * abs_r[1][j] + a[2] * abs_r[2][j] + b[j]));
+
+			/* Cross products of one axis of each */
+			for (int k = 0; k < 3; ++k)
+			{
+				int k1 = (k + 1) % 3, k2 = (k + 2) % 3;
+				for (int j = 0; j < 3; ++j)
+				{
+					int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+					L ra = a[k1] * abs_r[k2][j] + a[k2] * abs_r[k1][j];
+					L rb = b[j1] * abs_r[k][j2] + b[j2] * abs_r[k][j1];
+					separated = L::Or(separated, L::Greater(L::Abs(t[k2] * r[k1][j] - t[k1] * r[k2][j]), ra + rb));
+				}
+			}
+
+			unsigned all_lanes = (1u << L::width) - 1;
+			written = AppendHits(~L::MaskBits(separated) & all_lanes, i, hits, written);
+		}
+		return FinishTail(i, boxes.count, hits, written, [&](size_t first, size_t left, uint32_t* out)
+		{
+			OrientedBoxArrays tail = boxes;
+			tail.x += first;
+			tail.y += first;
+			tail.z += first;
+			for (const float*& axis : tail.axis)
+				axis += first;
+			for (const float*& half_size : tail.half_size)
+				half_size += first;
+			tail.count = left;
+			return OrientedBoxBatch<ScalarLane>(box, tail, out);
+		});
+	}
+}
@@ -0,0 +1,208 @@
+#include "collision_kernels.h"
+#include "collision_kernel_batch.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define COLLISION_KERNELS_HAVE_SSE2
+#endif
+
+#if defined(COLLISION_KERNELS_HAVE_SSE2) && !defined(_MSC_VER)
+#include <cpuid.h>
+#endif
+
+namespace
+{
+#ifdef COLLISION_KERNELS_HAVE_SSE2
+	struct SseLane
+	{
+		typedef __m128 Mask;
+		static const int width = 4;
+
+		__m128 v;
+
+		static SseLane Set(float value) { SseLane lane = { _mm_set1_ps(value) }; return lane; }
+		static SseLane Load(const float* values) { SseLane lane = { _mm_loadu_ps(values) }; return lane; }
+		static SseLane Abs(SseLane a) { SseLane lane = { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; return lane; }
+		static __m128 LessEqual(SseLane a, SseLane b) { return _mm_cmple_ps(a.v, b.v); }
+		static __m128 Greater(SseLane a, SseLane b) { return _mm_cmpgt_ps(a.v, b.v); }
+		static __m128 And(__m128 a, __m128 b) { return _mm_and_ps(a, b); }
+		static __m128 Or(__m128 a, __m128 b) { return _mm_or_ps(a, b); }
+		static unsigned MaskBits(__m128 mask) { return unsigned(_mm_movemask_ps(mask)); }
+	};
+
+	inline SseLane Wrap(__m128 v) { SseLane lane = { v }; return lane; }
+	inline SseLane operator+(SseLane a, SseLane b) { return Wrap(_mm_add_ps(a.v, b.v)); }
+	inline SseLane operator-(SseLane a, SseLane b) { return Wrap(_mm_sub_ps(a.v, b.v)); }
+	inline SseLane operator*(SseLane a, SseLane b) { return Wrap(_mm_mul_ps(a.v, b.v)); }
+#endif
+}
+
+static bool CpuHasAvx2()
+{
+#if defined(COLLISION_KERNELS_HAVE_SSE2)
+	/* AVX2 in leaf 7, and the OS must save the YMM registers (OSXSAVE, then XCR0 bits 1 and 2) */
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	bool os_saves_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;
+	__cpuidex(info, 7, 0);
+	bool avx2 = (info[1] & (1 << 5)) != 0;
+	return os_saves_avx && avx2 && (_xgetbv(0) & 6) == 6;
+#else
+	unsigned eax, ebx, ecx, edx;
+	if (__get_cpuid_max(0, nullptr) < 7)
+		return false;
+	__cpuid(1, eax, ebx, ecx, edx);
+	bool os_saves_avx = (ecx & (1u << 27)) != 0 && (ecx & (1u << 28)) != 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	bool avx2 = (ebx & (1u << 5)) != 0;
+	if (!os_saves_avx || !avx2)
+		return false;
+	unsigned xcr0_low, xcr0_high;
+	__asm__("xgetbv" : "=a"(xcr0_low), "=d"(xcr0_high) : "c"(0));
+	return (xcr0_low & 6) == 6;
+#endif
+#else
+	return false;
+#endif
+}
+
+CollisionKernelLevel BestCollisionKernels()
+{
+	static const CollisionKernelLevel best =
+#ifdef COLLISION_KERNELS_HAVE_SSE2
+		CpuHasAvx2() ? COLLISION_KERNELS_AVX2 : COLLISION_KERNELS_SSE2;
+#else
+		COLLISION_KERNELS_SCALAR;
+#endif
+	return best;
+}
+
+static CollisionKernelLevel active_level = BestCollisionKernels();
+
+CollisionKernelLevel ActiveCollisionKernels()
+{
+	return active_level;
+}
+
+void SetCollisionKernels(CollisionKernelLevel level)
+{
+	active_level = level < BestCollisionKernels() ? level : BestCollisionKernels();
+}
+
+const char* CollisionKernelName(CollisionKernelLevel level)
+{
+	switch (level)
+	{
+	case COLLISION_KERNELS_AVX2:
+		return "AVX2";
+	case COLLISION_KERNELS_SSE2:
+		return "SSE2";
+	default:
+		return "scalar";
+	}
+}
+
+/* Oriented Boxes */
+void OrientedBoxes::Clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	for (std::vector<float>& component : axis)
+		component.clear();
+	for (std::vector<float>& half : half_size)
+		half.clear();
+}
+
+size_t OrientedBoxes::Add(const OrientedBox& box)
+{
+	x.push_back(box.center.x);
+	y.push_back(box.center.y);
+	z.push_back(box.center.z);
+	for (int k = 0; k < 3; ++k)
+	{
+		for (int c = 0; c < 3; ++c)
+			axis[k * 3 + c].push_back(box.axes[k][c]);
+		half_size[k].push_back(box.half_size[k]);
+	}
+	return x.size() - 1;
+}
+
+/* Kernels */
+size_t SphereOverlaps(
+	const glm::vec3& center, float radius,
+	const float* x, const float* y, const float* z, const float* radii, size_t count,
+	uint32_t* hits
+)
+{
+	const float c[3] = { center.x, center.y, center.z };
+	switch (active_level)
+	{
+#ifdef COLLISION_KERNELS_HAVE_SSE2
+	case COLLISION_KERNELS_AVX2:
+		return SphereOverlapsAvx2(c, radius, x, y, z, radii, count, hits);
+	case COLLISION_KERNELS_SSE2:
+		return SphereBatch<SseLane>(c, radius, x, y, z, radii, count, hits);
+#endif
+	default:
+		return SphereBatch<ScalarLane>(c, radius, x, y, z, radii, count, hits);
+	}
+}
+
+size_t BoxOverlaps(
+	const glm::vec3& center, const glm::vec3& reach,
+	const float* x, const float* y, const float* z, size_t count,
+	uint32_t* hits
+)
+{
+	const float c[3] = { center.x, center.y, center.z };
+	const float r[3] = { reach.x, reach.y, reach.z };
+	switch (active_level)
+	{
+#ifdef COLLISION_KERNELS_HAVE_SSE2
+	case COLLISION_KERNELS_AVX2:
+		return BoxOverlapsAvx2(c, r, x, y, z, count, hits);
+	case COLLISION_KERNELS_SSE2:
+		return BoxBatch<SseLane>(c, r, x, y, z, count, hits);
+#endif
+	default:
+		return BoxBatch<ScalarLane>(c, r, x, y, z, count, hits);
+	}
+}
+
+size_t OrientedBoxOverlaps(const OrientedBox& box, const OrientedBoxes& boxes, size_t first, uint32_t* hits)
+{
+	OrientedBoxQuery query;
+	OrientedBoxArrays arrays;
+	for (int k = 0; k < 3; ++k)
+	{
+		query.center[k] = box.center[k];
+		query.half_size[k] = box.half_size[k];
+		for (int c = 0; c < 3; ++c)
+		{
+			query.axes[k][c] = box.axes[k][c];
+			arrays.axis[k * 3 + c] = boxes.axis[k * 3 + c].data() + first;
+		}
+		arrays.half_size[k] = boxes.half_size[k].data() + first;
+	}
+	arrays.x = boxes.x.data() + first;
+	arrays.y = boxes.y.data() + first;
+	arrays.z = boxes.z.data() + first;
+	arrays.count = first < boxes.Size() ? boxes.Size() - first : 0;
+
+	switch (active_level)
+	{
+#ifdef COLLISION_KERNELS_HAVE_SSE2
+	case COLLISION_KERNELS_AVX2:
+		return OrientedBoxOverlapsAvx2(query, arrays, hits);
+	case COLLISION_KERNELS_SSE2:
+		return OrientedBoxBatch<SseLane>(query, arrays, hits);
+#endif
+	default:
+		return OrientedBoxBatch<ScalarLane>(query, arrays, hits);
+	}
+}
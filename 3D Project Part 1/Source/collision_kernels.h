@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "GLM/glm.hpp"
+
+/*
+	Collision Kernels: one shape tested against a batch of shapes stored as structure of
+	arrays, writing the indices of the overlapping ones into a compact hit list.
+	- Scalar, SSE2 (4 lanes) and AVX2 (8 lanes) versions give the same hits. The best one
+	  the CPU runs is picked at startup, SetCollisionKernels can force a lower one.
+	- hits needs room for count indices, they are written in ascending order and the
+	  number written is returned.
+	No GL.
+*/
+enum CollisionKernelLevel
+{
+	COLLISION_KERNELS_SCALAR,
+	COLLISION_KERNELS_SSE2,
+	COLLISION_KERNELS_AVX2,
+};
+
+/* The highest level this CPU and build support */
+CollisionKernelLevel BestCollisionKernels();
+CollisionKernelLevel ActiveCollisionKernels();
+/* Clamped to BestCollisionKernels, call before any kernel runs on another thread */
+void SetCollisionKernels(CollisionKernelLevel level);
+const char* CollisionKernelName(CollisionKernelLevel level);
+
+/* A box along its own axes, which are unit length and orthogonal */
+struct OrientedBox
+{
+	glm::vec3 center;
+	glm::mat3 axes;
+	glm::vec3 half_size;
+};
+
+/* Structure of arrays so the kernels stream through plain float arrays */
+struct OrientedBoxes
+{
+	std::vector<float> x, y, z;
+	/* axis[k * 3 + c] is component c of axis k */
+	std::vector<float> axis[9];
+	std::vector<float> half_size[3];
+
+	size_t Size() const { return x.size(); }
+	void Clear();
+	size_t Add(const OrientedBox& box);
+};
+
+/* Spheres overlap when their centers are no farther apart than the sum of the radii */
+size_t SphereOverlaps(
+	const glm::vec3& center, float radius,
+	const float* x, const float* y, const float* z, const float* radii, size_t count,
+	uint32_t* hits
+);
+
+/* Axis aligned boxes overlap when the centers are within reach on every axis, reach being the sum of the half sizes */
+size_t BoxOverlaps(
+	const glm::vec3& center, const glm::vec3& reach,
+	const float* x, const float* y, const float* z, size_t count,
+	uint32_t* hits
+);
+
+/* Separating axis test over the 15 axes of the two boxes, against boxes first to Size() - 1, hits counted from first */
+size_t OrientedBoxOverlaps(const OrientedBox& box, const OrientedBoxes& boxes, size_t first, uint32_t* hits);
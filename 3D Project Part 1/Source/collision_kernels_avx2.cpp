@@ -0,0 +1,70 @@
+/*
+	AVX2 versions of the collision kernels. GCC and Clang compile this file for AVX2, MSVC
+	needs no flag for the intrinsics. Only called after BestCollisionKernels saw AVX2, and
+	only headers without shared inline code are included after the target switch.
+*/
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+#pragma GCC target("avx2")
+#endif
+
+#include <immintrin.h>
+#include "collision_kernel_batch.h"
+
+namespace
+{
+	struct AvxLane
+	{
+		typedef __m256 Mask;
+		static const int width = 8;
+
+		__m256 v;
+
+		static AvxLane Set(float value) { AvxLane lane = { _mm256_set1_ps(value) }; return lane; }
+		static AvxLane Load(const float* values) { AvxLane lane = { _mm256_loadu_ps(values) }; return lane; }
+		static AvxLane Abs(AvxLane a) { AvxLane lane = { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v) }; return lane; }
+		static __m256 LessEqual(AvxLane a, AvxLane b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+		static __m256 Greater(AvxLane a, AvxLane b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+		static __m256 And(__m256 a, __m256 b) { return _mm256_and_ps(a, b); }
+		static __m256 Or(__m256 a, __m256 b) { return _mm256_or_ps(a, b); }
+		static unsigned MaskBits(__m256 mask) { return unsigned(_mm256_movemask_ps(mask)); }
+	};
+
+	inline AvxLane Wrap(__m256 v) { AvxLane lane = { v }; return lane; }
+	inline AvxLane operator+(AvxLane a, AvxLane b) { return Wrap(_mm256_add_ps(a.v, b.v)); }
+	inline AvxLane operator-(AvxLane a, AvxLane b) { return Wrap(_mm256_sub_ps(a.v, b.v)); }
+	inline AvxLane operator*(AvxLane a, AvxLane b) { return Wrap(_mm256_mul_ps(a.v, b.v)); }
+}
+
+/*
+	Every entry point clears the upper halves of the YMM registers before returning. The
+	compiler leaves them dirty when a batch ends in the scalar tail, and the SSE code of the
+	callers then runs many times slower.
+*/
+size_t SphereOverlapsAvx2(const float* center, float radius, const float* x, const float* y, const float* z, const float* radii, size_t count, uint32_t* hits)
+{
+	size_t written = SphereBatch<AvxLane>(center, radius, x, y, z, radii, count, hits);
+	_mm256_zeroupper();
+	return written;
+}
+
+size_t BoxOverlapsAvx2(const float* center, const float* reach, const float* x, const float* y, const float* z, size_t count, uint32_t* hits)
+{
+	size_t written = BoxBatch<AvxLane>(center, reach, x, y, z, count, hits);
+	_mm256_zeroupper();
+	return written;
+}
+
+size_t OrientedBoxOverlapsAvx2(const OrientedBoxQuery& box, const OrientedBoxArrays& boxes, uint32_t* hits)
+{
+	size_t written = OrientedBoxBatch<AvxLane>(box, boxes, hits);
+	_mm256_zeroupper();
+	return written;
+}
+
+#endif
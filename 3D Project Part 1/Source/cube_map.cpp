@@ -0,0 +1,100 @@
+#include "cube_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <thread>
+#include "GLM/gtc/constants.hpp"
+
+glm::vec3 CubeFaceDirection(int face, float s, float t)
+{
+	/* The major axis and the signs GL uses to pick a face texel, inverted */
+	switch (face)
+	{
+	case 0: return glm::vec3(1, -t, -s);
+	case 1: return glm::vec3(-1, -t, s);
+	case 2: return glm::vec3(s, 1, t);
+	case 3: return glm::vec3(s, -1, -t);
+	case 4: return glm::vec3(s, -t, 1);
+	default: return glm::vec3(-s, -t, -1);
+	}
+}
+
+glm::vec2 EquirectangularUV(const glm::vec3& direction)
+{
+	/* The sphere is a half circle (cos, sin) rotated around y by u turns, x = cos * cos(a) and z = -cos * sin(a) */
+	glm::vec3 d = glm::normalize(direction);
+	float u = std::atan2(-d.z, d.x) / glm::two_pi<float>();
+	if (u < 0)
+		u += 1;
+	float v = std::asin(glm::clamp(d.y, -1.f, 1.f)) / glm::pi<float>() + 0.5f;
+	return glm::vec2(u, v);
+}
+
+int CubeFaceSize(int equirectangular_width)
+{
+	return std::max(1, equirectangular_width / 4);
+}
+
+/* Bilinear sample wrapping horizontally and clamping vertically, adds into sum */
+static void SampleEquirectangular(const unsigned char* pixels, int width, int height, int channels, glm::vec2 uv, float* sum)
+{
+	float x = uv.x * width - 0.5f;
+	float y = glm::clamp(uv.y * height - 0.5f, 0.f, float(height - 1));
+	int x0 = int(std::floor(x));
+	int y0 = int(y);
+	float fx = x - x0;
+	float fy = y - y0;
+	int y1 = std::min(y0 + 1, height - 1);
+	x0 = ((x0 % width) + width) % width;
+	int x1 = (x0 + 1) % width;
+
+	const unsigned char* t00 = pixels + (size_t(y0) * width + x0) * channels;
+	const unsigned char* t10 = pixels + (size_t(y0) * width + x1) * channels;
+	const unsigned char* t01 = pixels + (size_t(y1) * width + x0) * channels;
+	const unsigned char* t11 = pixels + (size_t(y1) * width + x1) * channels;
+	for (int c = 0; c < channels; ++c)
+	{
+		float top = t00[c] + (t10[c] - t00[c]) * fx;
+		float bottom = t01[c] + (t11[c] - t01[c]) * fx;
+		sum[c] += top + (bottom - top) * fy;
+	}
+}
+
+static void ReprojectFace(const unsigned char* pixels, int width, int height, int channels, int face, int face_size, std::vector<unsigned char>& out)
+{
+	out.resize(size_t(face_size) * face_size * channels);
+
+	static const float offsets[2] = { 0.25f, 0.75f };
+	for (int y = 0; y < face_size; ++y)
+		for (int x = 0; x < face_size; ++x)
+		{
+			float sum[4] = { 0, 0, 0, 0 };
+			for (float oy : offsets)
+				for (float ox : offsets)
+				{
+					float s = 2.f * (x + ox) / face_size - 1.f;
+					float t = 2.f * (y + oy) / face_size - 1.f;
+					SampleEquirectangular(pixels, width, height, channels, EquirectangularUV(CubeFaceDirection(face, s, t)), sum);
+				}
+
+			unsigned char* texel = &out[(size_t(y) * face_size + x) * channels];
+			for (int c = 0; c < channels; ++c)
+				texel[c] = (unsigned char)std::min(255.f, sum[c] * 0.25f + 0.5f);
+		}
+}
+
+std::vector<std::vector<unsigned char>> EquirectangularToCubeMap(const unsigned char* pixels, int width, int height, int channels, int face_size)
+{
+	std::vector<std::vector<unsigned char>> faces(cube_face_count);
+	if (pixels == nullptr || width <= 0 || height <= 0 || face_size <= 0)
+		return faces;
+
+	std::vector<std::thread> threads;
+	for (int face = 0; face < cube_face_count; ++face)
+		threads.emplace_back(ReprojectFace, pixels, width, height, channels, face, face_size, std::ref(faces[face]));
+	for (std::thread& thread : threads)
+		thread.join();
+
+	return faces;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <vector>
+
+#include "GLM/glm.hpp"
+
+/* Cube Map: reprojection of equirectangular planet maps onto cube faces, no GL so the asset cooker can use it */
+
+/* Faces in GL order: +X, -X, +Y, -Y, +Z, -Z */
+const int cube_face_count = 6;
+
+/* Direction through face coordinates s, t in [-1, 1], laid out like the GL cube map faces with row 0 at t = -1 */
+glm::vec3 CubeFaceDirection(int face, float s, float t);
+
+/* Where a direction lands in the equirectangular map, matching the uvs of the sphere mesh */
+glm::vec2 EquirectangularUV(const glm::vec3& direction);
+
+/* A face a quarter of the equirectangular width keeps the texel density at the equator */
+int CubeFaceSize(int equirectangular_width);
+
+/*
+	Six faces of face_size squared texels with the same channel count as the source. Every
+	texel averages 2x2 bilinear samples, so the poles, where a face texel spans many
+	equirectangular texels horizontally, alias less. One thread per face.
+*/
+std::vector<std::vector<unsigned char>> EquirectangularToCubeMap(const unsigned char* pixels, int width, int height, int channels, int face_size);
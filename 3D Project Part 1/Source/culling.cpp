@@ -0,0 +1,130 @@
+#include "culling.h"
+
+/* Frustum */
+Frustum ExtractFrustum(const glm::mat4& view_projection)
+{
+	/* GLM is column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i]) */
+	auto row = [&view_projection](int i)
+	{
+		return glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+	};
+
+	Frustum frustum;
+	frustum.planes[0] = row(3) + row(0);
+	frustum.planes[1] = row(3) - row(0);
+	frustum.planes[2] = row(3) + row(1);
+	frustum.planes[3] = row(3) - row(1);
+	frustum.planes[4] = row(3) + row(2);
+	frustum.planes[5] = row(3) - row(2);
+
+	for (auto& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+/* Bounding Spheres */
+void BoundingSpheres::Clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	radius.clear();
+}
+
+size_t BoundingSpheres::Add(const glm::vec3& center, float sphere_radius)
+{
+	x.push_back(center.x);
+	y.push_back(center.y);
+	z.push_back(center.z);
+	radius.push_back(sphere_radius);
+	return x.size() - 1;
+}
+
+void BoundingSpheres::Resize(size_t count)
+{
+	x.resize(count);
+	y.resize(count);
+	z.resize(count);
+	radius.resize(count);
+}
+
+void BoundingSpheres::Set(size_t index, const glm::vec3& center, float sphere_radius)
+{
+	x[index] = center.x;
+	y[index] = center.y;
+	z[index] = center.z;
+	radius[index] = sphere_radius;
+}
+
+/* Culling */
+CullStats CullSpheres(
+	const float* x, const float* y, const float* z, const float* radius, size_t count,
+	const Frustum& frustum,
+	const glm::vec3& camera_position,
+	const SphereOccluder& occluder,
+	uint8_t* visible
+)
+{
+	/*
+		Horizon test: a sphere is hidden when it lies inside the cone from the camera
+		tangent to the occluder and starts farther away than the tangent points.
+		The near surface of the occluder is never farther than the tangent length,
+		so this only culls what is really hidden.
+	*/
+	glm::vec3 to_occluder = occluder.center - camera_position;
+	float occluder_distance_squared = glm::dot(to_occluder, to_occluder);
+	float occluder_radius_squared = occluder.radius * occluder.radius;
+	bool horizon_enabled = occluder_distance_squared > occluder_radius_squared;
+
+	float occluder_distance = glm::sqrt(occluder_distance_squared);
+	float tangent_length = horizon_enabled ? glm::sqrt(occluder_distance_squared - occluder_radius_squared) : 0.f;
+	glm::vec3 axis = horizon_enabled ? to_occluder / occluder_distance : glm::vec3(0);
+	float cone_cos = horizon_enabled ? tangent_length / occluder_distance : 0.f;
+	float cone_sin = horizon_enabled ? occluder.radius / occluder_distance : 0.f;
+
+	CullStats stats = { count, 0, 0 };
+
+	/* Branch free so the compiler can vectorize the loop */
+	for (size_t i = 0; i < count; ++i)
+	{
+		float r = radius[i];
+
+		bool inside = true;
+		for (const auto& plane : frustum.planes)
+			inside &= plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w >= -r;
+
+		float vx = x[i] - camera_position.x;
+		float vy = y[i] - camera_position.y;
+		float vz = z[i] - camera_position.z;
+		float distance_squared = vx * vx + vy * vy + vz * vz;
+		float distance = glm::sqrt(distance_squared);
+		float along_axis = vx * axis.x + vy * axis.y + vz * axis.z;
+
+		/* angle(v, axis) + asin(r / distance) <= cone half angle, written without trig */
+		bool beyond_horizon = distance - r >= tangent_length;
+		bool narrower_than_cone = r * occluder_distance <= occluder.radius * distance;
+		bool inside_cone = along_axis >= cone_cos * glm::sqrt(glm::max(distance_squared - r * r, 0.f)) + cone_sin * r;
+		bool occluded = horizon_enabled & beyond_horizon & narrower_than_cone & inside_cone;
+
+		visible[i] = uint8_t(inside & !occluded);
+		stats.frustum_culled += !inside;
+		stats.horizon_culled += inside & occluded;
+	}
+
+	return stats;
+}
+
+CullStats CullSpheres(
+	const BoundingSpheres& spheres,
+	const Frustum& frustum,
+	const glm::vec3& camera_position,
+	const SphereOccluder& occluder,
+	std::vector<uint8_t>& visible
+)
+{
+	visible.resize(spheres.Size());
+	return CullSpheres(
+		spheres.x.data(), spheres.y.data(), spheres.z.data(), spheres.radius.data(), spheres.Size(),
+		frustum, camera_position, occluder, visible.data());
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GLM/glm.hpp"
+
+/* Culling: bounding sphere tests against the view frustum and the planet horizon */
+
+/* Plane normals point into the frustum, w is the plane distance */
+struct Frustum
+{
+	glm::vec4 planes[6];
+};
+
+/* Works for any view_projection with the GL -1..1 clip volume */
+Frustum ExtractFrustum(const glm::mat4& view_projection);
+
+/* A solid sphere, everything fully behind it as seen from the camera is hidden */
+struct SphereOccluder
+{
+	glm::vec3 center;
+	float radius;
+};
+
+struct CullStats
+{
+	size_t tested;
+	size_t frustum_culled;
+	size_t horizon_culled;
+};
+
+/* Structure of arrays so CullSpheres streams through plain float arrays */
+struct BoundingSpheres
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+
+	size_t Size() const { return x.size(); }
+	void Clear();
+	size_t Add(const glm::vec3& center, float sphere_radius);
+	/* For filling by index, from several threads at once */
+	void Resize(size_t count);
+	void Set(size_t index, const glm::vec3& center, float sphere_radius);
+};
+
+/* Writes 1 into visible[i] when sphere i may be seen, 0 when it is culled */
+CullStats CullSpheres(
+	const float* x, const float* y, const float* z, const float* radius, size_t count,
+	const Frustum& frustum,
+	const glm::vec3& camera_position,
+	const SphereOccluder& occluder,
+	uint8_t* visible
+);
+
+CullStats CullSpheres(
+	const BoundingSpheres& spheres,
+	const Frustum& frustum,
+	const glm::vec3& camera_position,
+	const SphereOccluder& occluder,
+	std::vector<uint8_t>& visible
+);
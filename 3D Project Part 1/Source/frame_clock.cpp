@@ -0,0 +1,34 @@
+#include "frame_clock.h"
+
+/* Frame Clock */
+FrameClock::FrameClock(double tick_seconds, int max_ticks_per_frame)
+	: start(std::chrono::steady_clock::now()),
+	tick_seconds(tick_seconds),
+	max_ticks_per_frame(max_ticks_per_frame),
+	time(0),
+	frame_seconds(0),
+	accumulator(0),
+	tick_count(0)
+{
+}
+
+int FrameClock::BeginFrame()
+{
+	double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	frame_seconds = now - time;
+	time = now;
+
+	accumulator += frame_seconds;
+	int ticks = 0;
+	while (accumulator >= tick_seconds && ticks < max_ticks_per_frame)
+	{
+		accumulator -= tick_seconds;
+		++ticks;
+	}
+
+	/* Dropped ticks are gone, rendering stays within one tick of the simulation */
+	if (accumulator >= tick_seconds)
+		accumulator = tick_seconds;
+	tick_count += uint64_t(ticks);
+	return ticks;
+}
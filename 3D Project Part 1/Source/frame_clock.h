@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+/*
+	Frame Clock: the only time source of the main loop, sampled once per frame. The
+	simulation advances in fixed ticks out of an accumulator, so its results depend on
+	the tick count alone and not on the frame rate. What is left in the accumulator is
+	how far rendering is between the last two ticks.
+*/
+class FrameClock
+{
+public:
+	/* At most max_ticks_per_frame ticks are run per frame, a long stall slows the simulation down instead of piling up ticks */
+	FrameClock(double tick_seconds, int max_ticks_per_frame);
+
+	/* Samples the time, returns how many ticks to simulate before rendering this frame */
+	int BeginFrame();
+
+	/* Seconds since the clock was created, as sampled by the last BeginFrame */
+	double Time() const { return time; }
+	double FrameSeconds() const { return frame_seconds; }
+	double TickSeconds() const { return tick_seconds; }
+	uint64_t TickCount() const { return tick_count; }
+
+	/* 0 renders the previous tick, 1 the latest one */
+	float Alpha() const { return float(accumulator / tick_seconds); }
+
+private:
+	std::chrono::steady_clock::time_point start;
+	double tick_seconds;
+	int max_ticks_per_frame;
+	double time;
+	double frame_seconds;
+	double accumulator;
+	uint64_t tick_count;
+};
@@ -0,0 +1,80 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+static const int max_frame_counters = 64;
+
+static struct
+{
+	const char* names[max_frame_counters];
+	double values[max_frame_counters];
+	int count = 0;
+	bool enabled = false;
+	double last_print = 0;
+} FrameStats;
+
+void SetFrameCounter(const char* name, double value)
+{
+	for (int i = 0; i < FrameStats.count; ++i)
+	{
+		if (FrameStats.names[i] == name)
+		{
+			FrameStats.values[i] = value;
+			return;
+		}
+	}
+
+	if (FrameStats.count == max_frame_counters)
+		return;
+
+	FrameStats.names[FrameStats.count] = name;
+	FrameStats.values[FrameStats.count] = value;
+	++FrameStats.count;
+}
+
+void EnableFrameStats(bool enabled)
+{
+	FrameStats.enabled = enabled;
+}
+
+bool FrameStatsEnabled()
+{
+	return FrameStats.enabled;
+}
+
+void PrintFrameStats(double time)
+{
+	if (!FrameStats.enabled || time - FrameStats.last_print < 1.0)
+		return;
+	FrameStats.last_print = time;
+
+	for (int i = 0; i < FrameStats.count; ++i)
+		std::cout << FrameStats.names[i] << ": " << FrameStats.values[i] << (i + 1 < FrameStats.count ? "  " : "");
+	std::cout << std::endl;
+}
+
+/* Frame Time Log */
+void FrameTimeLog::Print(const char* label) const
+{
+	if (milliseconds.empty())
+		return;
+
+	double sum = 0.0;
+	for (float frame : milliseconds)
+		sum += frame;
+	double mean = sum / milliseconds.size();
+	double squares = 0.0;
+	for (float frame : milliseconds)
+		squares += (frame - mean) * (frame - mean);
+
+	std::vector<float> sorted = milliseconds;
+	std::sort(sorted.begin(), sorted.end());
+	float percentile = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+
+	std::cout << std::fixed << std::setprecision(2) << label << ": " << milliseconds.size() << " frames, mean " << mean
+		<< " ms, std dev " << std::sqrt(squares / milliseconds.size()) << " ms, 99% " << percentile << " ms, longest " << sorted.back() << " ms" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+}
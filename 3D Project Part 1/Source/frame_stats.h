@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+/* Frame Stats: named per-frame counters, printed at most once a second while enabled */
+
+/* name must outlive the program, counters are matched by pointer */
+void SetFrameCounter(const char* name, double value);
+
+void EnableFrameStats(bool enabled);
+bool FrameStatsEnabled();
+
+/* Call once per frame with the current time in seconds */
+void PrintFrameStats(double time);
+
+/*
+	Frame Time Log: every frame time of a session, summarized once at the end. The
+	standard deviation and the slowest frames show how even the frames were, which the
+	average hides.
+*/
+class FrameTimeLog
+{
+public:
+	void Add(double seconds) { milliseconds.push_back(float(seconds * 1000.0)); }
+
+	/* Frame count, mean, standard deviation, 99th percentile and longest frame */
+	void Print(const char* label) const;
+
+private:
+	std::vector<float> milliseconds;
+};
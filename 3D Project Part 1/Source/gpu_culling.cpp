@@ -0,0 +1,352 @@
+#include "gpu_culling.h"
+
+#include <cstddef>
+#include "GLM/gtc/type_ptr.hpp"
+
+/* Layout glMultiDrawElementsIndirect reads */
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLuint base_vertex;
+	GLuint base_instance;
+};
+
+static const char* cull_vertex_source = R"VERTEX(
+#version 330 core
+
+layout(location = 0) in mat4 a_model;
+
+out mat4 v_model;
+
+void main()
+{
+	v_model = a_model;
+}
+)VERTEX";
+
+/* Same tests as CullSpheres in culling.cpp */
+static const char* cull_geometry_source = R"GEOMETRY(
+#version 330 core
+
+layout(points) in;
+layout(points, max_vertices = 4) out;
+
+uniform vec4 u_frustum[6];
+uniform vec3 u_eye;
+uniform vec4 u_occluder;
+uniform float u_radius;
+uniform mat4 u_local[4];
+uniform int u_local_count;
+
+in mat4 v_model[];
+
+out mat4 out_model;
+
+bool Visible(vec3 center, float radius)
+{
+	for (int i = 0; i < 6; ++i)
+		if (dot(u_frustum[i].xyz, center) + u_frustum[i].w < -radius)
+			return false;
+
+	vec3 to_occluder = u_occluder.xyz - u_eye;
+	float occluder_distance_squared = dot(to_occluder, to_occluder);
+	float occluder_radius_squared = u_occluder.w * u_occluder.w;
+	if (occluder_distance_squared <= occluder_radius_squared)
+		return true;
+
+	float occluder_distance = sqrt(occluder_distance_squared);
+	float tangent_length = sqrt(occluder_distance_squared - occluder_radius_squared);
+	vec3 axis = to_occluder / occluder_distance;
+
+	vec3 v = center - u_eye;
+	float distance_squared = dot(v, v);
+	float distance = sqrt(distance_squared);
+
+	bool beyond_horizon = distance - radius >= tangent_length;
+	bool narrower_than_cone = radius * occluder_distance <= u_occluder.w * distance;
+	bool inside_cone = dot(v, axis) * occluder_distance >= tangent_length * sqrt(max(distance_squared - radius * radius, 0)) + u_occluder.w * radius;
+	return !(beyond_horizon && narrower_than_cone && inside_cone);
+}
+
+void main()
+{
+	mat4 model = v_model[0];
+	if (!Visible(model[3].xyz, u_radius))
+		return;
+
+	for (int i = 0; i < u_local_count; ++i)
+	{
+		out_model = model * u_local[i];
+		EmitVertex();
+		EndPrimitive();
+	}
+}
+)GEOMETRY";
+
+static GLuint CreateCullProgram()
+{
+	GLuint vertex_shader = CreateShaderFromSource(GL_VERTEX_SHADER, cull_vertex_source);
+	GLuint geometry_shader = CreateShaderFromSource(GL_GEOMETRY_SHADER, cull_geometry_source);
+	if (vertex_shader == 0 || geometry_shader == 0)
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, geometry_shader);
+
+	const GLchar* varyings[] = { "out_model" };
+	glTransformFeedbackVaryings(program, 1, varyings, GL_INTERLEAVED_ATTRIBS);
+	glLinkProgram(program);
+
+	glDetachShader(program, vertex_shader);
+	glDetachShader(program, geometry_shader);
+	glDeleteShader(vertex_shader);
+	glDeleteShader(geometry_shader);
+
+	if (!CheckProgramLinkStatus(program))
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+/* GPU Rover Culler */
+GpuRoverCuller::GpuRoverCuller(const VAO& body_mesh, const VAO& wheel_mesh, size_t max_rovers)
+	: body_mesh(body_mesh),
+	wheel_mesh(wheel_mesh),
+	max_rovers(max_rovers),
+	indirect(GLAD_GL_ARB_multi_draw_indirect && GLAD_GL_ARB_query_buffer_object),
+	sets(),
+	pass_count(0),
+	draw_set(0)
+{
+	program = CreateCullProgram();
+	if (program == 0)
+		return;
+
+	frustum_location = glGetUniformLocation(program, "u_frustum");
+	eye_location = glGetUniformLocation(program, "u_eye");
+	occluder_location = glGetUniformLocation(program, "u_occluder");
+	radius_location = glGetUniformLocation(program, "u_radius");
+	local_location = glGetUniformLocation(program, "u_local");
+	local_count_location = glGetUniformLocation(program, "u_local_count");
+
+	glGenBuffers(1, &input_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, input_buffer);
+	glBufferData(GL_ARRAY_BUFFER, max_rovers * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+
+	glGenVertexArrays(1, &input_vao);
+	glBindVertexArray(input_vao);
+	for (GLuint column = 0; column < 4; ++column)
+	{
+		glVertexAttribPointer(column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(column * sizeof(glm::vec4)));
+		glEnableVertexAttribArray(column);
+	}
+	glBindVertexArray(0);
+
+	/* The indirect path draws right after culling, so GPU ordering makes one set enough */
+	for (OutputSet& set : sets)
+	{
+		glGenBuffers(1, &set.body_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, set.body_buffer);
+		glBufferData(GL_ARRAY_BUFFER, max_rovers * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+
+		glGenBuffers(1, &set.wheel_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, set.wheel_buffer);
+		glBufferData(GL_ARRAY_BUFFER, 4 * max_rovers * sizeof(glm::mat4), NULL, GL_DYNAMIC_COPY);
+
+		set.body_vao = CreateInstancedVAO(body_mesh, set.body_buffer);
+		set.wheel_vao = CreateInstancedVAO(wheel_mesh, set.wheel_buffer);
+
+		glGenQueries(1, &set.body_query);
+		glGenQueries(1, &set.wheel_query);
+		set.body_count = 0;
+		set.wheel_count = 0;
+		set.pass = 0;
+		set.pending = false;
+
+		if (indirect)
+			break;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	indirect_buffer = 0;
+	if (indirect)
+	{
+		DrawElementsIndirectCommand commands[2] =
+		{
+			{ GLuint(body_mesh.element_array_count), 0, 0, 0, 0 },
+			{ GLuint(wheel_mesh.element_array_count), 0, 0, 0, 0 },
+		};
+
+		glGenBuffers(1, &indirect_buffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(commands), commands, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+}
+
+GpuRoverCuller::~GpuRoverCuller()
+{
+	if (!Valid())
+		return;
+
+	/* The unused sets of the indirect path hold zeros, which GL ignores */
+	for (OutputSet& set : sets)
+	{
+		GLuint buffers[2] = { set.body_buffer, set.wheel_buffer };
+		GLuint vaos[2] = { set.body_vao, set.wheel_vao };
+		GLuint queries[2] = { set.body_query, set.wheel_query };
+		glDeleteVertexArrays(2, vaos);
+		glDeleteBuffers(2, buffers);
+		glDeleteQueries(2, queries);
+	}
+	glDeleteVertexArrays(1, &input_vao);
+	glDeleteBuffers(1, &input_buffer);
+	glDeleteBuffers(1, &indirect_buffer);
+	glDeleteProgram(program);
+}
+
+void GpuRoverCuller::Cull(
+	const glm::mat4* rover_models, size_t rover_count, float bounding_radius,
+	const glm::mat4& body_local, const glm::mat4* wheel_local,
+	const Frustum& frustum, const glm::vec3& camera_position, const SphereOccluder& occluder
+)
+{
+	if (!Valid())
+		return;
+
+	rover_count = glm::min(rover_count, max_rovers);
+
+	/* Overwrite the oldest set other than the one drawn */
+	int write_set = 0;
+	if (!indirect)
+	{
+		write_set = -1;
+		for (int i = 0; i < 3; ++i)
+			if (i != draw_set && (write_set < 0 || sets[i].pass < sets[write_set].pass))
+				write_set = i;
+	}
+	OutputSet& set = sets[write_set];
+
+	/* Orphan the old storage so the upload does not wait for last frame's cull pass */
+	glBindBuffer(GL_ARRAY_BUFFER, input_buffer);
+	glBufferData(GL_ARRAY_BUFFER, max_rovers * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, rover_count * sizeof(glm::mat4), rover_models);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glUseProgram(program);
+	glUniform4fv(frustum_location, 6, glm::value_ptr(frustum.planes[0]));
+	glUniform3fv(eye_location, 1, glm::value_ptr(camera_position));
+	glUniform4fv(occluder_location, 1, glm::value_ptr(glm::vec4(occluder.center, occluder.radius)));
+	glUniform1f(radius_location, bounding_radius);
+
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(input_vao);
+
+	auto runPass = [&](GLuint output_buffer, GLuint query, const glm::mat4* local, int local_count)
+	{
+		glUniformMatrix4fv(local_location, local_count, GL_FALSE, glm::value_ptr(local[0]));
+		glUniform1i(local_count_location, local_count);
+
+		glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, output_buffer);
+		glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, query);
+		glBeginTransformFeedback(GL_POINTS);
+		glDrawArrays(GL_POINTS, 0, GLsizei(rover_count));
+		glEndTransformFeedback();
+		glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+	};
+	runPass(set.body_buffer, set.body_query, &body_local, 1);
+	runPass(set.wheel_buffer, set.wheel_query, wheel_local, 4);
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	set.pass = ++pass_count;
+	set.pending = true;
+
+	if (indirect)
+	{
+		/* With a query buffer bound the "pointer" is an offset, the GPU writes the result there */
+		glBindBuffer(GL_QUERY_BUFFER, indirect_buffer);
+		glGetQueryObjectuiv(set.body_query, GL_QUERY_RESULT,
+			reinterpret_cast<GLuint*>(offsetof(DrawElementsIndirectCommand, instance_count)));
+		glGetQueryObjectuiv(set.wheel_query, GL_QUERY_RESULT,
+			reinterpret_cast<GLuint*>(sizeof(DrawElementsIndirectCommand) + offsetof(DrawElementsIndirectCommand, instance_count)));
+		glBindBuffer(GL_QUERY_BUFFER, 0);
+		return;
+	}
+
+	/* Only results GL reports available are read, so this never stalls on the GPU */
+	for (int i = 0; i < 3; ++i)
+	{
+		OutputSet& candidate = sets[i];
+		if (!candidate.pending)
+			continue;
+
+		GLuint body_available = GL_FALSE;
+		GLuint wheel_available = GL_FALSE;
+		glGetQueryObjectuiv(candidate.body_query, GL_QUERY_RESULT_AVAILABLE, &body_available);
+		glGetQueryObjectuiv(candidate.wheel_query, GL_QUERY_RESULT_AVAILABLE, &wheel_available);
+		if (!body_available || !wheel_available)
+			continue;
+
+		glGetQueryObjectuiv(candidate.body_query, GL_QUERY_RESULT, &candidate.body_count);
+		glGetQueryObjectuiv(candidate.wheel_query, GL_QUERY_RESULT, &candidate.wheel_count);
+		candidate.pending = false;
+		if (candidate.pass > sets[draw_set].pass)
+			draw_set = i;
+	}
+}
+
+const GpuRoverCuller::OutputSet& GpuRoverCuller::DrawSet() const
+{
+	return sets[draw_set];
+}
+
+GLuint GpuRoverCuller::BodyVAO() const
+{
+	return DrawSet().body_vao;
+}
+
+GLuint GpuRoverCuller::WheelVAO() const
+{
+	return DrawSet().wheel_vao;
+}
+
+void GpuRoverCuller::DrawBodies() const
+{
+	if (!Valid())
+		return;
+
+	if (indirect)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<void *>(0), 1, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else if (DrawSet().body_count > 0)
+	{
+		glDrawElementsInstanced(GL_TRIANGLES, body_mesh.element_array_count, GL_UNSIGNED_INT, NULL, DrawSet().body_count);
+	}
+}
+
+void GpuRoverCuller::DrawWheels() const
+{
+	if (!Valid())
+		return;
+
+	if (indirect)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, reinterpret_cast<void *>(sizeof(DrawElementsIndirectCommand)), 1, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else if (DrawSet().wheel_count > 0)
+	{
+		glDrawElementsInstanced(GL_TRIANGLES, wheel_mesh.element_array_count, GL_UNSIGNED_INT, NULL, DrawSet().wheel_count);
+	}
+}
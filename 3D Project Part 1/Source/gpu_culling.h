@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GLAD/glad.h"
+#include "GLM/glm.hpp"
+#include "culling.h"
+#include "opengl_utilities.h"
+
+/*
+	GPU Rover Culling: every rover is one point through a vertex + geometry shader pass
+	that tests its bounding sphere against the frustum and the planet horizon and writes
+	the model matrices of the visible rover bodies and wheels with transform feedback.
+	The CPU never waits for the visible count:
+	- Indirect path (ARB_multi_draw_indirect + ARB_query_buffer_object): the
+	  primitives-written queries are resolved straight into the instanceCount of the
+	  indirect draw commands on the GPU, the count never comes back to the CPU.
+	- GL 3.3 path: a ring of three output sets, each with its own counts. A set's
+	  count is read once GL reports it available and the draw uses the newest set whose
+	  count is in, so a count always matches its buffers. Rovers are drawn at least one
+	  frame late, more when the GPU falls behind.
+*/
+class GpuRoverCuller
+{
+public:
+	/* Must be constructed with a current context */
+	GpuRoverCuller(const VAO& body_mesh, const VAO& wheel_mesh, size_t max_rovers);
+	/* Deletes the GL objects, destroy it before the context */
+	~GpuRoverCuller();
+
+	bool Valid() const { return program != 0; }
+	bool Indirect() const { return indirect; }
+
+	/* body_local and the four wheel_local transforms are applied after each rover model */
+	void Cull(
+		const glm::mat4* rover_models, size_t rover_count, float bounding_radius,
+		const glm::mat4& body_local, const glm::mat4* wheel_local,
+		const Frustum& frustum, const glm::vec3& camera_position, const SphereOccluder& occluder
+	);
+
+	/* Instanced VAOs to bind for the draws below, each has a mat4 per instance at locations 3 to 6 */
+	GLuint BodyVAO() const;
+	GLuint WheelVAO() const;
+
+	/* Expects the VAO above and an INSTANCING program to be bound */
+	void DrawBodies() const;
+	void DrawWheels() const;
+
+private:
+	struct OutputSet
+	{
+		GLuint body_buffer;
+		GLuint wheel_buffer;
+		GLuint body_vao;
+		GLuint wheel_vao;
+		GLuint body_query;
+		GLuint wheel_query;
+		GLuint body_count;
+		GLuint wheel_count;
+		/* Cull pass that last wrote the set, 0 if none */
+		unsigned long long pass;
+		/* Written but its counts are not read yet */
+		bool pending;
+	};
+
+	const OutputSet& DrawSet() const;
+
+	const VAO& body_mesh;
+	const VAO& wheel_mesh;
+	size_t max_rovers;
+	bool indirect;
+
+	GLuint program;
+	GLint frustum_location;
+	GLint eye_location;
+	GLint occluder_location;
+	GLint radius_location;
+	GLint local_location;
+	GLint local_count_location;
+
+	GLuint input_buffer;
+	GLuint input_vao;
+	GLuint indirect_buffer;
+
+	OutputSet sets[3];
+	unsigned long long pass_count;
+	int draw_set;
+};
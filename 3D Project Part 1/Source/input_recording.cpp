@@ -0,0 +1,88 @@
+#include "input_recording.h"
+
+#include <cstring>
+#include <fstream>
+
+static const unsigned char input_recording_identifier[12] = { 0xAB, 'M', 'I', 'R', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static bool SameInput(const InputEvent& event, const SimulationInput& input)
+{
+	return event.key == uint8_t(input.key) && event.held == uint8_t(input.held) && event.rover_cam == uint8_t(input.rover_cam);
+}
+
+/* Input Recorder */
+void InputRecorder::Record(uint64_t tick, const SimulationInput& input)
+{
+	if (!events.empty() && SameInput(events.back(), input))
+		return;
+
+	InputEvent event;
+	event.tick = uint32_t(tick);
+	event.key = uint8_t(input.key);
+	event.held = input.held ? 1 : 0;
+	event.rover_cam = input.rover_cam ? 1 : 0;
+	event.reserved = 0;
+	events.push_back(event);
+}
+
+bool InputRecorder::Save(const std::string& path, const Simulation& simulation) const
+{
+	InputRecordingHeader header;
+	std::memcpy(header.identifier, input_recording_identifier, sizeof(header.identifier));
+	header.tick_rate = uint32_t(simulation.TickRate());
+	header.rover_count = uint32_t(simulation.RoverCount());
+	header.event_count = uint32_t(events.size());
+	header.collision_mode = 0;
+	if (simulation.ContinuousCollision())
+		header.collision_mode |= RECORDING_CONTINUOUS_COLLISION;
+	if (!simulation.StopOnCollision())
+		header.collision_mode |= RECORDING_NO_COLLISION_STOP;
+	header.reserved = 0;
+	header.tick_count = simulation.TickCount();
+	header.final_state_hash = simulation.StateHash();
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(events.data()), std::streamsize(sizeof(InputEvent) * events.size()));
+	return bool(file);
+}
+
+/* Input Replay */
+bool InputReplay::Load(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	InputRecordingHeader candidate;
+	if (!file.read(reinterpret_cast<char*>(&candidate), sizeof(candidate)) ||
+		std::memcmp(candidate.identifier, input_recording_identifier, sizeof(input_recording_identifier)) != 0)
+		return false;
+
+	std::vector<InputEvent> candidate_events(candidate.event_count);
+	if (!file.read(reinterpret_cast<char*>(candidate_events.data()), std::streamsize(sizeof(InputEvent) * candidate_events.size())))
+		return false;
+
+	header = candidate;
+	events.swap(candidate_events);
+	Rewind();
+	return true;
+}
+
+SimulationInput InputReplay::Input(uint64_t tick)
+{
+	while (next_event < events.size() && events[next_event].tick <= tick)
+	{
+		const InputEvent& event = events[next_event++];
+		current.key = SimulationKey(event.key);
+		current.held = event.held != 0;
+		current.rover_cam = event.rover_cam != 0;
+	}
+	return current;
+}
+
+void InputReplay::Rewind()
+{
+	next_event = 0;
+	current = SimulationInput();
+}
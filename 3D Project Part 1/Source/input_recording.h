@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "simulation.h"
+
+/*
+	Input Recording: the input every simulation tick saw, stored as the ticks where it
+	changed. Replaying it into a simulation with the same rover count reproduces the
+	recorded state bit for bit, whatever the frame rate. The final state hash is kept to
+	check that. The tick rate and the collision mode change the state as well, a replay
+	runs with the ones in the header. No GL.
+*/
+enum InputRecordingCollision : uint32_t
+{
+	RECORDING_CONTINUOUS_COLLISION = 1,
+	RECORDING_NO_COLLISION_STOP = 2
+};
+
+struct InputRecordingHeader
+{
+	unsigned char identifier[12];
+	uint32_t tick_rate;
+	uint32_t rover_count;
+	uint32_t event_count;
+	/* InputRecordingCollision flags */
+	uint32_t collision_mode;
+	uint32_t reserved;
+	uint64_t tick_count;
+	uint64_t final_state_hash;
+};
+
+/* The input from tick on, until the next event */
+struct InputEvent
+{
+	uint32_t tick;
+	uint8_t key;
+	uint8_t held;
+	uint8_t rover_cam;
+	uint8_t reserved;
+};
+
+class InputRecorder
+{
+public:
+	/* Call before every tick with the input it is given */
+	void Record(uint64_t tick, const SimulationInput& input);
+
+	/* The tick rate and the collision mode are taken from the simulation */
+	bool Save(const std::string& path, const Simulation& simulation) const;
+
+	size_t EventCount() const { return events.size(); }
+
+private:
+	std::vector<InputEvent> events;
+};
+
+class InputReplay
+{
+public:
+	/* False when the file is missing or not a recording */
+	bool Load(const std::string& path);
+
+	const InputRecordingHeader& Header() const { return header; }
+	bool ContinuousCollision() const { return (header.collision_mode & RECORDING_CONTINUOUS_COLLISION) != 0; }
+	bool StopOnCollision() const { return (header.collision_mode & RECORDING_NO_COLLISION_STOP) == 0; }
+	bool Finished(uint64_t tick) const { return tick >= header.tick_count; }
+
+	/* The input of the tick, ticks have to be asked for in increasing order */
+	SimulationInput Input(uint64_t tick);
+
+	/* Starts over at tick 0 */
+	void Rewind();
+
+private:
+	InputRecordingHeader header = {};
+	std::vector<InputEvent> events;
+	size_t next_event = 0;
+	SimulationInput current;
+};
@@ -0,0 +1,259 @@
+#include "job_system.h"
+
+#include <chrono>
+
+/* Tries before an idle worker goes to sleep, so jobs queued right after are picked up without a wake up */
+static const int idle_spins = 64;
+
+static std::atomic<unsigned long long> next_system_id(1);
+
+/* The system and slot of the current thread, set when the thread first queues or runs a job */
+static thread_local unsigned long long current_system = 0;
+static thread_local unsigned current_slot = 0;
+
+JobSystem::JobSystem(unsigned thread_count)
+	: id(next_system_id++),
+	queued(0),
+	stopping(false),
+	timing(false)
+{
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < thread_count + max_other_threads; ++i)
+		slots.emplace_back(new Slot());
+	slot_count = thread_count;
+
+	current_system = id;
+	current_slot = 0;
+	for (unsigned i = 1; i < thread_count; ++i)
+		workers.emplace_back(&JobSystem::Work, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	job_queued.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+
+	/* Every job is back on a free list once it has run */
+	for (std::unique_ptr<Slot>& slot : slots)
+		for (Job* job : slot->free_jobs)
+			delete job;
+}
+
+size_t JobSystem::ChunkSize(size_t count, size_t grain) const
+{
+	size_t chunks = size_t(ThreadCount()) * 4;
+	return std::max(std::max<size_t>(grain, 1), (count + chunks - 1) / chunks);
+}
+
+unsigned JobSystem::CurrentSlot()
+{
+	if (current_system == id)
+		return current_slot;
+
+	/* A thread new to the system takes the next spare slot, once they are gone it shares the first one */
+	unsigned slot = slot_count.load();
+	while (slot < slots.size() && !slot_count.compare_exchange_weak(slot, slot + 1))
+	{
+	}
+	current_system = id;
+	current_slot = slot < slots.size() ? slot : 0;
+	return current_slot;
+}
+
+Job* JobSystem::Allocate(const char* name, JobCounter* counter)
+{
+	if (counter)
+		++counter->pending;
+
+	unsigned owner = CurrentSlot();
+	Slot& slot = *slots[owner];
+	Job* job = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(slot.mutex);
+		if (!slot.free_jobs.empty())
+		{
+			job = slot.free_jobs.back();
+			slot.free_jobs.pop_back();
+		}
+	}
+	if (!job)
+		job = new Job();
+
+	job->name = name;
+	job->counter = counter;
+	job->owner = owner;
+	return job;
+}
+
+void JobSystem::Queue(Job* job, JobCounter* dependency)
+{
+	if (dependency)
+	{
+		/* Checked under the lock the last job of the dependency releases the held jobs with */
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->pending.load() != 0)
+		{
+			dependency->held.push_back(job);
+			return;
+		}
+	}
+	Push(job);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	unsigned slot = CurrentSlot();
+	while (!counter.Done())
+	{
+		if (Job* job = Take(slot))
+			Execute(job, slot);
+		else
+			std::this_thread::yield();
+	}
+	/* The thread that finished the last job may still hold the lock */
+	std::lock_guard<std::mutex> lock(counter.mutex);
+}
+
+std::vector<JobTiming> JobSystem::TakeTimings()
+{
+	std::vector<JobTiming> result;
+	for (unsigned i = 0; i < slot_count.load(); ++i)
+	{
+		Slot* slot = slots[i].get();
+		std::lock_guard<std::mutex> lock(slot->mutex);
+		for (const TimingRecord& record : slot->timings)
+		{
+			auto existing = std::find_if(result.begin(), result.end(), [&](const JobTiming& timing) { return timing.name == record.name; });
+			if (existing == result.end())
+			{
+				JobTiming timing = { record.name, 0, 0.0, 0.0 };
+				result.push_back(timing);
+				existing = result.end() - 1;
+			}
+			++existing->jobs;
+			existing->milliseconds += record.milliseconds;
+			existing->longest_milliseconds = std::max(existing->longest_milliseconds, record.milliseconds);
+		}
+		slot->timings.clear();
+	}
+	return result;
+}
+
+void JobSystem::Push(Job* job)
+{
+	Slot& slot = *slots[CurrentSlot()];
+	{
+		std::lock_guard<std::mutex> lock(slot.mutex);
+		if (slot.front > 0 && slot.front * 2 >= slot.jobs.size())
+		{
+			slot.jobs.erase(slot.jobs.begin(), slot.jobs.begin() + slot.front);
+			slot.front = 0;
+		}
+		slot.jobs.push_back(job);
+	}
+	++queued;
+
+	/* Taking the lock orders the push before a worker's last check and its sleep */
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	job_queued.notify_one();
+}
+
+Job* JobSystem::Take(unsigned slot)
+{
+	/* The newest job of our own deque, else the oldest of another */
+	unsigned count = slot_count.load();
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Slot& source = *slots[(slot + i) % count];
+		std::lock_guard<std::mutex> lock(source.mutex);
+		if (source.front == source.jobs.size())
+			continue;
+		Job* job;
+		if (i == 0)
+		{
+			job = source.jobs.back();
+			source.jobs.pop_back();
+		}
+		else
+		{
+			job = source.jobs[source.front++];
+		}
+		if (source.front == source.jobs.size())
+		{
+			source.jobs.clear();
+			source.front = 0;
+		}
+		--queued;
+		return job;
+	}
+	return nullptr;
+}
+
+void JobSystem::Execute(Job* job, unsigned slot)
+{
+	if (timing)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		job->run(*job);
+		TimingRecord record = { job->name, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() };
+		std::lock_guard<std::mutex> lock(slots[slot]->mutex);
+		slots[slot]->timings.push_back(record);
+	}
+	else
+	{
+		job->run(*job);
+	}
+	job->destroy(*job);
+
+	if (JobCounter* counter = job->counter)
+	{
+		std::vector<Job*> released;
+		{
+			std::lock_guard<std::mutex> lock(counter->mutex);
+			if (--counter->pending == 0)
+				released.swap(counter->held);
+		}
+		for (Job* next : released)
+			Push(next);
+	}
+
+	Slot& owner = *slots[job->owner];
+	std::lock_guard<std::mutex> lock(owner.mutex);
+	owner.free_jobs.push_back(job);
+}
+
+void JobSystem::Work(unsigned slot)
+{
+	current_system = id;
+	current_slot = slot;
+
+	int idle = 0;
+	for (;;)
+	{
+		if (Job* job = Take(slot))
+		{
+			Execute(job, slot);
+			idle = 0;
+			continue;
+		}
+		if (++idle < idle_spins)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		job_queued.wait(lock, [this]() { return stopping || queued.load() > 0; });
+		if (stopping && queued.load() == 0)
+			return;
+		idle = 0;
+	}
+}
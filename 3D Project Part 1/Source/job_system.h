@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class JobCounter;
+
+/*
+	A queued job. Jobs are recycled through the free list of the slot that allocated them,
+	the work is stored in place unless it is larger than the storage.
+*/
+struct Job
+{
+	static const size_t storage_bytes = 192;
+
+	const char* name;
+	JobCounter* counter;
+	unsigned owner;
+	void (*run)(Job& job);
+	void (*destroy)(Job& job);
+	std::aligned_storage<storage_bytes>::type storage;
+};
+
+/*
+	Counts the unfinished jobs started with it. Jobs can be held back until a counter
+	reaches zero, they are queued by the thread that finishes its last job. Wait for a
+	counter before destroying it.
+*/
+class JobCounter
+{
+public:
+	JobCounter() : pending(0) {}
+
+	bool Done() const { return pending.load() == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<int> pending;
+	std::mutex mutex;
+	std::vector<Job*> held;
+};
+
+/* Time spent in the jobs of one name */
+struct JobTiming
+{
+	const char* name;
+	size_t jobs;
+	double milliseconds;
+	double longest_milliseconds;
+};
+
+/*
+	Job System: worker threads running small jobs, each thread with its own deque. A
+	thread pushes and pops its own jobs at the back, where the data is still in its cache.
+	Idle threads steal from the front of the other deques, so the work spreads out
+	without a single shared queue.
+	- The thread that created the system is worker 0. Any other thread that queues jobs
+	  gets a deque of its own the first time, so two threads never pop each other's
+	  newest jobs. A thread waiting for a counter runs jobs in the meantime.
+	- Jobs come from free lists and small work is stored in the job, queuing allocates
+	  nothing once the lists are warm.
+	- ParallelFor splits an index range into chunks, about four per thread.
+	- With timing enabled every job's time is recorded under its name.
+	No GL.
+*/
+class JobSystem
+{
+public:
+	/* Threads that are not workers and can queue jobs at the same time as the creating thread */
+	static const unsigned max_other_threads = 4;
+
+	/* Threads including the calling one, 0 uses one per hardware thread */
+	explicit JobSystem(unsigned thread_count = 0);
+	/* Every job has to be finished */
+	~JobSystem();
+
+	unsigned ThreadCount() const { return unsigned(workers.size()) + 1; }
+
+	/* counter may be NULL, the job waits for dependency to reach zero when one is given. name must be a literal */
+	template <typename Task>
+	void Run(const char* name, Task work, JobCounter* counter = nullptr, JobCounter* dependency = nullptr)
+	{
+		Job* job = Allocate(name, counter);
+		Store(*job, std::move(work), std::integral_constant<bool, sizeof(Task) <= Job::storage_bytes && alignof(Task) <= alignof(decltype(job->storage))>());
+		Queue(job, dependency);
+	}
+
+	/* Runs jobs until the counter reaches zero */
+	void Wait(JobCounter& counter);
+
+	/* body(begin, end) over [0, count) in chunks of at least grain, returns at once */
+	template <typename Body>
+	void ParallelFor(const char* name, size_t count, size_t grain, Body body, JobCounter& counter, JobCounter* dependency = nullptr)
+	{
+		size_t chunk = ChunkSize(count, grain);
+		for (size_t begin = 0; begin < count; begin += chunk)
+		{
+			size_t end = std::min(count, begin + chunk);
+			Run(name, [body, begin, end]() { body(begin, end); }, &counter, dependency);
+		}
+	}
+
+	/* The same, returns once every chunk is done */
+	template <typename Body>
+	void ParallelFor(const char* name, size_t count, size_t grain, const Body& body)
+	{
+		JobCounter counter;
+		ParallelFor(name, count, grain, [&body](size_t begin, size_t end) { body(begin, end); }, counter);
+		Wait(counter);
+	}
+
+	void EnableTiming(bool enabled) { timing = enabled; }
+	/* Job times recorded since the last call, summed per name in order of first use */
+	std::vector<JobTiming> TakeTimings();
+
+private:
+	struct TimingRecord
+	{
+		const char* name;
+		double milliseconds;
+	};
+
+	/* The deque is jobs[front, end), stolen jobs leave a gap at the front that pushes close again */
+	struct Slot
+	{
+		std::mutex mutex;
+		std::vector<Job*> jobs;
+		size_t front = 0;
+		std::vector<Job*> free_jobs;
+		std::vector<TimingRecord> timings;
+	};
+
+	/* Work that fits is constructed in the storage */
+	template <typename Task>
+	static void Store(Job& job, Task&& work, std::true_type)
+	{
+		new (&job.storage) Task(std::move(work));
+		job.run = [](Job& stored) { (*reinterpret_cast<Task*>(&stored.storage))(); };
+		job.destroy = [](Job& stored) { reinterpret_cast<Task*>(&stored.storage)->~Task(); };
+	}
+
+	/* Larger work is allocated, the storage holds the pointer */
+	template <typename Task>
+	static void Store(Job& job, Task&& work, std::false_type)
+	{
+		new (&job.storage) Task*(new Task(std::move(work)));
+		job.run = [](Job& stored) { (**reinterpret_cast<Task**>(&stored.storage))(); };
+		job.destroy = [](Job& stored) { delete *reinterpret_cast<Task**>(&stored.storage); };
+	}
+
+	size_t ChunkSize(size_t count, size_t grain) const;
+	unsigned CurrentSlot();
+	Job* Allocate(const char* name, JobCounter* counter);
+	void Queue(Job* job, JobCounter* dependency);
+	void Push(Job* job);
+	Job* Take(unsigned slot);
+	void Execute(Job* job, unsigned slot);
+	void Work(unsigned slot);
+
+	/* Identifies the system to the threads that have a slot in it, addresses can be reused */
+	unsigned long long id;
+	/* Created up front and never moved, the first slot_count are in use */
+	std::vector<std::unique_ptr<Slot>> slots;
+	std::atomic<unsigned> slot_count;
+	std::vector<std::thread> workers;
+	std::atomic<size_t> queued;
+	std::mutex sleep_mutex;
+	std::condition_variable job_queued;
+	bool stopping;
+	std::atomic<bool> timing;
+};
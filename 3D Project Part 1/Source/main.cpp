@@ -6,11 +6,40 @@
 #include "GLM/common.hpp"
 #include "GLM/gtc/type_ptr.hpp"
 #include "GLM/gtc/random.hpp"
+#include "GLM/gtc/quaternion.hpp"
 #include "GLAD/glad.h"
 #include "GLFW/glfw3.h"
 #include "opengl_utilities.h"
 #include "mesh_generation.h"
+#include "asset_archive.h"
+#include "collision_kernels.h"
+#include "cube_map.h"
+#include "culling.h"
+#include "frame_clock.h"
+#include "input_recording.h"
+#include "gpu_culling.h"
+#include "job_system.h"
+#include "occlusion.h"
+#include "frame_stats.h"
+#include "program_cache.h"
+#include "render_queue.h"
+#include "shader_compiler.h"
+#include "shader_permutations.h"
+#include "simulation.h"
+#include "simulation_thread.h"
+#include "startup_report.h"
+#include "texture_array.h"
+#include "texture_import.h"
+#include "texture_loader.h"
+#include "texture_streaming.h"
+#include "virtual_texture.h"
 #include <algorithm> 
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <string>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -22,7 +51,33 @@ static struct {
 	GLint key;
 	GLint action;
 	bool roverCam;
-	bool collision;
+	bool gpuCulling;
+	bool noOcclusion;
+	bool occlusionLatency;
+	std::string virtualTexture;
+	bool progressiveTextures;
+	bool planetCubeMap;
+	bool noVsync;
+	/* Ticks the simulation between frames on the main thread, as before the simulation thread */
+	bool singleThread;
+	bool headless;
+	/* 0 picks the default of the mode */
+	unsigned long long headlessTicks;
+	int rovers = 3;
+	/* Simulation ticks per second */
+	int tickRate = Simulation::default_tick_rate;
+	bool continuousCollision;
+	/* Collisions are still found, but no longer stop the rovers */
+	bool noCollisionStop;
+	bool compareCollision;
+	/* Threads of the job system including the main one, 0 uses every hardware thread */
+	unsigned threads;
+	bool benchRovers;
+	bool soak;
+	bool benchCollision;
+	std::string recordFile;
+	std::string replayFile;
+	std::string assetArchive = "assets.pak";
 	
 } Globals;
 
@@ -58,16 +113,106 @@ static void keyPressedCallback(GLFWwindow* window, int key, int scancode, int ac
 		{
 			Globals.roverCam = !Globals.roverCam;
 		}
+		if (key == GLFW_KEY_P && Globals.action == GLFW_RELEASE)
+		{
+			EnableFrameStats(!FrameStatsEnabled());
+		}
 	}
 }
 
+/* The end of a replay, handed from the tick that reached it to the thread that prints it */
+struct ReplayCheck
+{
+	unsigned long long ticks;
+	uint64_t hash;
+	uint64_t recorded_hash;
+};
+
 /*Functions*/
-void checkCollision(glm::vec3 my_rover, glm::vec3 rover2, glm::vec3 rover3);
 void print(glm::vec3 vector);
-void checkCollision2(glm::vec3 cube1p, glm::vec3 cube1n, glm::vec3 cube2p, glm::vec3 cube2n, glm::vec3 cube3p, glm::vec3 cube3n);
+bool TextureHasCutout(const unsigned char* data, int width, int height, int channels);
+static SimulationInput CurrentInput();
+static int RunHeadless(unsigned long long ticks, int rovers);
+static int RunRoverScaling();
+static int RunOrientationSoak(unsigned long long ticks);
+static int RunCollisionBench(int rover_count);
+static int RunCollisionComparison();
+static void PrintReplayCheck(const ReplayCheck& check);
+static void DrawCulledRoverBodies(const DrawItem& item);
+static void DrawCulledRoverWheels(const DrawItem& item);
 
 int main(int argc, char* argv[])
 {
+	StartupTimer startup_timer;
+
+	/* Command line options */
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		if (option == "--gpu-culling")
+			Globals.gpuCulling = true;
+		else if (option == "--no-occlusion")
+			Globals.noOcclusion = true;
+		else if (option == "--occlusion-latency")
+			Globals.occlusionLatency = true;
+		else if (option == "--virtual-texture" && i + 1 < argc)
+			Globals.virtualTexture = argv[++i];
+		else if (option == "--progressive-textures")
+			Globals.progressiveTextures = true;
+		else if (option == "--planet-cubemap")
+			Globals.planetCubeMap = true;
+		else if (option == "--no-vsync")
+			Globals.noVsync = true;
+		else if (option == "--single-thread")
+			Globals.singleThread = true;
+		else if (option == "--archive" && i + 1 < argc)
+			Globals.assetArchive = argv[++i];
+		else if (option == "--headless")
+			Globals.headless = true;
+		else if (option == "--ticks" && i + 1 < argc)
+			Globals.headlessTicks = std::strtoull(argv[++i], nullptr, 10);
+		else if (option == "--rovers" && i + 1 < argc)
+			Globals.rovers = std::max(3, std::atoi(argv[++i]));
+		else if (option == "--bench-rovers")
+			Globals.benchRovers = true;
+		else if (option == "--soak")
+			Globals.soak = true;
+		else if (option == "--bench-collision")
+			Globals.benchCollision = true;
+		else if (option == "--tick-rate" && i + 1 < argc)
+			Globals.tickRate = std::max(1, std::atoi(argv[++i]));
+		else if (option == "--continuous-collision")
+			Globals.continuousCollision = true;
+		else if (option == "--no-collision-stop")
+			Globals.noCollisionStop = true;
+		else if (option == "--compare-collision")
+			Globals.compareCollision = true;
+		else if (option == "--threads" && i + 1 < argc)
+			Globals.threads = unsigned(std::max(1, std::atoi(argv[++i])));
+		else if (option == "--record" && i + 1 < argc)
+			Globals.recordFile = argv[++i];
+		else if (option == "--replay" && i + 1 < argc)
+			Globals.replayFile = argv[++i];
+	}
+
+	/* No window and no GL, only the simulation */
+	if (Globals.headless)
+		return RunHeadless(Globals.headlessTicks ? Globals.headlessTicks : 100000, Globals.rovers);
+	if (Globals.benchRovers)
+		return RunRoverScaling();
+	if (Globals.soak)
+		return RunOrientationSoak(Globals.headlessTicks ? Globals.headlessTicks : 10000000);
+	if (Globals.benchCollision)
+		return RunCollisionBench(Globals.rovers > 3 ? Globals.rovers : 4096);
+	if (Globals.compareCollision)
+		return RunCollisionComparison();
+
+	/* Every asset file is looked up in the archive first, loose files are the fallback */
+	if (MountAssetArchive(Globals.assetArchive))
+		std::cout << "Assets from " << Globals.assetArchive << ", " << MountedAssetArchive().EntryCount() << " entries" << std::endl;
+	else if (Globals.assetArchive != "assets.pak")
+		std::cout << "Asset archive " << Globals.assetArchive << " is missing or invalid, using loose files." << std::endl;
+
 	/* Set GLFW error callback */
 	glfwSetErrorCallback(ErrorCallback);
 
@@ -99,8 +244,8 @@ int main(int argc, char* argv[])
 	glfwSetWindowPos(window, 10, 50);
 	/* Make the window's context current */
 	glfwMakeContextCurrent(window);
-	/* Enable VSync */
-	glfwSwapInterval(1);
+	/* Enable VSync, the simulation runs at a fixed tick rate either way */
+	glfwSwapInterval(Globals.noVsync ? 0 : 1);
 
 	/* Load OpenGL extensions with GLAD */
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -119,9 +264,11 @@ int main(int argc, char* argv[])
 	/* Configure OpenGL */
 	glClearColor(0, 0, 0, 1);
 	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
+	/* Blending is toggled per render pass */
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glBlendColor(0.5, 0.5, 0.5, 1);
+	/* Cube map lookups filter across face edges */
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
 	/* MESHES CREATION */
 	std::vector<glm::vec3> positions;
@@ -254,437 +401,576 @@ int main(int argc, char* argv[])
 			}
 	);
 
-	//TEXTURES
-	auto filename = "texture.jpg";
-	auto filename2 = "starryskylarge2.jpg";
-	auto filename3 = "rover2.jpg";
-
-	stbi_set_flip_vertically_on_load(true);
-	int x, y, n;
-	int x2, y2, n2;
-	int x3, y3, n3;
-	unsigned char *texture_data = stbi_load(filename, &x, &y, &n, 0);
-
-	if (texture_data == NULL)
-	{
-		std::cout << "Texture " << filename << " failed to load." << std::endl;
-		std::cout << "Error: " << stbi_failure_reason() << std::endl;
-	}
-	else
-	{
-		std::cout << "Success: Loading Texture Completed. X:" << x << " Y: " << y << " N:" << n << std::endl;
-	}
-
-	GLuint mars_texture;
-	glGenTextures(1, &mars_texture);
-
-	if (x * n % 4 != 0)
-	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	}
-
-	glBindTexture(GL_TEXTURE_2D, mars_texture);
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		x, y, 0, n == 3? GL_RGB:GL_RGBA, GL_UNSIGNED_BYTE, texture_data
-	);
-
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
-
-
-
-	if (x * n % 4 != 0)
-	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	}
-
-	stbi_image_free(texture_data);
-
-	unsigned char *texture_data2 = stbi_load(filename2, &x2, &y2, &n2, 0);
-	if (texture_data2 == NULL)
-	{
-		std::cout << "Texture " << filename2 << " failed to load." << std::endl;
-		std::cout << "Error: " << stbi_failure_reason() << std::endl;
-	}
-	else
-	{
-		std::cout << "Success: Loading Texture Completed. X:" << x2 << " Y: " << y2 << " N:" << n2 << std::endl;
-	}
-
-	GLuint stars_texture;
-	glGenTextures(1, &stars_texture);
-
-	if (x * n2 % 4 != 0)
-	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	}
-
-	glBindTexture(GL_TEXTURE_2D, stars_texture);
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		x2, y2, 0, n2 == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, texture_data2
-	);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-
-	if (x * n2 % 4 != 0)
-	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	}
-
-	stbi_image_free(texture_data2);
-
-	unsigned char *texture_data3 = stbi_load(filename3, &x3, &y3, &n3, 0);
-
-	GLuint rover_texture;
-	glGenTextures(1, &rover_texture);
-
-	if (x * n3 % 4 != 0)
-	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	}
-
-	glBindTexture(GL_TEXTURE_2D, rover_texture);
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		x3, y3, 0, n3 == 3 ? GL_RGB : GL_RGBA, GL_UNSIGNED_BYTE, texture_data3
-	);
-	
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-
-	if (x * n3 % 4 != 0)
-	{
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	}
-
-	stbi_image_free(texture_data3);
-
-	//TRANSPARENT TEXTURE
-	auto filename4 = "empty.png";
-
-	int x4, y4, n4;
-	unsigned char *texture_data4 = stbi_load(filename4, &x4, &y4, &n4, 0);
-
-	GLuint clear_texture;
-	glGenTextures(1, &clear_texture);
-
-	glBindTexture(GL_TEXTURE_2D, clear_texture);
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		x4, y4, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture_data4
-	);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	stbi_image_free(texture_data4);
-	
-	//WHEEL
-	auto filename5 = "wheel.jpg";
-
-	int x5, y5, n5;
-	unsigned char *texture_data5 = stbi_load(filename5, &x5, &y5, &n5, 0);
-
-	GLuint wheel_texture;
-	glGenTextures(1, &wheel_texture);
-
-	glBindTexture(GL_TEXTURE_2D, wheel_texture);
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0,
-		GL_RGBA,
-		x5, y5, 0, GL_RGB, GL_UNSIGNED_BYTE, texture_data5
-	);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	stbi_image_free(texture_data5);
-
-
-	/* Creating Programs */	
-	GLuint program = CreateProgramFromSources(
+	/* Creating Programs */
+	/* One source, compiled per feature mask. Features are ALPHA_TEST, LIGHTING, INSTANCING, TEXTURE_ARRAY, VIRTUAL_TEXTURE and CUBE_MAP */
+	ShaderCompiler shader_compiler;
+	ShaderPermutations scene_shaders(shader_compiler, "scene",
 		R"VERTEX(
 #version 330 core
 
 layout(location = 0) in vec3 a_position;
 layout(location = 1) in vec3 a_normal;
 layout(location = 2) in vec2 a_uvs;
-
+#ifdef INSTANCING
+layout(location = 3) in mat4 a_instance_transform;
+#endif
 
 uniform mat4 u_transform;
 
 out vec3 vertex_position;
 out vec3 vertex_normal;
 out vec2 vertex_uvs;
+#ifdef CUBE_MAP
+out vec3 vertex_direction;
+#endif
 
 void main()
 {
-	gl_Position = u_transform * vec4(a_position, 1);
-	vertex_normal = vec3(u_transform * vec4(a_normal, 0));
+#ifdef INSTANCING
+	mat4 transform = u_transform * a_instance_transform;
+#else
+	mat4 transform = u_transform;
+#endif
+	gl_Position = transform * vec4(a_position, 1);
+	vertex_normal = vec3(transform * vec4(a_normal, 0));
 	vertex_position = vec3(gl_Position);
 	vertex_uvs = a_uvs;
+#ifdef CUBE_MAP
+	vertex_direction = a_position;
+#endif
 }
 		)VERTEX",
 
 		R"FRAGMENT(
 #version 330 core
 
-uniform vec2 u_mouse_position;
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray u_texture;
+uniform int u_layer;
+#elif defined(CUBE_MAP)
+uniform samplerCube u_texture;
+#else
 uniform sampler2D u_texture;
+#endif
+
+#ifdef VIRTUAL_TEXTURE
+uniform sampler2D u_indirection;
+uniform vec2 u_vt_size;
+uniform float u_vt_tile_size;
+uniform float u_vt_border;
+uniform float u_vt_cache_size;
+uniform int u_vt_max_level;
+uniform int u_vt_level_offset[16];
+
+/* Picks the level like the feedback pass in virtual_texture.cpp, then samples the finest resident tile covering it */
+vec4 SampleVirtualTexture(vec2 uvs)
+{
+	vec2 texel = uvs * u_vt_size;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+	int level = clamp(int(floor(lod)), 0, u_vt_max_level);
+
+	vec2 wrapped = fract(uvs);
+	vec2 level_size = max(floor(u_vt_size / exp2(float(level))), vec2(1));
+	ivec2 tiles = ivec2(ceil(level_size / u_vt_tile_size));
+	ivec2 tile = clamp(ivec2(wrapped * level_size / u_vt_tile_size), ivec2(0), tiles - 1);
+
+	/* slot x, slot y and the level of the tile in that slot */
+	vec3 entry = floor(texelFetch(u_indirection, ivec2(u_vt_level_offset[level] + tile.x, tile.y), 0).rgb * 255.0 + 0.5);
+
+	vec2 resident_texel = wrapped * max(floor(u_vt_size / exp2(entry.z)), vec2(1));
+	vec2 within = resident_texel - floor(resident_texel / u_vt_tile_size) * u_vt_tile_size;
+	vec2 physical = entry.xy * (u_vt_tile_size + 2.0 * u_vt_border) + u_vt_border + within;
+	return textureLod(u_texture, physical / u_vt_cache_size, 0.0);
+}
+#endif
 
 in vec3 vertex_position;
 in vec3 vertex_normal;
 in vec2 vertex_uvs;
+#ifdef CUBE_MAP
+in vec3 vertex_direction;
+#endif
 
 out vec4 out_color;
 
 void main()
 {
-/*
-	vec4 color = texture(u_texture, vertex_uvs).rgba;
-	if (color.a < 0.1)
-		discard;
-
-	vec3 ambient = 0.05 * color.rgb;
-	vec3 light_direction = -normalize(normalize(vec3(-1, -1, 1)) - vertex_position);
-	vec3 surface_normal = normalize(vertex_normal);
-	float diffuse_intensity = max(0, dot(light_direction, surface_normal));
-	vec3 diffuse = diffuse_intensity * color.rgb;
-	vec3 view_dir = vec3(0, 0, -1);	
-	vec3 reflectDir = reflect(-lightcwasd_direction, surface_normal);
-	float spec = 0.0;
-    spec = pow(max(dot(view_dir, reflectDir), 0.0), 8.0);
-    
-
-	vec3 specular = vec3(0.3) * spec; 
-	out_color = vec4(ambient + diffuse + specular, color.a);
-
-*/
 	vec4 color = vec4(0);
 
 	vec3 surface_position = vertex_position;
 	vec3 surface_normal = normalize(vertex_normal);
 	vec2 surface_uvs = vertex_uvs;
 
+#ifdef TEXTURE_ARRAY
+	vec4 surface_color = texture(u_texture, vec3(surface_uvs, u_layer)).rgba;
+#elif defined(VIRTUAL_TEXTURE)
+	vec4 surface_color = SampleVirtualTexture(surface_uvs);
+#elif defined(CUBE_MAP)
+	vec4 surface_color = texture(u_texture, vertex_direction).rgba;
+#else
 	vec4 surface_color = texture(u_texture, surface_uvs).rgba;
+#endif
+#ifdef ALPHA_TEST
 	if (surface_color.a < 0.1)
 		discard;
+#endif
 	vec3 ambient_color = vec3(1);
 	color += vec4(ambient_color,1) * surface_color;
 
-/*
+#ifdef LIGHTING
 	vec3 light_direction = normalize(vec3(-1, -1, 1));
 	vec3 to_light = -normalize(light_direction - surface_position);
 	vec3 light_color = vec3(0.5);
 
 	float diffuse_intensity = max(0, dot(to_light, surface_normal));
 	color += diffuse_intensity * vec4(light_color,1) * surface_color;
-*/
+#endif
 	out_color = color;
 }
 		)FRAGMENT");
 
-	if (program == NULL)
+	/* Linked variants are reused across launches when the driver supports program binaries */
+	ProgramCache program_cache("shader_cache");
+	scene_shaders.UseCache(&program_cache);
+
+	/* Submitted now, checked when the materials are bound, so compiling overlaps texture loading */
+	scene_shaders.Prepare(0);
+	scene_shaders.Prepare(SHADER_FEATURE_TEXTURE_ARRAY);
+	scene_shaders.Prepare(SHADER_FEATURE_TEXTURE_ARRAY | SHADER_FEATURE_ALPHA_TEST);
+	if (Globals.gpuCulling)
+		scene_shaders.Prepare(SHADER_FEATURE_INSTANCING | SHADER_FEATURE_TEXTURE_ARRAY);
+	if (!Globals.virtualTexture.empty())
+		scene_shaders.Prepare(SHADER_FEATURE_VIRTUAL_TEXTURE);
+	if (Globals.planetCubeMap)
+		scene_shaders.Prepare(SHADER_FEATURE_CUBE_MAP);
+
+	//TEXTURES
+	TextureLoader texture_loader;
+
+	GLuint mars_texture = 0, stars_texture = 0, part_texture = 0;
+	GLint rover_layer = 0, clear_layer = 1, wheel_layer = 2;
+	bool clear_needs_alpha_test = true;
+	bool mars_cube_map = false;
+
+	/* With --progressive-textures every texture is drawn from a small mip level at once and sharpens over the first frames */
+	std::unique_ptr<TextureStreamer> texture_streamer;
+	if (Globals.progressiveTextures && Globals.planetCubeMap)
+		std::cout << "--planet-cubemap is not streamed, Mars stays equirectangular with --progressive-textures" << std::endl;
+
+	if (Globals.progressiveTextures)
 	{
-		glfwTerminate();
-		return -1;
+		texture_streamer.reset(new TextureStreamer(texture_loader, "texture_previews", 2 << 20));
+
+		mars_texture = texture_streamer->LoadCooked("cooked", "texture.jpg");
+		if (!mars_texture)
+			mars_texture = texture_streamer->Load2D("texture.jpg");
+		stars_texture = texture_streamer->LoadCooked("cooked", "starryskylarge2.jpg");
+		if (!stars_texture)
+			stars_texture = texture_streamer->Load2D("starryskylarge2.jpg");
+		part_texture = texture_streamer->LoadArray({ "rover2.jpg", "empty.png", "wheel.jpg" });
+
+		/* Finding cut-out texels needs the decode, so any helper image with an alpha channel pays for the discard */
+		int clear_width, clear_height, clear_channels;
+		AssetData clear_file = OpenAsset("empty.png");
+		if (clear_file.IsValid() && stbi_info_from_memory(clear_file.Data(), int(clear_file.Size()), &clear_width, &clear_height, &clear_channels))
+			clear_needs_alpha_test = clear_channels == 2 || clear_channels == 4;
 	}
+	else
+	{
+		/* Block compressed textures from the asset cooker skip decoding, see Tools/asset_cooker.cpp */
+		/* Cooked textures are equirectangular, the cube map is reprojected from the decoded image */
+		if (!Globals.planetCubeMap)
+			mars_texture = LoadCookedTexture("cooked", "texture.jpg");
+		stars_texture = LoadCookedTexture("cooked", "starryskylarge2.jpg");
+
+		/* All other images decode on worker threads at once, each one uploads as soon as it is ready */
+		TextureLoader::Request mars_image = 0, stars_image = 0;
+		if (!mars_texture)
+			mars_image = texture_loader.Load("texture.jpg", true);
+		if (!stars_texture)
+			stars_image = texture_loader.Load("starryskylarge2.jpg", true);
+		TextureLoader::Request rover_image = texture_loader.Load("rover2.jpg", true);
+		TextureLoader::Request clear_image = texture_loader.Load("empty.png", true);
+		TextureLoader::Request wheel_image = texture_loader.Load("wheel.jpg", true);
+
+		/* Uploads go through pixel buffer objects in 4 MB chunks */
+		PixelUploader pixel_uploader(4 << 20, 3);
+
+		auto waitForImage = [&](TextureLoader::Request request) -> const DecodedImage&
+		{
+			const DecodedImage& image = texture_loader.Wait(request);
+			if (image.pixels == NULL)
+			{
+				std::cout << "Texture " << image.filename << " failed to load." << std::endl;
+				std::cout << "Error: " << image.failure_reason << std::endl;
+			}
+			else
+			{
+				std::cout << "Success: Loading Texture Completed. X:" << image.width << " Y: " << image.height << " N:" << image.channels << std::endl;
+			}
+			return image;
+		};
+
+		/* Sized formats and a CPU built mip chain. The shaders write linear color, so no sRGB formats */
+		auto createTexture = [&](TextureLoader::Request request) -> GLuint
+		{
+			const DecodedImage& image = waitForImage(request);
+			GLuint texture = ImportTexture2D(image.filename, image.pixels, image.width, image.height, image.channels, false, pixel_uploader);
+			texture_loader.Release(request);
+			return texture;
+		};
+
+		/* Reprojects the equirectangular planet map onto a cube map with the same texel density at the equator */
+		auto createCubeMap = [&](TextureLoader::Request request) -> GLuint
+		{
+			const DecodedImage& image = waitForImage(request);
+			GLuint texture = 0;
+			if (image.pixels != NULL)
+			{
+				int face_size = CubeFaceSize(image.width);
+				StartupTimer reproject_timer;
+				std::vector<std::vector<unsigned char>> faces = EquirectangularToCubeMap(image.pixels, image.width, image.height, image.channels, face_size);
+				RecordStartupTiming("texture reproject", image.filename, reproject_timer.ElapsedMilliseconds());
 
-	glUseProgram(program);
+				texture = ImportCubeMap(image.filename + " (cube map)", faces, face_size, image.channels, false, pixel_uploader);
+			}
+			texture_loader.Release(request);
+			return texture;
+		};
 
-	auto texture_location = glGetUniformLocation(program, "u_texture");
-	glUniform1i(texture_location, 0);
-	auto mouse_location = glGetUniformLocation(program, "u_mouse_position");
-	auto u_transform_location = glGetUniformLocation(program, "u_transform");
+		//MARS
+		if (Globals.planetCubeMap)
+		{
+			mars_texture = createCubeMap(mars_image);
+			mars_cube_map = mars_texture != 0;
+		}
+		else if (!mars_texture)
+			mars_texture = createTexture(mars_image);
 
-	glm::mat4 rover_rotate(1.0);
-	glm::mat4 rover_rotate2(1.0);
-	glm::mat4 rover_rotate3(1.0);
+		//STARS
+		if (!stars_texture)
+			stars_texture = createTexture(stars_image);
 
-	glm::vec3 my_rover_pos(3.0);
-	glm::vec3 rover2_pos(3.0);
-	glm::vec3 rover3_pos(3.0);
+		//ROVER
+		/* One array texture holds all rover parts and the helper cubes, resampled to the rover texture size */
+		const DecodedImage& rover_data = waitForImage(rover_image);
 
-	float rot_x = 0.0f, rot_y = 0.0f;
-	float cam_x = 0.0f,cam_y=0.0f, cam_z = -3.0f;
-	Globals.roverCam = false;
+		TextureArray part_textures(rover_data.width, rover_data.height);
+		rover_layer = part_textures.AddLayer(rover_data.pixels, rover_data.width, rover_data.height, rover_data.channels);
+
+		texture_loader.Release(rover_image);
 
-	glm::dvec3 chasing_pos = glm::dvec3(-1.05,0,0);
+		//TRANSPARENT TEXTURE
+		const DecodedImage& clear_data = waitForImage(clear_image);
 
-	float difference_x = 10;
-	float difference_y = 10;
+		clear_needs_alpha_test = TextureHasCutout(clear_data.pixels, clear_data.width, clear_data.height, clear_data.channels);
+		clear_layer = part_textures.AddLayer(clear_data.pixels, clear_data.width, clear_data.height, clear_data.channels);
 
-	float chasing1 = 0;
-	float chasing2 = 0;
+		texture_loader.Release(clear_image);
 	
-	/* Loop until the user closes the window */
-	while (!glfwWindowShouldClose(window))
+		//WHEEL
+		const DecodedImage& wheel_data = waitForImage(wheel_image);
+
+		wheel_layer = part_textures.AddLayer(wheel_data.pixels, wheel_data.width, wheel_data.height, wheel_data.channels);
+
+		texture_loader.Release(wheel_image);
+
+		StartupTimer part_upload_timer;
+		part_texture = part_textures.Upload(&pixel_uploader);
+		RecordStartupTiming("texture upload", "rover part array", part_upload_timer.ElapsedMilliseconds());
+
+		/* RGBA8 for every layer because the helper layer needs alpha */
+		size_t part_texels = MipChainTexels(rover_data.width, rover_data.height) * part_textures.LayerCount();
+		RecordTextureMemory("rover part array", part_texels * 4, part_texels * 4);
+
+		pixel_uploader.Finish();
+	}
+
+	//MARS
+	if (!mars_cube_map)
 	{
-		/* Render here */
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glClearColor(0,0,0, 1);
+		glBindTexture(GL_TEXTURE_2D, mars_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+	}
 
-		//Projection style
-		auto projection = glm::perspective(glm::radians(45.f), 1.f, 0.1f, 10.f);
-		
-		//MOUSE
-		glm::dvec2 normalized_mouse = Globals.mouse_position / glm::dvec2(Globals.screen_dimensions);
-		normalized_mouse.y = 1. - normalized_mouse.y;
-		normalized_mouse.x = normalized_mouse.x * 2. - 1.;
-		normalized_mouse.y = normalized_mouse.y * 2. - 1.;
+	//VIRTUAL TEXTURE
+	/* With --virtual-texture Mars streams tiles of a page file into a 16x16 tile cache, the Mars texture stays as the fallback */
+	std::unique_ptr<VirtualTexture> virtual_texture;
+	if (!Globals.virtualTexture.empty())
+	{
+		virtual_texture.reset(new VirtualTexture(Globals.virtualTexture, 16));
+		if (!virtual_texture->Valid())
+		{
+			virtual_texture.reset();
+			std::cout << "Virtual texture unavailable, falling back to the Mars texture" << std::endl;
+		}
+		else
+		{
+			RecordTextureMemory("mars virtual texture", virtual_texture->MemoryBytes(), virtual_texture->MemoryBytes());
+		}
+	}
 
-		//MARS TRANSFORMATION		
-		/*Mars matrix scales it by 0.7*/   
-		auto mars_transform = glm::scale(glm::vec3(0.7));
+	/* Only textures with cut-out texels pay for the discard */
+	Material mars_material = { mars_texture, 0, mars_cube_map ? unsigned(SHADER_FEATURE_CUBE_MAP) : 0u, RENDER_PASS_OCCLUDER, nullptr };
+	if (virtual_texture)
+		mars_material = { virtual_texture->CacheTexture(), 0, SHADER_FEATURE_VIRTUAL_TEXTURE, RENDER_PASS_OCCLUDER, nullptr };
+	Material stars_material = { stars_texture, 0, 0, RENDER_PASS_BACKGROUND, nullptr };
+	Material rover_material = { part_texture, rover_layer, SHADER_FEATURE_TEXTURE_ARRAY, RENDER_PASS_OPAQUE, nullptr };
+	Material wheel_material = { part_texture, wheel_layer, SHADER_FEATURE_TEXTURE_ARRAY, RENDER_PASS_OPAQUE, nullptr };
+	Material clear_material = { part_texture, clear_layer, SHADER_FEATURE_TEXTURE_ARRAY | (clear_needs_alpha_test ? unsigned(SHADER_FEATURE_ALPHA_TEST) : 0u), RENDER_PASS_TRANSPARENT, nullptr };
+	Material proxy_material = { 0, 0, 0, RENDER_PASS_OCCLUSION_PROXY, nullptr };
+
+	if (!scene_shaders.Bind(mars_material) || !scene_shaders.Bind(stars_material) ||
+		!scene_shaders.Bind(rover_material) || !scene_shaders.Bind(wheel_material) ||
+		!scene_shaders.Bind(clear_material) || !scene_shaders.Bind(proxy_material))
+	{
+		glfwTerminate();
+		return -1;
+	}
+	if (virtual_texture)
+		virtual_texture->SetupProgram(mars_material.program->id);
+
+	/* With --gpu-culling rovers are culled on the GPU and drawn instanced, meant for large rover counts */
+	Material instanced_rover_material = { part_texture, rover_layer, SHADER_FEATURE_INSTANCING | SHADER_FEATURE_TEXTURE_ARRAY, RENDER_PASS_OPAQUE, nullptr };
+	Material instanced_wheel_material = { part_texture, wheel_layer, SHADER_FEATURE_INSTANCING | SHADER_FEATURE_TEXTURE_ARRAY, RENDER_PASS_OPAQUE, nullptr };
+	std::unique_ptr<GpuRoverCuller> gpu_culler;
+	if (Globals.gpuCulling && scene_shaders.Bind(instanced_rover_material) && scene_shaders.Bind(instanced_wheel_material))
+	{
+		gpu_culler.reset(new GpuRoverCuller(cubeVAO, wheelVAO, std::max<size_t>(4096, size_t(Globals.rovers))));
+		if (!gpu_culler->Valid())
+			gpu_culler.reset();
+	}
+	if (Globals.gpuCulling && !gpu_culler)
+		std::cout << "GPU culling unavailable, falling back to CPU culling" << std::endl;
 
-		//WHEEL TRANSFORM
-		glm::mat4 FL_wheel_transform(1.0);
-		FL_wheel_transform = glm::scale(glm::vec3(0.35));
-		FL_wheel_transform = glm::translate(glm::vec3(0.5, 0.5, -0.35)) * FL_wheel_transform;
-		FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(90.f), glm::vec3(0, 0, 1));
+	/* Rovers that survive culling can still be hidden by Mars from the side, a proxy box query catches those */
+	std::unique_ptr<OcclusionCuller> occlusion(new OcclusionCuller(Globals.occlusionLatency ? OcclusionCuller::PREVIOUS_FRAME : OcclusionCuller::CONDITIONAL_RENDER));
 
-		glm::mat4 FR_wheel_transform(1.0);
-		FR_wheel_transform = glm::scale(glm::vec3(0.35));
-		FR_wheel_transform = glm::translate(glm::vec3(-0.5, 0.5, -0.35)) * FR_wheel_transform;
-		FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(90.f), glm::vec3(0, 0, 1));
+	/* Sized for thousands of draws so nothing is allocated inside the loop */
+	RenderQueue render_queue(16384 + 8 * size_t(Globals.rovers));
 
-		glm::mat4 BL_wheel_transform(1.0);
-		BL_wheel_transform = glm::scale(glm::vec3(0.35));
-		BL_wheel_transform = glm::translate(glm::vec3(0.5, -0.5, -0.35)) * BL_wheel_transform;
-		BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(90.f), glm::vec3(0, 0, 1));
+	/* Rover space extent is about 1.2 (body half diagonal plus wheel radius), scaled by the rover and Mars transforms */
+	const float rover_bounding_radius = 1.2f * 0.08f * 0.7f;
+	const SphereOccluder mars_occluder = { glm::vec3(0), 0.7f };
+	BoundingSpheres cull_spheres;
+	std::vector<uint8_t> cull_visible;
+	
+	Globals.roverCam = false;
 
-		glm::mat4 BR_wheel_transform(1.0);
-		BR_wheel_transform = glm::scale(glm::vec3(0.35));
-		BR_wheel_transform = glm::translate(glm::vec3(-0.5, -0.5, -0.35)) * BR_wheel_transform;
-		BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(90.f), glm::vec3(0, 0, 1));
+	const float z_near = 0.1f;
+	const float z_far = 10.f;
 
-		//ROVER TRANSFORMATION
-		//rover transform scales by 0.08, translates to outside of mars and rotates based on key press
-		glm::mat4 rover_transform(1.0);
-		rover_transform = glm::scale(glm::vec3(0.08));
-		rover_transform = glm::translate(glm::vec3(1.05, 0, 0)) * rover_transform;
+	//MARS TRANSFORMATION
+	/*Mars matrix scales it by 0.7*/
+	const glm::mat4 mars_transform = Simulation::MarsTransform();
+	const float scaleFactor = Simulation::CollisionHalfSize();
 
-		glm::mat4 rotation(1.0);
+	/* Per rover work of the ticks and of the frame runs on every thread, GL calls stay on this one */
+	JobSystem jobs(Globals.threads);
 
-		int speed = 2;
-		if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_W && !Globals.collision)
-		{
-			rotation = glm::rotate(glm::radians(float(speed)), glm::vec3(0, 0, 1));
-			FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime()*50)), glm::vec3(0, 1, 0)) ;
-			FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
+	//SIMULATION
+	/* Rover movement, the rover 3 chase, the free camera and collisions, see simulation.h */
+	Simulation simulation(Globals.rovers, Globals.tickRate, Globals.continuousCollision);
+	simulation.SetStopOnCollision(!Globals.noCollisionStop);
+	simulation.SetJobSystem(&jobs);
+
+	/* Speeds are per tick, at 60 ticks a second the same per frame speeds the game had at 60 Hz vsync */
+	FrameClock frame_clock(1.0 / simulation.TickRate(), 8);
 
+	/* A replay feeds the recorded input to the ticks instead of the keyboard until it runs out */
+	InputRecorder input_recorder;
+	std::unique_ptr<InputReplay> input_replay;
+	if (!Globals.replayFile.empty())
+	{
+		input_replay.reset(new InputReplay());
+		if (!input_replay->Load(Globals.replayFile) || int(input_replay->Header().rover_count) != simulation.RoverCount()
+			|| int(input_replay->Header().tick_rate) != simulation.TickRate())
+		{
+			std::cout << "Input recording " << Globals.replayFile << " is missing or was not recorded with " << simulation.RoverCount()
+				<< " rovers at " << simulation.TickRate() << " ticks per second." << std::endl;
+			input_replay.reset();
 		}
-		if (Globals.key == GLFW_KEY_S && Globals.action != GLFW_RELEASE && !Globals.collision)
+		else
 		{
-			rotation = glm::rotate(glm::radians(float(-speed)), glm::vec3(0, 0, 1));
-			FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * -50)), glm::vec3(0, 1, 0));
-			BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * -50)), glm::vec3(0, 1, 0));
-			FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * -50)), glm::vec3(0, 1, 0));
-			BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * -50)), glm::vec3(0, 1, 0));
+			/* Set before the first tick, like the rover count and the tick rate it is part of what the hash checks */
+			simulation.SetContinuousCollision(input_replay->ContinuousCollision());
+			simulation.SetStopOnCollision(input_replay->StopOnCollision());
 		}
-		if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_A && !Globals.collision)
+	}
+
+	/* Filled by the tick that ends the replay, the flag publishes it to the main thread, which prints it */
+	ReplayCheck replay_check = {};
+	std::atomic<bool> replay_checked(false);
+
+	/* One tick with the keyboard input, or the recording while one is replayed. Runs on the simulation thread unless --single-thread */
+	auto runTick = [&](const SimulationInput& keyboard)
+	{
+		SimulationInput input = keyboard;
+		if (input_replay)
+			input = input_replay->Input(simulation.TickCount());
+		if (!Globals.recordFile.empty())
+			input_recorder.Record(simulation.TickCount(), input);
+
+		simulation.Tick(input);
+
+		if (input_replay && input_replay->Finished(simulation.TickCount()))
 		{
-			FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(-20.f), glm::vec3(0, 0, 1));
-			BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(-20.f), glm::vec3(0, 0, 1));
-			FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(-20.f), glm::vec3(0, 0, 1));
-			BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(-20.f), glm::vec3(0, 0, 1));
+			replay_check = { simulation.TickCount(), simulation.StateHash(), input_replay->Header().final_state_hash };
+			replay_checked = true;
+			input_replay.reset();
+		}
+		return input;
+	};
+
+	/* The renderer only reads snapshots, the first one is the starting state */
+	SnapshotBuffer snapshots;
+	snapshots.Back().Capture(simulation, SimulationInput(), std::chrono::steady_clock::now());
+	snapshots.Publish();
+	std::unique_ptr<SimulationThread> simulation_thread;
+	unsigned long long drawn_tick = 0;
 
+	/* Frame times from the second frame on, the first one includes the startup */
+	FrameTimeLog frame_times;
+	bool first_frame = true;
 
-			rotation = glm::rotate(glm::radians(float(speed)), glm::vec3(0, 1, 0));
-			FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
+	/* Orientations between the last two ticks, the only place they become matrices */
+	auto interpolateRotation = [](const glm::quat& previous, const glm::quat& current, float alpha)
+	{
+		return glm::mat4_cast(glm::slerp(previous, current, alpha));
+	};
 
+	/* Model matrices of every rover and the points the simulation tracks, filled each frame */
+	std::vector<glm::mat4> rover_draw;
+	std::vector<glm::vec3> rover_draw_pos;
+	const glm::mat4 rover_model_fix[] =
+	{
+		glm::rotate(glm::radians(90.f), glm::vec3(0, 1, 0)),
+		glm::rotate(glm::radians(270.f), glm::vec3(0, 1, 0)),
+		glm::rotate(glm::radians(180.f), glm::vec3(0, 1, 0)) * glm::rotate(glm::radians(90.f), glm::vec3(0, 0, 1)),
+	};
+
+	//WHEEL TRANSFORM
+	glm::mat4 wheel_rest[4];
+	const glm::vec3 wheel_offsets[4] = { glm::vec3(0.5, 0.5, -0.35), glm::vec3(-0.5, 0.5, -0.35), glm::vec3(-0.5, -0.5, -0.35), glm::vec3(0.5, -0.5, -0.35) };
+	for (int i = 0; i < 4; ++i)
+		wheel_rest[i] = glm::translate(wheel_offsets[i]) * glm::scale(glm::vec3(0.35)) * glm::rotate(glm::radians(90.f), glm::vec3(0, 0, 1));
+
+	/* Front left, front right, back right, back left. The player's wheels steer with the input of the tick, every rover's spin as it drives */
+	auto wheelTransforms = [&](const SceneSnapshot& scene, size_t rover, glm::mat4* wheels)
+	{
+		glm::mat4 steer(1.0);
+		if (rover == 0 && scene.input.held && !scene.collision)
+		{
+			if (scene.input.key == SIM_KEY_LEFT)
+				steer = glm::rotate(glm::radians(-20.f), glm::vec3(0, 0, 1));
+			else if (scene.input.key == SIM_KEY_RIGHT)
+				steer = glm::rotate(glm::radians(20.f), glm::vec3(0, 0, 1));
 		}
-		if (Globals.key == GLFW_KEY_D && Globals.action != GLFW_RELEASE && !Globals.collision)
-		{
-			rotation = glm::rotate(glm::radians(float(-speed)), glm::vec3(0, 1, 0));
-			FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(20.f), glm::vec3(0, 0, 1));
-			BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(20.f), glm::vec3(0, 0, 1));
-			FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(20.f), glm::vec3(0, 0, 1));
-			BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(20.f), glm::vec3(0, 0, 1));
-
-			FL_wheel_transform = FL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			BR_wheel_transform = BR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			FR_wheel_transform = FR_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
-			BL_wheel_transform = BL_wheel_transform * glm::rotate(glm::radians(float(glfwGetTime() * 50)), glm::vec3(0, 1, 0));
+		glm::mat4 spin = glm::rotate(scene.wheel_angle[rover], glm::vec3(0, 1, 0));
+		for (int i = 0; i < 4; ++i)
+			wheels[i] = wheel_rest[i] * steer * spin;
+	};
+
+	RecordStartupTiming("total", "until first frame", startup_timer.ElapsedMilliseconds());
+	PrintStartupReport();
+	PrintTextureMemoryReport();
+
+	/* The simulation ticks on its own from here, this thread renders and polls the window */
+	if (!Globals.singleThread)
+		simulation_thread.reset(new SimulationThread(simulation, snapshots, runTick));
+
+	/* Loop until the user closes the window */
+	while (!glfwWindowShouldClose(window))
+	{
+		jobs.EnableTiming(FrameStatsEnabled());
+		int ticks = frame_clock.BeginFrame();
+		if (!first_frame)
+			frame_times.Add(frame_clock.FrameSeconds());
+		first_frame = false;
+
+		/* With the simulation thread the clock only measures the frames */
+		if (simulation_thread)
+		{
+			simulation_thread->SetInput(CurrentInput());
 		}
+		else if (ticks > 0)
+		{
+			SimulationInput input;
+			for (int i = 0; i < ticks; ++i)
+				input = runTick(CurrentInput());
+			std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now()
+				- std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(frame_clock.Alpha() * frame_clock.TickSeconds()));
+			snapshots.Back().Capture(simulation, input, due);
+			snapshots.Publish();
+		}
+		if (replay_checked.exchange(false))
+			PrintReplayCheck(replay_check);
+
+		/* The newest tick, it stays the same until the next frame reads again */
+		const SceneSnapshot& scene = snapshots.Read();
+		float alpha = scene.Alpha(std::chrono::steady_clock::now());
+		SetFrameCounter("ticks per frame", double(scene.tick_count - drawn_tick));
+		drawn_tick = scene.tick_count;
+
+		/* Render here */
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glClearColor(0,0,0, 1);
+
+		//Projection style
+		auto projection = glm::perspective(glm::radians(45.f), 1.f, z_near, z_far);
+		
+		//MOUSE
+		glm::dvec2 normalized_mouse = Globals.mouse_position / glm::dvec2(Globals.screen_dimensions);
+		normalized_mouse.y = 1. - normalized_mouse.y;
+		normalized_mouse.x = normalized_mouse.x * 2. - 1.;
+		normalized_mouse.y = normalized_mouse.y * 2. - 1.;
 
-		rover_rotate = rover_rotate * rotation;
-		rover_transform = rover_rotate * rover_transform;
+		/*
+			Rovers are drawn between the last two ticks, alpha of the way to the latest. Their
+			matrices and bounding spheres are filled by jobs while this thread goes on, the
+			player's rover is placed here as well for the camera.
+		*/
+		size_t rover_count = scene.RoverCount();
+		rover_draw.resize(rover_count);
+		rover_draw_pos.resize(rover_count);
+		cull_spheres.Resize(2 * rover_count);
+		cull_visible.resize(2 * rover_count);
+		JobCounter matrices_done;
+		jobs.ParallelFor("rover matrices", rover_count, 1024, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				glm::mat4 orientation = interpolateRotation(scene.previous_orientation[i], scene.orientation[i], alpha);
+				glm::mat4 placed = orientation * Simulation::RoverBase(RoverBehavior(scene.behavior[i]));
+				rover_draw_pos[i] = glm::vec3(mars_transform * orientation * glm::vec4(scene.local_x[i], scene.local_y[i], scene.local_z[i], 1));
+
+				/* The model faces along the base direction of its behavior */
+				rover_draw[i] = mars_transform * placed * rover_model_fix[scene.behavior[i]];
+
+				/* Rovers and debug cubes are tested as bounding spheres */
+				cull_spheres.Set(i, glm::vec3(rover_draw[i][3]), rover_bounding_radius);
+				cull_spheres.Set(rover_count + i, rover_draw_pos[i], scaleFactor * glm::sqrt(3.f));
+			}
+		}, matrices_done);
+		glm::mat4 rover_transform = interpolateRotation(scene.previous_orientation[0], scene.orientation[0], alpha) * Simulation::RoverBase(RoverBehavior(scene.behavior[0]));
 
 		//CAMERAS TRANSFORMATION
 
 		//rover cam
 
 		glm::vec3 camera_position = mars_transform * rover_transform * glm::vec4(3, -2, 0, 1);
-		my_rover_pos = mars_transform * rover_transform * glm::vec4(1.05, 0, 0, 1);
 		glm::vec3 rover_position_mouse = mars_transform * rover_transform * glm::vec4(1.05 + normalized_mouse.y, 0, 0 + normalized_mouse.x, 1);
 		glm::vec3 up_direction(0, 1, 0);
 
 		glm::mat4 camera_transform(1.0);
-		if (!Globals.roverCam)
+		if (!scene.input.rover_cam)
 		{
-			if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_RIGHT)
-			{
-				cam_x += 0.01;
-			}
-			if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_LEFT)
-			{
-				cam_x -= 0.01;
-			}
-			if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_UP)
-			{
-				cam_z += 0.01;
-			}
-			if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_DOWN)
-			{
-				cam_z -= 0.01;
-			}
-			if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_R)
-			{
-				cam_y += 0.01;
-			}
-			if (Globals.action != GLFW_RELEASE && Globals.key == GLFW_KEY_F)
-			{
-				cam_y -= 0.01;
-			}
-
 			camera_transform = glm::lookAt(
-				glm::vec3(cam_x, cam_y, cam_z),
+				glm::mix(scene.previous_camera, scene.camera, alpha),
 				glm::vec3(normalized_mouse, 0),
 				glm::vec3(0, 1, 0));
 		}
@@ -697,236 +983,735 @@ void main()
 			);
 		}
 
-		//ROVER 2 -- moves automatically
-		
-		glm::mat4 rotation2(1.0);
+		glm::mat4 view_projection = projection * camera_transform;
 
-		glm::mat4 rover_transform2(1.0);
-		rover_transform2 = glm::scale(glm::vec3(0.08));
-		rover_transform2 = glm::translate(glm::vec3(-1.05, 0, 0)) * rover_transform2;
-		if (!Globals.collision)
+		//CULLING
+		/* Mars hides whatever is behind its horizon. The tests start once the spheres are filled, the rover draws wait for them */
+		glm::vec3 eye_position = glm::vec3(glm::inverse(camera_transform)[3]);
+		const Frustum frustum = ExtractFrustum(view_projection);
+		std::atomic<size_t> cull_tested(0), frustum_culled(0), horizon_culled(0);
+		JobCounter cull_done;
+		jobs.ParallelFor("cull", 2 * rover_count, 4096, [&](size_t begin, size_t end)
 		{
-			rotation2 = glm::rotate(glm::radians(float(0.5)), glm::vec3(0, 0, 1));
-		}
-		rover_rotate2 = rover_rotate2 * rotation2;
-		rover_transform2 = rover_rotate2 * rover_transform2;
+			CullStats stats = CullSpheres(cull_spheres.x.data() + begin, cull_spheres.y.data() + begin, cull_spheres.z.data() + begin,
+				cull_spheres.radius.data() + begin, end - begin, frustum, eye_position, mars_occluder, cull_visible.data() + begin);
+			cull_tested += stats.tested;
+			frustum_culled += stats.frustum_culled;
+			horizon_culled += stats.horizon_culled;
+		}, cull_done, &matrices_done);
+
+		//DRAW SUBMISSION
+		/* Draws are queued with a sort key and issued after sorting, not in the order below */
+		render_queue.Clear();
+
+		auto submitQueried = [&](const Material& material, const VAO& vao, const glm::mat4& model, DrawQuery query_use, GLuint query)
+		{
+			float view_depth = (camera_transform * model[3]).z;
+
+			DrawItem item;
+			item.program = material.program->id;
+			item.transform_location = material.program->transform_location;
+			item.texture = material.texture;
+			item.texture_target = MaterialTextureTarget(material);
+			item.layer_location = material.program->layer_location;
+			item.layer = material.layer;
+			item.vao = vao.id;
+			item.element_count = vao.element_array_count;
+			item.transform = view_projection * model;
+			item.query_use = query_use;
+			item.query = query;
+			render_queue.Submit(MakeSortKey(material.pass, item.program, item.texture, vao.id, (view_depth - z_near) / (z_far - z_near)), item);
+		};
 
-		rover2_pos = mars_transform * rover_transform2 * glm::vec4(-1.05, 0, 0, 1);
+		auto submitDraw = [&](const Material& material, const VAO& vao, const glm::mat4& model)
+		{
+			submitQueried(material, vao, model, DRAW_QUERY_NONE, 0);
+		};
 
-		//ROVER 3
+		//MARS
+		submitDraw(mars_material, sphereVAO, mars_transform);
 
-		glm::mat4 rotation3(1.0);
+		if (virtual_texture)
+		{
+			/* Requests read back here are from an earlier frame, the feedback drawn now is read next frame */
+			virtual_texture->RenderFeedback(sphereVAO, view_projection * mars_transform, Globals.screen_dimensions);
+			VirtualTexture::Stats vt_stats = virtual_texture->Update();
+			SetFrameCounter("vt resident tiles", double(vt_stats.resident_tiles));
+			SetFrameCounter("vt miss rate %", vt_stats.requested_tiles ? 100.0 * vt_stats.missed_tiles / vt_stats.requested_tiles : 0.0);
+			SetFrameCounter("vt upload KB", vt_stats.bytes_uploaded / 1024.0);
+		}
 
-		glm::mat4 rover_transform3(1.0);
-		rover_transform3 = glm::scale(glm::vec3(0.08));
-		rover_transform3 = glm::translate(glm::vec3(0, 0, -1.05)) * rover_transform3;
+		jobs.Wait(cull_done);
+		SetFrameCounter("cull tested", double(cull_tested));
+		SetFrameCounter("frustum culled", double(frustum_culled));
+		SetFrameCounter("horizon culled", double(horizon_culled));
 
-		difference_x = my_rover_pos.x - rover3_pos.x;
-		difference_y = my_rover_pos.y - rover3_pos.y;
+		auto drawRover = [&](glm::mat4 modelMatrix, size_t occlusion_id)
+		{
+			DrawQuery query_use = DRAW_QUERY_NONE;
+			GLuint query = 0;
+			if (!Globals.noOcclusion)
+			{
+				/* The proxy box covers the body and wheels */
+				query = occlusion->ProxyQuery(occlusion_id);
+				if (query != 0)
+					submitQueried(proxy_material, cubeVAO, modelMatrix * glm::scale(glm::vec3(0.9)), DRAW_QUERY_PROXY, query);
+
+				if (occlusion->GetMode() == OcclusionCuller::CONDITIONAL_RENDER)
+					query_use = DRAW_QUERY_CONDITIONAL;
+				else if (!occlusion->Visible(occlusion_id))
+					return;
+				else
+					query = 0;
+			}
 
-		//int y_angle = my_rover_pos.y - rover3_pos.y;
-		float y_angle = atan2(my_rover_pos.z, my_rover_pos.y);// -atan2(rover3_pos.y, rover3_pos.y));
-		float z_angle = atan2(my_rover_pos.x, my_rover_pos.z);// -atan2(rover3_pos.z, rover3_pos.z));
+			//ROVER
+			submitQueried(rover_material, cubeVAO, modelMatrix * glm::scale(glm::vec3(0.5)), query_use, query);
 
-		glm::mat4 d(1.0);
+			//WHEELS
+			glm::mat4 wheel_transforms[4];
+			wheelTransforms(scene, occlusion_id, wheel_transforms);
+			for (const glm::mat4& wheel_transform : wheel_transforms)
+				submitQueried(wheel_material, wheelVAO, modelMatrix * wheel_transform, query_use, query);
+		};
 
-		if (!Globals.collision)
+		if (gpu_culler)
 		{
-			chasing1 = glm::mix(y_angle,0.f , 0.99f);
-			chasing2 = glm::mix(z_angle,0.f , 0.99f);
-			rotation3 = glm::rotate(y_angle*0.001f, glm::vec3(0, 0, 1));
-			if (rotation3 != d)
-				rotation3 =glm::rotate(z_angle*0.001f, glm::vec3(0, 1, 0)) * rotation3;
-			else if (z_angle != 0)
-				rotation3 =  glm::rotate(z_angle*0.001f, glm::vec3(0, 1, 0));
-			if (y_angle > 0) {}
+			/* Every instance gets the player's wheels */
+			glm::mat4 wheel_transforms[4];
+			wheelTransforms(scene, 0, wheel_transforms);
+			gpu_culler->Cull(rover_draw.data(), rover_count, rover_bounding_radius, glm::scale(glm::vec3(0.5)), wheel_transforms,
+				ExtractFrustum(view_projection), eye_position, mars_occluder);
+
+			/* Model matrices come from the instance buffer, the transform is only the camera */
+			auto submitInstanced = [&](const Material& material, GLuint vao, void(*draw)(const DrawItem&))
+			{
+				DrawItem item;
+				item.program = material.program->id;
+				item.transform_location = material.program->transform_location;
+				item.texture = material.texture;
+				item.texture_target = MaterialTextureTarget(material);
+				item.layer_location = material.program->layer_location;
+				item.layer = material.layer;
+				item.vao = vao;
+				item.element_count = 0;
+				item.transform = view_projection;
+				item.custom_draw = draw;
+				item.user_data = gpu_culler.get();
+				render_queue.Submit(MakeSortKey(material.pass, item.program, item.texture, vao, 0.f), item);
+			};
+			submitInstanced(instanced_rover_material, gpu_culler->BodyVAO(), DrawCulledRoverBodies);
+			submitInstanced(instanced_wheel_material, gpu_culler->WheelVAO(), DrawCulledRoverWheels);
 		}
-		/*
-		if (!Globals.collision && (my_rover_pos.z * rover3_pos.z > 0) && (abs(difference_x)>0.06))
+		else
 		{
-			if (difference_x < 0)
-				rotationx = glm::rotate(glm::radians(float(0.5)), glm::vec3(0, 1, 0));
-			else if (difference_x > 0 )
-				rotationx = glm::rotate(glm::radians(float(-0.5)), glm::vec3(0, 1, 0));
+			if (!Globals.noOcclusion)
+				occlusion->BeginFrame();
+
+			for (size_t i = 0; i < rover_count; ++i)
+				if (cull_visible[i])
+					drawRover(rover_draw[i], i);
+
+			if (!Globals.noOcclusion && occlusion->GetMode() == OcclusionCuller::PREVIOUS_FRAME)
+				SetFrameCounter("occlusion hidden", double(occlusion->HiddenCount()));
 		}
 
-		if (!Globals.collision && (my_rover_pos.z * rover3_pos.z > 0) && (abs(difference_y) > 0.06))
+		for (size_t i = 0; i < rover_count; ++i)
+			if (cull_visible[rover_count + i])
+				submitDraw(clear_material, cubeVAO, glm::translate(rover_draw_pos[i]) * glm::scale(glm::vec3(scaleFactor)));
+
+		//STARS
+		glm::mat4 background(1.0);
+		submitDraw(stars_material, quadVAO, background);
+
+		//TEXTURE STREAMING
+		/* Finer levels of the progressive textures, within the upload budget */
+		if (texture_streamer && !texture_streamer->Update())
+			texture_streamer.reset();
+
+		if (virtual_texture)
 		{
-			if (rover3_pos.x < 0)
-			{
-				if (difference_y < 0 )
-					rotationy = glm::rotate(glm::radians(float(0.5)), glm::vec3(0, 0, 1));
-				else if (difference_y >= 0)
-					rotationy = glm::rotate(glm::radians(float(-0.5)), glm::vec3(0, 0, 1));
-			}
-			else
-			{
-				if (difference_y < 0)
-					rotationy = glm::rotate(glm::radians(float(-0.5)), glm::vec3(0, 0, 1));
-				else if (difference_y >= 0)
-					rotationy = glm::rotate(glm::radians(float(0.5)), glm::vec3(0, 0, 1));
-			}
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, virtual_texture->IndirectionTexture());
 		}
+		glActiveTexture(GL_TEXTURE0);
 
-		if (rotationx == glm::mat4(1.0))
-			rover_rotate3 = rover_rotate3 * rotationy;
-		else
-			rover_rotate3 = rover_rotate3 * rotationy * rotationx;
-*/
-		rover_rotate3 = rover_rotate3 * rotation3;
-		rover_transform3 = rover_rotate3 * rover_transform3;
+		render_queue.Sort();
+		render_queue.Execute();
 
-		rover3_pos = mars_transform * rover_transform3 *  glm::vec4(0,0, - 1.05, 1);
+		/* Milliseconds per job name, summed over the threads */
+		for (const JobTiming& timing : jobs.TakeTimings())
+			SetFrameCounter(timing.name, timing.milliseconds);
+		PrintFrameStats(frame_clock.Time());
 
-		
-		//MARS
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, mars_texture);
-		glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(projection * camera_transform * mars_transform));
-		glUniform2fv(mouse_location, 1, glm::value_ptr(glm::vec2(normalized_mouse)));
-		glBindVertexArray(sphereVAO.id);
-		glDrawElements(GL_TRIANGLES, sphereVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+		/* Swap front and back buffers */
+		glfwSwapBuffers(window);
 
-		rover_transform = rover_transform * glm::rotate(glm::radians(90.f), glm::vec3(0, 1, 0));
-		rover_transform2 = rover_transform2 * glm::rotate(glm::radians(270.f), glm::vec3(0, 1, 0));
-		rover_transform3 = rover_transform3 * glm::rotate(glm::radians(180.f), glm::vec3(0, 1, 0));
-		rover_transform3 = rover_transform3 * glm::rotate(glm::radians(90.f), glm::vec3(0,0,1)) ;
+		/* Poll for and process events */
+		glfwPollEvents();
+	}
 
+	if (simulation_thread)
+	{
+		unsigned long long late_ticks = simulation_thread->LateTicks();
+		simulation_thread.reset();
+		std::cout << "Simulation thread: " << simulation.TickCount() << " ticks, " << late_ticks << " run late to catch up" << std::endl;
+	}
+	/* A replay that ended after the last frame */
+	if (replay_checked.exchange(false))
+		PrintReplayCheck(replay_check);
+	frame_times.Print(Globals.singleThread ? "Frame times, single thread" : "Frame times, simulation thread");
 
-		auto drawRover = [&](glm::mat4 modelMatrix)
-		{
-			//ROVER
-			glBindTexture(GL_TEXTURE_2D, rover_texture);
-			glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(modelMatrix * glm::scale(glm::vec3(0.5))));
-			glUniform2fv(mouse_location, 1, glm::value_ptr(glm::vec2(normalized_mouse)));
-			glBindVertexArray(cubeVAO.id);
-			glDrawElements(GL_TRIANGLES, cubeVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+	if (!Globals.recordFile.empty())
+	{
+		if (input_recorder.Save(Globals.recordFile, simulation))
+			std::cout << "Recorded " << simulation.TickCount() << " ticks of input to " << Globals.recordFile << std::endl;
+		else
+			std::cout << "Could not write " << Globals.recordFile << std::endl;
+	}
 
-			//WHEELS
-			glBindTexture(GL_TEXTURE_2D, wheel_texture);
-			glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(modelMatrix* FL_wheel_transform));
-			glUniform2fv(mouse_location, 1, glm::value_ptr(glm::vec2(normalized_mouse)));
-			glBindVertexArray(wheelVAO.id);
-			glDrawElements(GL_TRIANGLES, wheelVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+	/* GL objects are deleted while the context still exists */
+	occlusion.reset();
+	gpu_culler.reset();
+	virtual_texture.reset();
+	texture_streamer.reset();
 
-			glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(modelMatrix * FR_wheel_transform));
-			glDrawElements(GL_TRIANGLES, wheelVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+	glfwTerminate();
+	return 0;
+}
 
-			glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(modelMatrix * BR_wheel_transform));
-			glDrawElements(GL_TRIANGLES, wheelVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+void print(glm::vec3 vector)
+{
+	std::cout << vector.x << "  " << vector.y << "   " << vector.z << std::endl; 
+}
 
-			glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(modelMatrix * BL_wheel_transform));
-			glDrawElements(GL_TRIANGLES, wheelVAO.element_array_count, GL_UNSIGNED_INT, NULL);
-		};
+static void DrawCulledRoverBodies(const DrawItem& item)
+{
+	static_cast<const GpuRoverCuller*>(item.user_data)->DrawBodies();
+}
 
-		drawRover(projection * camera_transform * mars_transform * rover_transform);
-		drawRover(projection * camera_transform * mars_transform * rover_transform2);
-		drawRover(projection * camera_transform * mars_transform * rover_transform3);
+static void DrawCulledRoverWheels(const DrawItem& item)
+{
+	static_cast<const GpuRoverCuller*>(item.user_data)->DrawWheels();
+}
 
+/* True when some texel would be discarded by the alpha test */
+bool TextureHasCutout(const unsigned char* data, int width, int height, int channels)
+{
+	if (data == NULL || (channels != 2 && channels != 4))
+		return false;
+
+	size_t texel_count = size_t(width) * height;
+	for (size_t i = 0; i < texel_count; ++i)
+		if (data[i * channels + channels - 1] < 26)
+			return true;
+	return false;
+}
 
-		float scaleFactor = 0.055;
-		glm::vec3 myCubePosn = glm::translate(my_rover_pos) * glm::scale(glm::vec3(scaleFactor)) * glm::vec4(-1, -1, -1, 1);
-		glm::vec3 myCubePosp = glm::translate(my_rover_pos) * glm::scale(glm::vec3(scaleFactor)) * glm::vec4(1,1,1,1);
-		glBindTexture(GL_TEXTURE_2D, clear_texture);
-		glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(projection * camera_transform * glm::translate(my_rover_pos) * glm::scale(glm::vec3(scaleFactor))));
-		glUniform2fv(mouse_location, 1, glm::value_ptr(glm::vec2(0, 0)));
-		glBindVertexArray(cubeVAO.id);
-		glDrawElements(GL_TRIANGLES, cubeVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+/* The simulation's view of the last key event */
+static SimulationInput CurrentInput()
+{
+	SimulationInput input;
+	input.held = Globals.action != GLFW_RELEASE;
+	input.rover_cam = Globals.roverCam;
+	switch (Globals.key)
+	{
+	case GLFW_KEY_W: input.key = SIM_KEY_FORWARD; break;
+	case GLFW_KEY_S: input.key = SIM_KEY_BACK; break;
+	case GLFW_KEY_A: input.key = SIM_KEY_LEFT; break;
+	case GLFW_KEY_D: input.key = SIM_KEY_RIGHT; break;
+	case GLFW_KEY_RIGHT: input.key = SIM_KEY_CAMERA_RIGHT; break;
+	case GLFW_KEY_LEFT: input.key = SIM_KEY_CAMERA_LEFT; break;
+	case GLFW_KEY_UP: input.key = SIM_KEY_CAMERA_FORWARD; break;
+	case GLFW_KEY_DOWN: input.key = SIM_KEY_CAMERA_BACK; break;
+	case GLFW_KEY_R: input.key = SIM_KEY_CAMERA_UP; break;
+	case GLFW_KEY_F: input.key = SIM_KEY_CAMERA_DOWN; break;
+	default: break;
+	}
+	return input;
+}
 
+/* Runs the ticks as fast as possible, prints the throughput and the time per system. The player drives forward unless a recording is replayed */
+static int RunHeadless(unsigned long long ticks, int rovers)
+{
+	InputReplay replay;
+	int tick_rate = Globals.tickRate;
+	bool continuous_collision = Globals.continuousCollision;
+	bool stop_on_collision = !Globals.noCollisionStop;
+	bool replaying = !Globals.replayFile.empty();
+	if (replaying)
+	{
+		if (!replay.Load(Globals.replayFile))
+		{
+			std::cout << "Input recording " << Globals.replayFile << " is missing or invalid." << std::endl;
+			return 1;
+		}
+		ticks = replay.Header().tick_count;
+		rovers = int(replay.Header().rover_count);
+		tick_rate = int(replay.Header().tick_rate);
+		continuous_collision = replay.ContinuousCollision();
+		stop_on_collision = replay.StopOnCollision();
+	}
 
-		glm::vec3 myCubePos3n = glm::translate(rover3_pos) * glm::scale(glm::vec3(scaleFactor)) * glm::vec4(-1, -1, -1, 1);
-		glm::vec3 myCubePos3p = glm::translate(rover3_pos) * glm::scale(glm::vec3(scaleFactor)) * glm::vec4(1, 1, 1, 1);
-		glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(projection * camera_transform * glm::translate(rover3_pos) * glm::scale(glm::vec3(scaleFactor))));
-		glUniform2fv(mouse_location, 1, glm::value_ptr(glm::vec2(0, 0)));
-		glDrawElements(GL_TRIANGLES, cubeVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+	SimulationInput forward;
+	forward.key = SIM_KEY_FORWARD;
+	forward.held = true;
+	auto inputFor = [&](unsigned long long tick)
+	{
+		return replaying ? replay.Input(tick) : forward;
+	};
 
-		glm::vec3 myCubePos2n = glm::translate(rover2_pos) * glm::scale(glm::vec3(scaleFactor)) * glm::vec4(-1, -1, -1, 1);
-		glm::vec3 myCubePos2p = glm::translate(rover2_pos) * glm::scale(glm::vec3(scaleFactor)) * glm::vec4(1, 1, 1, 1);
-		glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(projection * camera_transform * glm::translate(rover2_pos) * glm::scale(glm::vec3(scaleFactor))));
-		glUniform2fv(mouse_location, 1, glm::value_ptr(glm::vec2(0, 0)));
-		glDrawElements(GL_TRIANGLES, cubeVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+	/* Untimed first, the clock reads would be part of the throughput */
+	JobSystem jobs(Globals.threads);
+	Simulation simulation(rovers, tick_rate, continuous_collision);
+	simulation.SetStopOnCollision(stop_on_collision);
+	simulation.SetJobSystem(&jobs);
+	InputRecorder recorder;
+	StartupTimer timer;
+	for (unsigned long long i = 0; i < ticks; ++i)
+	{
+		SimulationInput input = inputFor(i);
+		if (!Globals.recordFile.empty())
+			recorder.Record(i, input);
+		simulation.Tick(input);
+	}
+	double milliseconds = timer.ElapsedMilliseconds();
+
+	replay.Rewind();
+	Simulation timed_simulation(rovers, tick_rate, continuous_collision);
+	timed_simulation.SetStopOnCollision(stop_on_collision);
+	timed_simulation.SetJobSystem(&jobs);
+	jobs.EnableTiming(true);
+	SimulationTimings timings;
+	/* The stop is for good, every tick after the first collision times a world standing still */
+	unsigned long long stopped_from = ticks;
+	for (unsigned long long i = 0; i < ticks; ++i)
+	{
+		timed_simulation.Tick(inputFor(i), &timings);
+		if (stopped_from == ticks && timed_simulation.Collision() && timed_simulation.StopOnCollision())
+			stopped_from = i + 1;
+	}
+	std::vector<JobTiming> job_timings = jobs.TakeTimings();
 
-		checkCollision2(myCubePosn, myCubePosp, myCubePos2n, myCubePos2p, myCubePos3n, myCubePos3p);
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "Headless simulation: " << ticks << " ticks, " << simulation.RoverCount() << " rovers on " << jobs.ThreadCount() << " threads in "
+		<< milliseconds << " ms, " << (milliseconds > 0 ? ticks / (milliseconds / 1000.0) : 0.0) << " ticks/s" << std::endl;
 
-		//STARS
-		glBindTexture(GL_TEXTURE_2D, stars_texture);
-		glm::mat4 background(1.0);
-		glUniformMatrix4fv(u_transform_location, 1, GL_FALSE, glm::value_ptr(projection * camera_transform * background));
-		glBindVertexArray(quadVAO.id);
-		glDrawElements(GL_TRIANGLES, quadVAO.element_array_count, GL_UNSIGNED_INT, NULL);
+	auto printSystem = [ticks](const char* name, double system_milliseconds)
+	{
+		std::cout << "  " << std::left << std::setw(10) << name << std::right << std::setw(10) << system_milliseconds << " ms"
+			<< std::setprecision(3) << std::setw(10) << (ticks ? system_milliseconds * 1000.0 / ticks : 0.0) << " us/tick" << std::setprecision(1) << std::endl;
+	};
+	printSystem("movement", timings.movement);
+	printSystem("chase", timings.chase);
+	printSystem("camera", timings.camera);
+	printSystem("collision", timings.collision);
+
+	/* Job time is summed over the threads, it exceeds the system times above when jobs run side by side */
+	std::cout << "  job                 jobs        ms   us/job  longest us" << std::endl;
+	for (const JobTiming& timing : job_timings)
+	{
+		std::cout << "  " << std::left << std::setw(14) << timing.name << std::right << std::setw(10) << timing.jobs << std::setw(10) << timing.milliseconds
+			<< std::setw(9) << timing.milliseconds * 1000.0 / timing.jobs << std::setw(12) << timing.longest_milliseconds * 1000.0 << std::endl;
+	}
 
+	glm::vec3 player = simulation.Rovers().Position(0);
+	std::cout << std::setprecision(4) << "Player at (" << player.x << ", " << player.y << ", " << player.z << "), "
+		<< (simulation.Collision() ? "colliding" : "not colliding") << std::endl;
+	if (stopped_from < ticks)
+	{
+		std::cout << "Warning: every rover stopped at the collision after tick " << stopped_from << ", the other "
+			<< ticks - stopped_from << " ticks timed a world standing still. --no-collision-stop keeps the rovers moving." << std::endl;
+	}
+	const BroadphaseStats& collision_stats = simulation.CollisionStats();
+	std::cout << "Last tick tested " << collision_stats.tested_pairs << " of " << size_t(simulation.RoverCount()) * (simulation.RoverCount() - 1) / 2
+		<< " rover pairs, " << collision_stats.overlapping_pairs << " overlapping, " << collision_stats.moved << " rovers changed cell" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
 
-		/* Swap front and back buffers */
-		glfwSwapBuffers(window);
+	if (replaying)
+		PrintReplayCheck({ simulation.TickCount(), simulation.StateHash(), replay.Header().final_state_hash });
+	else
+		std::cout << "State hash " << std::hex << std::setfill('0') << std::setw(16) << simulation.StateHash() << std::dec << std::setfill(' ') << std::endl;
 
-		/* Poll for and process events */
-		glfwPollEvents();
+	if (!Globals.recordFile.empty())
+	{
+		if (!recorder.Save(Globals.recordFile, simulation))
+		{
+			std::cout << "Could not write " << Globals.recordFile << std::endl;
+			return 1;
+		}
+		std::cout << "Recorded " << ticks << " ticks of input to " << Globals.recordFile << std::endl;
 	}
+	return 0;
+}
 
-	glfwTerminate();
+/*
+	Time per rover per tick from a handful of rovers to a hundred thousand, the player
+	drives forward. The collision stop is off, otherwise the player runs into a rover
+	within a few ticks at high counts and the rest would time a world standing still.
+	Pairs are from the last tick, cell moves are averaged over the ticks.
+*/
+static int RunRoverScaling()
+{
+	const int counts[] = { 3, 10, 100, 1000, 10000, 100000 };
+
+	SimulationInput forward;
+	forward.key = SIM_KEY_FORWARD;
+	forward.held = true;
+
+	JobSystem jobs(Globals.threads);
+	std::cout << std::fixed << std::setprecision(1);
+	std::cout << "On " << jobs.ThreadCount() << " threads" << (Globals.continuousCollision ? ", continuous collision" : "") << std::endl;
+	std::cout << "  rovers     ticks        ms   ns/rover/tick     ms/tick  pairs tested     all pairs  tested %  moves/tick" << std::endl;
+	for (int count : counts)
+	{
+		/* About two million rover ticks per count */
+		unsigned long long ticks = std::max(10ull, 2000000ull / (unsigned long long)count);
+		Simulation simulation(count, Simulation::default_tick_rate, Globals.continuousCollision);
+		simulation.SetJobSystem(&jobs);
+		simulation.SetStopOnCollision(false);
+		simulation.Tick(forward);
+
+		StartupTimer timer;
+		size_t moves = 0;
+		for (unsigned long long i = 0; i < ticks; ++i)
+		{
+			simulation.Tick(forward);
+			moves += simulation.CollisionStats().moved;
+		}
+		double milliseconds = timer.ElapsedMilliseconds();
+
+		double all_pairs = double(count) * (count - 1) / 2;
+		size_t tested_pairs = simulation.CollisionStats().tested_pairs;
+		std::cout << std::setw(8) << count << std::setw(10) << ticks << std::setw(10) << milliseconds
+			<< std::setw(16) << milliseconds * 1e6 / (double(ticks) * count)
+			<< std::setprecision(3) << std::setw(12) << milliseconds / ticks << std::setprecision(1)
+			<< std::setw(14) << tested_pairs << std::setw(14) << std::setprecision(0) << all_pairs
+			<< std::setprecision(2) << std::setw(10) << 100.0 * tested_pairs / all_pairs
+			<< std::setw(12) << double(moves) / ticks << std::setprecision(1) << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
 	return 0;
 }
 
-void checkCollision2(glm::vec3 cube1p, glm::vec3 cube1n, glm::vec3 cube2p, glm::vec3 cube2n, glm::vec3 cube3p, glm::vec3 cube3n)
+/*
+	Integrates the same rotations as quaternions (the simulation's code) and as 4x4 matrices
+	multiplied every tick (how the game used to), next to a double precision reference.
+	Error is the largest element difference from the reference rotation matrix.
+*/
+static int RunOrientationSoak(unsigned long long ticks)
 {
-	float minX = std::min(cube1p.x, cube1n.x);
-	float maxX = std::max(cube1p.x, cube1n.x);
-	float minY = std::min(cube1p.y, cube1n.y);
-	float maxY = std::max(cube1p.y, cube1n.y);
-	float minZ = std::min(cube1p.z, cube1n.z);
-	float maxZ = std::max(cube1p.z, cube1n.z);
-
-	float minX2 = std::min(cube2p.x, cube2n.x);
-	float maxX2 = std::max(cube2p.x, cube2n.x);
-	float minY2 = std::min(cube2p.y, cube2n.y);
-	float maxY2 = std::max(cube2p.y, cube2n.y);
-	float minZ2 = std::min(cube2p.z, cube2n.z);
-	float maxZ2 = std::max(cube2p.z, cube2n.z);
-
-	float minX3 = std::min(cube3p.x, cube3n.x);
-	float maxX3 = std::max(cube3p.x, cube3n.x);
-	float minY3 = std::min(cube3p.y, cube3n.y);
-	float maxY3 = std::max(cube3p.y, cube3n.y);
-	float minZ3 = std::min(cube3p.z, cube3n.z);
-	float maxZ3 = std::max(cube3p.z, cube3n.z);
-
-	if ((minX <= maxX2 && maxX >= minX2) &&
-		(minY <= maxY2 && maxY >= minY2) &&
-		(minZ <= maxZ2 && maxZ >= minZ2))
-	{
-		Globals.collision = true;
+	const size_t count = 64;
+	const float rates[] = { glm::radians(2.0f), glm::radians(0.5f), glm::radians(-2.0f), 0.0f };
+
+	std::vector<float> drive(count), turn(count);
+	std::vector<glm::quat> quaternions(count);
+	std::vector<glm::mat4> matrices(count);
+	std::vector<glm::dquat> reference(count), reference_step(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		/* Runs of rovers share rates, like the circling rovers do */
+		drive[i] = rates[(i / 22) % 3];
+		turn[i] = rates[(i / 16) % 4];
+		quaternions[i] = glm::angleAxis(float(i) * 2.39996f, glm::vec3(0, 1, 0)) * glm::angleAxis(float(i) * 0.7f, glm::vec3(1, 0, 0));
+		matrices[i] = glm::mat4_cast(quaternions[i]);
+		reference[i] = glm::dquat(quaternions[i]);
+		/* The exact rotation of the float step, so only the accumulated rounding shows */
+		reference_step[i] = glm::normalize(glm::dquat(glm::angleAxis(drive[i], glm::vec3(0, 0, 1)) * glm::angleAxis(turn[i], glm::vec3(0, 1, 0))));
 	}
-	else if ((minX <= maxX3 && maxX >= minX3) &&
-		(minY <= maxY3 && maxY >= minY3) &&
-		(minZ <= maxZ3 && maxZ >= minZ3))
+
+	auto matrixError = [](const glm::mat3& rotation, const glm::dquat& exact)
+	{
+		glm::dmat3 expected = glm::mat3_cast(exact);
+		double error = 0;
+		for (int column = 0; column < 3; ++column)
+			for (int row = 0; row < 3; ++row)
+				error = std::max(error, std::abs(double(rotation[column][row]) - expected[column][row]));
+		return error;
+	};
+
+	std::cout << "Orientation soak: " << ticks << " ticks, " << count << " rovers" << std::endl;
+	std::cout << "       ticks  quat error   quat |q|-1   ns/rover  mat4 error  mat4 ortho   ns/rover" << std::endl;
+
+	unsigned long long block = std::max(1ull, ticks / 10);
+	double quaternion_milliseconds = 0, matrix_milliseconds = 0;
+	for (unsigned long long done = 0; done < ticks;)
 	{
-		Globals.collision = true;
+		unsigned long long block_ticks = std::min(block, ticks - done);
+
+		StartupTimer quaternion_timer;
+		for (unsigned long long tick = done; tick < done + block_ticks; ++tick)
+		{
+			IntegrateOrientations(quaternions.data(), drive.data(), turn.data(), 1.0f, count);
+			if ((tick + 1) % Simulation::normalize_interval == 0)
+				NormalizeOrientations(quaternions.data(), count);
+		}
+		quaternion_milliseconds += quaternion_timer.ElapsedMilliseconds();
+
+		StartupTimer matrix_timer;
+		float cached_drive = 0.0f, cached_turn = 0.0f;
+		glm::mat4 drive_rotation(1.0), turn_rotation(1.0);
+		for (unsigned long long tick = done; tick < done + block_ticks; ++tick)
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (drive[i] != cached_drive)
+				{
+					cached_drive = drive[i];
+					drive_rotation = glm::rotate(cached_drive, glm::vec3(0, 0, 1));
+				}
+				if (turn[i] != cached_turn)
+				{
+					cached_turn = turn[i];
+					turn_rotation = glm::rotate(cached_turn, glm::vec3(0, 1, 0));
+				}
+				matrices[i] = matrices[i] * drive_rotation * turn_rotation;
+			}
+		matrix_milliseconds += matrix_timer.ElapsedMilliseconds();
+
+		for (unsigned long long tick = done; tick < done + block_ticks; ++tick)
+			for (size_t i = 0; i < count; ++i)
+				reference[i] = reference[i] * reference_step[i];
+		for (glm::dquat& q : reference)
+			q = glm::normalize(q);
+		done += block_ticks;
+
+		double quaternion_error = 0, norm_error = 0, matrix_error = 0, orthogonality_error = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			quaternion_error = std::max(quaternion_error, matrixError(glm::mat3_cast(quaternions[i]), reference[i]));
+			norm_error = std::max(norm_error, std::abs(double(glm::length(quaternions[i])) - 1.0));
+			glm::mat3 rotation(matrices[i]);
+			matrix_error = std::max(matrix_error, matrixError(rotation, reference[i]));
+			glm::mat3 product = glm::transpose(rotation) * rotation;
+			for (int column = 0; column < 3; ++column)
+				for (int row = 0; row < 3; ++row)
+					orthogonality_error = std::max(orthogonality_error, std::abs(double(product[column][row]) - (column == row ? 1.0 : 0.0)));
+		}
+
+		double rover_ticks = double(done) * count;
+		std::cout << std::setw(12) << done << std::scientific << std::setprecision(2)
+			<< std::setw(12) << quaternion_error << std::setw(13) << norm_error
+			<< std::fixed << std::setw(11) << quaternion_milliseconds * 1e6 / rover_ticks
+			<< std::scientific << std::setw(12) << matrix_error << std::setw(12) << orthogonality_error
+			<< std::fixed << std::setw(11) << matrix_milliseconds * 1e6 / rover_ticks << std::endl;
 	}
-	else
+	std::cout.unsetf(std::ios::floatfield);
+	return 0;
+}
+
+/*
+	Every pair of rovers through the collision kernels at each level the CPU supports, next
+	to the per pair tests the game used before the kernels: glm::pow distances for spheres
+	and min / max corners for boxes. The hits of every level must match.
+*/
+static int RunCollisionBench(int rover_count)
+{
+	const int passes = 5;
+
+	Simulation simulation(rover_count);
+	simulation.Tick(SimulationInput());
+	const RoverStore& rovers = simulation.Rovers();
+	size_t count = rovers.Size();
+
+	/* Boxes along the rover frames, spheres around the boxes */
+	float half = Simulation::CollisionHalfSize();
+	float radius = half * std::sqrt(3.0f);
+	std::vector<float> radii(count, radius);
+	std::vector<OrientedBox> box_list(count);
+	OrientedBoxes boxes;
+	for (size_t i = 0; i < count; ++i)
 	{
-		Globals.collision = false;
+		box_list[i].center = glm::vec3(rovers.position_x[i], rovers.position_y[i], rovers.position_z[i]);
+		box_list[i].axes = glm::mat3_cast(rovers.orientation[i]);
+		box_list[i].half_size = glm::vec3(half);
+		boxes.Add(box_list[i]);
 	}
+	const float* x = boxes.x.data();
+	const float* y = boxes.y.data();
+	const float* z = boxes.z.data();
 
-	
+	/* Fastest of a few passes over all count * (count - 1) / 2 pairs */
+	double pairs = double(count) * (count - 1) / 2;
+	auto timePasses = [&](auto pass, size_t& overlapping)
+	{
+		double milliseconds = 1e30;
+		for (int p = 0; p < passes; ++p)
+		{
+			StartupTimer timer;
+			overlapping = pass();
+			milliseconds = std::min(milliseconds, timer.ElapsedMilliseconds());
+		}
+		return milliseconds;
+	};
 
-};
+	/* The per pair tests of the old game loop */
+	auto legacySpheres = [&]()
+	{
+		size_t overlapping = 0;
+		for (size_t i = 0; i < count; ++i)
+			for (size_t j = i + 1; j < count; ++j)
+			{
+				float distance = glm::pow(glm::pow(x[i] - x[j], 2.0f) + glm::pow(y[i] - y[j], 2.0f) + glm::pow(z[i] - z[j], 2.0f), 0.5f);
+				overlapping += distance <= 2.0f * radius;
+			}
+		return overlapping;
+	};
+	auto legacyBoxes = [&]()
+	{
+		size_t overlapping = 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			glm::vec3 min_i = glm::vec3(x[i], y[i], z[i]) - half, max_i = glm::vec3(x[i], y[i], z[i]) + half;
+			for (size_t j = i + 1; j < count; ++j)
+			{
+				glm::vec3 min_j = glm::vec3(x[j], y[j], z[j]) - half, max_j = glm::vec3(x[j], y[j], z[j]) + half;
+				overlapping += std::min(max_i.x, max_j.x) >= std::max(min_i.x, min_j.x)
+					&& std::min(max_i.y, max_j.y) >= std::max(min_i.y, min_j.y)
+					&& std::min(max_i.z, max_j.z) >= std::max(min_i.z, min_j.z);
+			}
+		}
+		return overlapping;
+	};
 
+	std::vector<uint32_t> hits(count);
+	auto sphereKernel = [&]()
+	{
+		size_t overlapping = 0;
+		for (size_t i = 0; i + 1 < count; ++i)
+			overlapping += SphereOverlaps(box_list[i].center, radius, x + i + 1, y + i + 1, z + i + 1, radii.data() + i + 1, count - i - 1, hits.data());
+		return overlapping;
+	};
+	auto boxKernel = [&]()
+	{
+		size_t overlapping = 0;
+		for (size_t i = 0; i + 1 < count; ++i)
+			overlapping += BoxOverlaps(box_list[i].center, glm::vec3(2.0f * half), x + i + 1, y + i + 1, z + i + 1, count - i - 1, hits.data());
+		return overlapping;
+	};
+	auto orientedBoxKernel = [&]()
+	{
+		size_t overlapping = 0;
+		for (size_t i = 0; i + 1 < count; ++i)
+			overlapping += OrientedBoxOverlaps(box_list[i], boxes, i + 1, hits.data());
+		return overlapping;
+	};
 
-void checkCollision(glm::vec3 my_rover, glm::vec3 rover2, glm::vec3 rover3)
-{
-	GLfloat distance1 = glm::pow((glm::pow((my_rover.x - rover2.x), 2) + glm::pow((my_rover.y - rover2.y), 2) + glm::pow((my_rover.z - rover2.z), 2)), 0.5);
-	GLfloat distance2 = glm::pow((glm::pow((my_rover.x - rover3.x), 2) + glm::pow((my_rover.y - rover3.y), 2) + glm::pow((my_rover.z - rover3.z), 2)), 0.5);
+	std::cout << "Collision kernels: " << count << " rovers, " << std::setprecision(0) << std::fixed << pairs << " pairs, best of " << passes << " passes" << std::endl;
+	std::cout << "  shape         test         hits     ns/pair   speedup" << std::endl;
 
-	if (distance1 > 0.11 && distance2 > 0.1)
-		Globals.collision = false;
-	else {
-		Globals.collision = true;
+	bool agree = true;
+	auto printRow = [&](const char* shape, const char* test, size_t overlapping, double milliseconds, double baseline)
+	{
+		std::cout << "  " << std::left << std::setw(14) << shape << std::setw(8) << test << std::right
+			<< std::setw(11) << overlapping << std::setprecision(2) << std::setw(12) << milliseconds * 1e6 / pairs
+			<< std::setprecision(1) << std::setw(9) << baseline / milliseconds << "x" << std::endl;
 	};
+	auto runShape = [&](const char* shape, auto legacy, auto kernel, bool has_legacy)
+	{
+		CollisionKernelLevel active = ActiveCollisionKernels();
+		size_t expected = 0, overlapping = 0;
+		double baseline = 0;
+		if (has_legacy)
+		{
+			baseline = timePasses(legacy, expected);
+			printRow(shape, "legacy", expected, baseline, baseline);
+		}
+		for (int level = COLLISION_KERNELS_SCALAR; level <= BestCollisionKernels(); ++level)
+		{
+			SetCollisionKernels(CollisionKernelLevel(level));
+			double milliseconds = timePasses(kernel, overlapping);
+			if (!has_legacy && level == COLLISION_KERNELS_SCALAR)
+			{
+				baseline = milliseconds;
+				expected = overlapping;
+			}
+			agree = agree && overlapping == expected;
+			printRow(shape, CollisionKernelName(CollisionKernelLevel(level)), overlapping, milliseconds, baseline);
+		}
+		SetCollisionKernels(active);
+	};
+	runShape("sphere", legacySpheres, sphereKernel, true);
+	runShape("box", legacyBoxes, boxKernel, true);
+	runShape("oriented box", legacyBoxes, orientedBoxKernel, false);
 
+	std::cout.unsetf(std::ios::floatfield);
+	std::cout << (agree ? "All levels found the same hits." : "Hit counts differ between levels!") << std::endl;
+	return agree ? 0 : 1;
 }
 
-void print(glm::vec3 vector)
+/*
+	Drives the player into the other rovers at several tick rates, once with discrete and
+	once with continuous collision. The time of the first contact is compared with
+	continuous collision at a very high tick rate. Each trial waits a multiple of half a
+	second before driving, forward or back, so the rovers meet somewhere else. A contact
+	found more than two ticks after the reference means the rovers passed through each
+	other, chasing makes the paths differ a little between tick rates.
+*/
+static int RunCollisionComparison()
 {
-	std::cout << vector.x << "  " << vector.y << "   " << vector.z << std::endl; 
+	const int reference_rate = 1920;
+	const int rates[] = { 240, 120, 60, 30, 20, 10, 6, 4, 2 };
+	const int trials = 12;
+	const double time_limit = 60.0;
+
+	SimulationInput forward;
+	forward.key = SIM_KEY_FORWARD;
+	forward.held = true;
+	SimulationInput back = forward;
+	back.key = SIM_KEY_BACK;
+	SimulationInput wait;
+
+	/* Seconds to the first contact, negative when there is none within the time limit */
+	auto firstContact = [&](int rate, bool continuous, int trial)
+	{
+		Simulation simulation(3, rate, continuous);
+		unsigned long long wait_ticks = (unsigned long long)(trial / 2 * rate / 2);
+		const SimulationInput& drive = trial % 2 == 0 ? forward : back;
+		unsigned long long limit = (unsigned long long)(time_limit * rate);
+		for (unsigned long long tick = 0; tick < limit; ++tick)
+		{
+			simulation.Tick(tick < wait_ticks ? wait : drive);
+			if (simulation.Collision())
+				return (double(tick) + simulation.ContactTime()) / rate;
+		}
+		return -1.0;
+	};
+
+	double reference[trials];
+	for (int trial = 0; trial < trials; ++trial)
+		reference[trial] = firstContact(reference_rate, true, trial);
+
+	std::cout << "Collision comparison: " << trials << " trials, reference is continuous at " << reference_rate << " ticks/s" << std::endl;
+	std::cout << "  ticks/s  deg/tick    discrete: missed  error ms    continuous: missed  error ms" << std::endl;
+	std::cout << std::fixed;
+	for (int rate : rates)
+	{
+		std::cout << std::setw(9) << rate << std::setprecision(1) << std::setw(10) << 2.0 * Simulation::default_tick_rate / rate;
+		for (int continuous = 0; continuous < 2; ++continuous)
+		{
+			/* Missed: no contact, or one found more than two ticks late. Error: the mean of the rest */
+			int missed = 0;
+			double error = 0;
+			for (int trial = 0; trial < trials; ++trial)
+			{
+				double contact = firstContact(rate, continuous != 0, trial);
+				if (contact < 0.0 || contact - reference[trial] > 2.0 / rate)
+					++missed;
+				else
+					error += std::abs(contact - reference[trial]) * 1000.0;
+			}
+			std::cout << std::setw(continuous ? 22 : 20) << missed << std::setprecision(2) << std::setw(10) << (missed < trials ? error / (trials - missed) : 0.0);
+		}
+		std::cout << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
+	return 0;
 }
 
+/* Compares the state at the end of a replay with the recorded one */
+static void PrintReplayCheck(const ReplayCheck& check)
+{
+	std::cout << "Replay of " << Globals.replayFile << " done after " << check.ticks << " ticks, state hash "
+		<< std::hex << std::setfill('0') << std::setw(16) << check.hash << std::dec << std::setfill(' ')
+		<< (check.hash == check.recorded_hash ? " matches the recording" : " differs from the recording") << std::endl;
+}
@@ -0,0 +1,108 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Mapped File */
+MappedFile::MappedFile()
+	: data(nullptr),
+	size(0)
+#ifdef _WIN32
+	, file(INVALID_HANDLE_VALUE),
+	mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping != nullptr)
+		data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	size = size_t(file_size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+#else
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	int descriptor = open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(descriptor, &status) != 0 || status.st_size == 0)
+	{
+		close(descriptor);
+		return false;
+	}
+
+	/* The mapping keeps its own reference to the file */
+	void* mapped = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+	close(descriptor);
+	if (mapped == MAP_FAILED)
+		return false;
+
+	data = static_cast<const unsigned char*>(mapped);
+	size = size_t(status.st_size);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap(const_cast<unsigned char*>(data), size);
+
+	data = nullptr;
+	size = 0;
+}
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/* Mapped File: a read only memory mapping of a whole file, pages load on first touch */
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/* Closes any previous mapping, false when the file is missing or empty */
+	bool Open(const std::string& path);
+	void Close();
+
+	const unsigned char* Data() const { return data; }
+	size_t Size() const { return size; }
+	bool IsOpen() const { return data != nullptr; }
+
+private:
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#endif
+};
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/* Mip Chain: CPU mip generation, no GL so the asset cooker can use it */
+
+struct MipLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;
+};
+
+/*
+	Levels 1 and below of a full mip chain down to 1x1, each one a 2x2 box filter of the
+	level above (SSE2 for the vertical pass). The rows of large levels are split across
+	threads. Odd sizes round down and reuse the last row or column.
+*/
+std::vector<MipLevel> BuildMipChain(const unsigned char* pixels, int width, int height, int channels);
+
+/* Texels in a full mip chain including level 0 */
+size_t MipChainTexels(int width, int height);
+
+/* Levels in a full mip chain including level 0 */
+int MipLevelCount(int width, int height);
+
+/* Size of a level of the chain, each one halves and rounds down to at least 1 */
+void MipLevelSize(int width, int height, int level, int& level_width, int& level_height);
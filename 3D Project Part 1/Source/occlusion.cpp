@@ -0,0 +1,113 @@
+#include "occlusion.h"
+
+/* Query Pool */
+QueryPool::~QueryPool()
+{
+	if (!free_queries.empty())
+		glDeleteQueries(GLsizei(free_queries.size()), free_queries.data());
+}
+
+GLuint QueryPool::Acquire()
+{
+	if (free_queries.empty())
+	{
+		GLuint query;
+		glGenQueries(1, &query);
+		++allocated;
+		return query;
+	}
+
+	GLuint query = free_queries.back();
+	free_queries.pop_back();
+	return query;
+}
+
+void QueryPool::Release(GLuint query)
+{
+	free_queries.push_back(query);
+}
+
+/* Occlusion Culler */
+OcclusionCuller::OcclusionCuller(Mode mode)
+	: mode(mode)
+{
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	for (std::vector<GLuint>& queries : retired)
+	{
+		for (GLuint query : queries)
+			pool.Release(query);
+	}
+	for (Tracked& object : objects)
+	{
+		if (object.pending_query != 0)
+			pool.Release(object.pending_query);
+	}
+}
+
+void OcclusionCuller::BeginFrame()
+{
+	frame = (frame + 1) % frames_in_flight;
+
+	/* Conditional render queries were issued frames_in_flight frames ago and are done with */
+	for (GLuint query : retired[frame])
+		pool.Release(query);
+	retired[frame].clear();
+
+	if (mode != PREVIOUS_FRAME)
+		return;
+
+	for (Tracked& object : objects)
+	{
+		if (object.pending_query == 0)
+			continue;
+
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(object.pending_query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint samples_passed = GL_FALSE;
+		glGetQueryObjectuiv(object.pending_query, GL_QUERY_RESULT, &samples_passed);
+		object.visible = samples_passed != GL_FALSE;
+
+		pool.Release(object.pending_query);
+		object.pending_query = 0;
+	}
+}
+
+GLuint OcclusionCuller::ProxyQuery(size_t object_id)
+{
+	if (object_id >= objects.size())
+		objects.resize(object_id + 1);
+
+	if (mode == CONDITIONAL_RENDER)
+	{
+		GLuint query = pool.Acquire();
+		retired[frame].push_back(query);
+		return query;
+	}
+
+	/* Wait for the outstanding result before testing again */
+	Tracked& object = objects[object_id];
+	if (object.pending_query != 0)
+		return 0;
+
+	object.pending_query = pool.Acquire();
+	return object.pending_query;
+}
+
+bool OcclusionCuller::Visible(size_t object_id) const
+{
+	return object_id >= objects.size() || objects[object_id].visible;
+}
+
+size_t OcclusionCuller::HiddenCount() const
+{
+	size_t hidden = 0;
+	for (const Tracked& object : objects)
+		hidden += !object.visible;
+	return hidden;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "GLAD/glad.h"
+
+/* Query Pool: recycles query objects instead of creating and deleting them every frame */
+class QueryPool
+{
+public:
+	/* Deletes the released queries, destroy it before the context */
+	~QueryPool();
+
+	GLuint Acquire();
+	void Release(GLuint query);
+
+	size_t Allocated() const { return allocated; }
+
+private:
+	std::vector<GLuint> free_queries;
+	size_t allocated = 0;
+};
+
+/*
+	Occlusion Culler: each tracked object draws a cheap proxy box inside a
+	GL_ANY_SAMPLES_PASSED query once the occluders are in the depth buffer.
+	- Conditional mode wraps the full draw in glBeginConditionalRender so the GPU
+	  skips it when the proxy was hidden, the CPU never looks at the result.
+	- Previous frame mode skips the full draw on the CPU with the last result
+	  that is available, polled with GL_QUERY_RESULT_AVAILABLE so it never waits.
+	  Objects that just became visible show up one frame late.
+	Query objects stay in flight for a few frames before they are reused.
+*/
+class OcclusionCuller
+{
+public:
+	enum Mode
+	{
+		CONDITIONAL_RENDER,
+		PREVIOUS_FRAME,
+	};
+
+	explicit OcclusionCuller(Mode mode);
+	/* Hands the queries still in flight back to the pool, which deletes them */
+	~OcclusionCuller();
+
+	Mode GetMode() const { return mode; }
+
+	/* Retires queries from old frames and collects results that are ready */
+	void BeginFrame();
+
+	/* Query for the proxy of object_id this frame, 0 means do not draw a proxy */
+	GLuint ProxyQuery(size_t object_id);
+
+	/* Previous frame mode only, false once the latest known result saw no samples */
+	bool Visible(size_t object_id) const;
+
+	size_t HiddenCount() const;
+
+private:
+	static const int frames_in_flight = 3;
+
+	struct Tracked
+	{
+		GLuint pending_query = 0;
+		bool visible = true;
+	};
+
+	Mode mode;
+	QueryPool pool;
+	std::vector<Tracked> objects;
+	std::vector<GLuint> retired[frames_in_flight];
+	int frame = 0;
+};
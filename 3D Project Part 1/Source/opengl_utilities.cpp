@@ -30,7 +30,7 @@ VAO::VAO(
 	glEnableVertexAttribArray(1);
 
 	glGenBuffers(1, &uvs_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normals_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, uvs_buffer);
 	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW);
 
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
@@ -44,13 +44,41 @@ VAO::VAO(
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
 };
 
-/* OpenGL Utility Functions */
-GLuint CreateShaderFromSource(const GLenum& shader_type, const GLchar * source)
+GLuint CreateInstancedVAO(const VAO& mesh, GLuint instance_buffer)
 {
-	GLuint shader = glCreateShader(shader_type);
-	glShaderSource(shader, 1, &source, NULL);
-	glCompileShader(shader);
+	GLuint id;
+	glGenVertexArrays(1, &id);
+	glBindVertexArray(id);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.position_buffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+	glEnableVertexAttribArray(0);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.normals_buffer);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+	glEnableVertexAttribArray(1);
 
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.uvs_buffer);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, static_cast<void *>(0));
+	glEnableVertexAttribArray(2);
+
+	/* A mat4 attribute takes four consecutive locations, one column each */
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	for (GLuint column = 0; column < 4; ++column)
+	{
+		glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(column * sizeof(glm::vec4)));
+		glVertexAttribDivisor(3 + column, 1);
+		glEnableVertexAttribArray(3 + column);
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.element_array_buffer);
+	glBindVertexArray(0);
+	return id;
+}
+
+/* OpenGL Utility Functions */
+bool CheckShaderCompileStatus(GLuint shader)
+{
 	int success;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 	if (!success)
@@ -60,7 +88,33 @@ GLuint CreateShaderFromSource(const GLenum& shader_type, const GLchar * source)
 		char info_log[512];
 		glGetShaderInfoLog(shader, 512, NULL, info_log);
 		std::cout << info_log << std::endl;
+	}
+	return success != 0;
+}
 
+bool CheckProgramLinkStatus(GLuint program)
+{
+	int success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		std::cout << "Error: Program Linking failed" << std::endl;
+
+		char info_log[512];
+		glGetProgramInfoLog(program, 512, NULL, info_log);
+		std::cout << info_log << std::endl;
+	}
+	return success != 0;
+}
+
+GLuint CreateShaderFromSource(const GLenum& shader_type, const GLchar * source)
+{
+	GLuint shader = glCreateShader(shader_type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	if (!CheckShaderCompileStatus(shader))
+	{
 		glDeleteShader(shader);
 		return NULL;
 	}
@@ -81,16 +135,8 @@ GLuint CreateProgramFromSources(const GLchar * vertex_shader_source, const GLcha
 	glAttachShader(program, fragment_shader);
 	glLinkProgram(program);
 
-	int success;
-	glGetProgramiv(program, GL_LINK_STATUS, &success);
-	if (!success)
+	if (!CheckProgramLinkStatus(program))
 	{
-		std::cout << "Error: Program Linking failed" << std::endl;
-
-		char info_log[512];
-		glGetProgramInfoLog(program, 512, NULL, info_log);
-		std::cout << info_log << std::endl;
-
 		glDeleteProgram(program);
 		return NULL;
 	}
@@ -28,8 +28,15 @@ struct VAO
 	);
 };
 
+/* A second VAO over the mesh buffers with a mat4 per instance at locations 3 to 6 */
+GLuint CreateInstancedVAO(const VAO& mesh, GLuint instance_buffer);
+
 /* OpenGL Utility Functions */
 
+/* Both query the status, which waits for the driver, and log the info log on failure */
+bool CheckShaderCompileStatus(GLuint shader);
+bool CheckProgramLinkStatus(GLuint program);
+
 GLuint CreateShaderFromSource(const GLenum& shader_type, const GLchar * source);
 
 GLuint CreateProgramFromSources(const GLchar * vertex_shader_source, const GLchar * fragment_shader_source);
@@ -0,0 +1,126 @@
+#include "page_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "mip_chain.h"
+
+static const unsigned char page_file_identifier[12] = { 0xAB, 'M', 'P', 'G', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+/* Tile data starts on a 4 KB boundary so tiles line up with memory pages */
+static const uint64_t page_data_alignment = 4096;
+
+static uint64_t DataOffset(uint32_t level_count)
+{
+	uint64_t index_end = sizeof(PageFileHeader) + sizeof(PageFileLevel) * uint64_t(level_count);
+	return (index_end + page_data_alignment - 1) / page_data_alignment * page_data_alignment;
+}
+
+bool WritePageFile(const std::string& path, const unsigned char* rgba, int width, int height, int tile_size, int border)
+{
+	if (rgba == nullptr || width <= 0 || height <= 0 || tile_size <= 0 || border < 0)
+		return false;
+
+	std::vector<MipLevel> mips = BuildMipChain(rgba, width, height, 4);
+
+	/* Levels until one tile covers the whole level */
+	std::vector<PageFileLevel> levels;
+	uint64_t tile_count = 0;
+	for (size_t level = 0; level <= mips.size(); ++level)
+	{
+		int level_width = level == 0 ? width : mips[level - 1].width;
+		int level_height = level == 0 ? height : mips[level - 1].height;
+
+		PageFileLevel info;
+		info.width = uint32_t(level_width);
+		info.height = uint32_t(level_height);
+		info.tiles_x = uint32_t((level_width + tile_size - 1) / tile_size);
+		info.tiles_y = uint32_t((level_height + tile_size - 1) / tile_size);
+		info.first_tile = tile_count;
+		levels.push_back(info);
+
+		tile_count += uint64_t(info.tiles_x) * info.tiles_y;
+		if (info.tiles_x == 1 && info.tiles_y == 1)
+			break;
+	}
+
+	PageFileHeader header;
+	std::memcpy(header.identifier, page_file_identifier, sizeof(header.identifier));
+	header.width = uint32_t(width);
+	header.height = uint32_t(height);
+	header.tile_size = uint32_t(tile_size);
+	header.border = uint32_t(border);
+	header.level_count = uint32_t(levels.size());
+	header.reserved[0] = 0;
+	header.reserved[1] = 0;
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(levels.data()), sizeof(PageFileLevel) * levels.size());
+	std::vector<char> padding(size_t(DataOffset(header.level_count) - sizeof(header) - sizeof(PageFileLevel) * levels.size()), 0);
+	file.write(padding.data(), std::streamsize(padding.size()));
+
+	int padded = tile_size + 2 * border;
+	std::vector<unsigned char> tile(size_t(padded) * padded * 4);
+	for (size_t level = 0; level < levels.size(); ++level)
+	{
+		const unsigned char* pixels = level == 0 ? rgba : mips[level - 1].pixels.data();
+		int level_width = int(levels[level].width);
+		int level_height = int(levels[level].height);
+
+		for (uint32_t tile_y = 0; tile_y < levels[level].tiles_y; ++tile_y)
+			for (uint32_t tile_x = 0; tile_x < levels[level].tiles_x; ++tile_x)
+			{
+				for (int y = 0; y < padded; ++y)
+				{
+					int source_y = std::min(std::max(int(tile_y) * tile_size + y - border, 0), level_height - 1);
+					for (int x = 0; x < padded; ++x)
+					{
+						int source_x = int(tile_x) * tile_size + x - border;
+						source_x = ((source_x % level_width) + level_width) % level_width;
+						std::memcpy(&tile[(size_t(y) * padded + x) * 4], pixels + (size_t(source_y) * level_width + source_x) * 4, 4);
+					}
+				}
+				file.write(reinterpret_cast<const char*>(tile.data()), std::streamsize(tile.size()));
+			}
+	}
+
+	return bool(file);
+}
+
+bool PageFileView::Parse(const unsigned char* data, size_t size)
+{
+	header = nullptr;
+	if (data == nullptr || size < sizeof(PageFileHeader))
+		return false;
+
+	const PageFileHeader* candidate = reinterpret_cast<const PageFileHeader*>(data);
+	if (std::memcmp(candidate->identifier, page_file_identifier, sizeof(page_file_identifier)) != 0 ||
+		candidate->level_count == 0 || candidate->level_count > 16 || candidate->tile_size == 0)
+		return false;
+
+	uint64_t data_offset = DataOffset(candidate->level_count);
+	if (size < data_offset)
+		return false;
+
+	header = candidate;
+	levels = reinterpret_cast<const PageFileLevel*>(data + sizeof(PageFileHeader));
+	tile_data = data + data_offset;
+
+	if (data_offset + TileCount() * TileBytes() > size)
+	{
+		header = nullptr;
+		return false;
+	}
+	return true;
+}
+
+size_t PageFileView::TileCount() const
+{
+	const PageFileLevel& last = levels[header->level_count - 1];
+	return size_t(last.first_tile + uint64_t(last.tiles_x) * last.tiles_y);
+}
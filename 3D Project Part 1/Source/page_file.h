@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+	Page File: a texture cut into fixed size RGBA8 tiles for virtual texturing, every mip
+	level down to the one that fits in a single tile. Each tile carries a border of
+	neighbouring texels so bilinear filtering works inside the physical cache. Texels
+	wrap horizontally (the Mars map is equirectangular) and clamp vertically. No GL.
+*/
+struct PageFileHeader
+{
+	unsigned char identifier[12];
+	uint32_t width;
+	uint32_t height;
+	uint32_t tile_size;
+	uint32_t border;
+	uint32_t level_count;
+	uint32_t reserved[2];
+};
+
+struct PageFileLevel
+{
+	uint32_t width;
+	uint32_t height;
+	uint32_t tiles_x;
+	uint32_t tiles_y;
+	/* Index of the level's first tile, tiles are stored row by row */
+	uint64_t first_tile;
+};
+
+/* Tiles the RGBA8 image and its mips, the tile size excludes the border */
+bool WritePageFile(const std::string& path, const unsigned char* rgba, int width, int height, int tile_size, int border);
+
+/* A parsed view over page file bytes, the bytes have to outlive it */
+class PageFileView
+{
+public:
+	bool Parse(const unsigned char* data, size_t size);
+
+	const PageFileHeader& Header() const { return *header; }
+	const PageFileLevel& Level(int level) const { return levels[level]; }
+	int LevelCount() const { return int(header->level_count); }
+
+	/* Width and height of a stored tile including both borders */
+	int PaddedTileSize() const { return int(header->tile_size + 2 * header->border); }
+	size_t TileBytes() const { return size_t(PaddedTileSize()) * PaddedTileSize() * 4; }
+	size_t TileCount() const;
+
+	uint64_t TileIndex(int level, int tile_x, int tile_y) const { return levels[level].first_tile + uint64_t(tile_y) * levels[level].tiles_x + tile_x; }
+	const unsigned char* TileData(uint64_t tile) const { return tile_data + tile * TileBytes(); }
+
+private:
+	const PageFileHeader* header = nullptr;
+	const PageFileLevel* levels = nullptr;
+	const unsigned char* tile_data = nullptr;
+};
@@ -0,0 +1,128 @@
+#include "program_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include "hash.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const uint32_t cache_magic = 0x4E494250; // "PBIN"
+static const uint32_t cache_version = 1;
+
+struct ProgramCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint32_t binary_format;
+	uint32_t binary_length;
+};
+
+static uint64_t HashString(const char* string, uint64_t seed)
+{
+	if (string == NULL)
+		return seed;
+	/* Hash the terminator too so "ab" + "c" and "a" + "bc" differ */
+	return HashBytes(string, strlen(string) + 1, seed);
+}
+
+/* Program Cache */
+ProgramCache::ProgramCache(const std::string& directory)
+	: enabled(false),
+	directory(directory),
+	driver_hash(0)
+{
+	if (!GLAD_GL_ARB_get_program_binary)
+		return;
+
+	GLint format_count = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+	if (format_count <= 0)
+		return;
+
+	driver_hash = HashString(reinterpret_cast<const char*>(glGetString(GL_VENDOR)), HashBytes(NULL, 0));
+	driver_hash = HashString(reinterpret_cast<const char*>(glGetString(GL_RENDERER)), driver_hash);
+	driver_hash = HashString(reinterpret_cast<const char*>(glGetString(GL_VERSION)), driver_hash);
+
+#ifdef _WIN32
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+	enabled = true;
+}
+
+uint64_t ProgramCache::Key(const std::string& vertex_source, const std::string& fragment_source) const
+{
+	uint64_t key = HashString(vertex_source.c_str(), driver_hash);
+	return HashString(fragment_source.c_str(), key);
+}
+
+std::string ProgramCache::PathFor(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+	return directory + "/" + name;
+}
+
+GLuint ProgramCache::Load(const std::string& vertex_source, const std::string& fragment_source)
+{
+	if (!enabled)
+		return 0;
+
+	uint64_t key = Key(vertex_source, fragment_source);
+	std::ifstream file(PathFor(key), std::ios::binary);
+	if (!file)
+		return 0;
+
+	ProgramCacheHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		header.magic != cache_magic || header.version != cache_version || header.key != key)
+		return 0;
+
+	std::vector<char> binary(header.binary_length);
+	if (!file.read(binary.data(), binary.size()))
+		return 0;
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.binary_format, binary.data(), GLsizei(binary.size()));
+
+	/* Drivers reject binaries after an update even when the version string is unchanged */
+	int success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+void ProgramCache::Store(GLuint program, const std::string& vertex_source, const std::string& fragment_source)
+{
+	if (!enabled || program == 0)
+		return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum binary_format = 0;
+	glGetProgramBinary(program, length, &length, &binary_format, binary.data());
+
+	ProgramCacheHeader header = { cache_magic, cache_version, Key(vertex_source, fragment_source), binary_format, uint32_t(length) };
+
+	std::ofstream file(PathFor(header.key), std::ios::binary | std::ios::trunc);
+	if (!file.write(reinterpret_cast<const char*>(&header), sizeof(header)) || !file.write(binary.data(), length))
+		std::cout << "Warning: Could not write program cache " << PathFor(header.key) << std::endl;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "GLAD/glad.h"
+
+/*
+	Program Cache: stores linked program binaries on disk, keyed by a hash of
+	the shader sources and the GL vendor, renderer and version strings.
+	Needs ARB_get_program_binary and at least one binary format, otherwise every
+	lookup misses and the caller compiles as usual.
+*/
+class ProgramCache
+{
+public:
+	/* Must be constructed with a current context */
+	explicit ProgramCache(const std::string& directory);
+
+	bool Enabled() const { return enabled; }
+
+	/* Linked program on a hit, 0 on a miss or when the driver rejects the binary */
+	GLuint Load(const std::string& vertex_source, const std::string& fragment_source);
+
+	void Store(GLuint program, const std::string& vertex_source, const std::string& fragment_source);
+
+private:
+	uint64_t Key(const std::string& vertex_source, const std::string& fragment_source) const;
+	std::string PathFor(uint64_t key) const;
+
+	bool enabled;
+	std::string directory;
+	uint64_t driver_hash;
+};
@@ -0,0 +1,171 @@
+#include "render_queue.h"
+
+#include <algorithm>
+#include "GLM/gtc/type_ptr.hpp"
+
+/* Sort Keys */
+uint64_t MakeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint mesh, float depth)
+{
+	depth = glm::clamp(depth, 0.f, 1.f);
+	uint64_t quantized_depth = uint64_t(depth * double(0xFFFFFF));
+
+	uint64_t key = uint64_t(pass & 0xF) << 60;
+	if (pass == RENDER_PASS_TRANSPARENT)
+	{
+		key |= (0xFFFFFF - quantized_depth) << 36;
+		key |= uint64_t(program & 0xFF) << 28;
+		key |= uint64_t(texture & 0xFFF) << 16;
+		key |= uint64_t(mesh & 0xFFF) << 4;
+	}
+	else
+	{
+		key |= uint64_t(program & 0xFF) << 52;
+		key |= uint64_t(texture & 0xFFF) << 40;
+		key |= uint64_t(mesh & 0xFFF) << 28;
+		key |= quantized_depth << 4;
+	}
+	return key;
+}
+
+/* Render Queue */
+RenderQueue::RenderQueue(size_t capacity)
+	: count(0),
+	items(capacity),
+	keys(capacity),
+	order(capacity),
+	scratch_keys(capacity),
+	scratch_order(capacity)
+{
+}
+
+void RenderQueue::Clear()
+{
+	count = 0;
+}
+
+bool RenderQueue::Submit(uint64_t key, const DrawItem& item)
+{
+	if (count == items.size())
+		return false;
+
+	items[count] = item;
+	keys[count] = key;
+	order[count] = uint32_t(count);
+	++count;
+	return true;
+}
+
+void RenderQueue::Sort()
+{
+	/* LSD radix sort over 8 bit digits, digits shared by every key are skipped */
+	uint64_t* source_keys = keys.data();
+	uint32_t* source_order = order.data();
+	uint64_t* target_keys = scratch_keys.data();
+	uint32_t* target_order = scratch_order.data();
+
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (size_t i = 0; i < count; ++i)
+			++histogram[(source_keys[i] >> shift) & 0xFF];
+
+		if (count == 0 || histogram[(source_keys[0] >> shift) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int digit = 0; digit < 256; ++digit)
+		{
+			size_t digit_count = histogram[digit];
+			histogram[digit] = offset;
+			offset += digit_count;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			size_t destination = histogram[(source_keys[i] >> shift) & 0xFF]++;
+			target_keys[destination] = source_keys[i];
+			target_order[destination] = source_order[i];
+		}
+
+		std::swap(source_keys, target_keys);
+		std::swap(source_order, target_order);
+	}
+
+	if (source_keys != keys.data())
+	{
+		std::copy(source_keys, source_keys + count, keys.data());
+		std::copy(source_order, source_order + count, order.data());
+	}
+}
+
+/* Fixed function state that differs between passes */
+static void ApplyPassState(RenderPass pass)
+{
+	if (pass == RENDER_PASS_TRANSPARENT)
+		glEnable(GL_BLEND);
+	else
+		glDisable(GL_BLEND);
+
+	bool writes = pass != RENDER_PASS_OCCLUSION_PROXY;
+	glColorMask(writes, writes, writes, writes);
+	glDepthMask(writes);
+}
+
+void RenderQueue::Execute()
+{
+	RenderPass current_pass = RENDER_PASS_COUNT;
+	GLuint current_program = 0;
+	GLuint current_texture = 0;
+	GLuint current_vao = 0;
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		const DrawItem& item = items[order[i]];
+
+		RenderPass pass = RenderPass(keys[i] >> 60);
+		if (pass != current_pass)
+		{
+			ApplyPassState(pass);
+			current_pass = pass;
+		}
+
+		if (item.program != current_program)
+		{
+			glUseProgram(item.program);
+			current_program = item.program;
+		}
+		if (item.texture != current_texture)
+		{
+			glBindTexture(item.texture_target, item.texture);
+			current_texture = item.texture;
+		}
+		if (item.vao != current_vao)
+		{
+			glBindVertexArray(item.vao);
+			current_vao = item.vao;
+		}
+
+		glUniformMatrix4fv(item.transform_location, 1, GL_FALSE, glm::value_ptr(item.transform));
+		if (item.layer_location != -1)
+			glUniform1i(item.layer_location, item.layer);
+		/* GL_QUERY_NO_WAIT draws anyway when the result is not in yet instead of stalling */
+		if (item.query_use == DRAW_QUERY_PROXY)
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, item.query);
+		else if (item.query_use == DRAW_QUERY_CONDITIONAL)
+			glBeginConditionalRender(item.query, GL_QUERY_NO_WAIT);
+
+		if (item.custom_draw)
+			item.custom_draw(item);
+		else
+			glDrawElements(GL_TRIANGLES, item.element_count, GL_UNSIGNED_INT, NULL);
+
+		if (item.query_use == DRAW_QUERY_PROXY)
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+		else if (item.query_use == DRAW_QUERY_CONDITIONAL)
+			glEndConditionalRender();
+	}
+
+	/* glClear respects the write masks, leave them on for the next frame */
+	if (current_pass == RENDER_PASS_OCCLUSION_PROXY)
+		ApplyPassState(RENDER_PASS_OPAQUE);
+}
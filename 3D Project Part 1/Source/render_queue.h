@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GLAD/glad.h"
+#include "GLM/glm.hpp"
+
+/*
+	Render passes, executed in this order. Occluders fill the depth buffer before the
+	occlusion proxies are tested against it, the proxy pass writes neither color nor
+	depth and only the transparent pass blends.
+*/
+enum RenderPass
+{
+	RENDER_PASS_OCCLUDER = 0,
+	RENDER_PASS_OCCLUSION_PROXY = 1,
+	RENDER_PASS_OPAQUE = 2,
+	RENDER_PASS_BACKGROUND = 3,
+	RENDER_PASS_TRANSPARENT = 4,
+	RENDER_PASS_COUNT
+};
+
+/* How a draw uses its query object */
+enum DrawQuery
+{
+	DRAW_QUERY_NONE = 0,
+	/* The draw runs inside a GL_ANY_SAMPLES_PASSED query */
+	DRAW_QUERY_PROXY,
+	/* The draw is skipped by the GPU when the query saw no samples */
+	DRAW_QUERY_CONDITIONAL,
+};
+
+/* Everything needed to issue one glDrawElements call */
+struct DrawItem
+{
+	GLuint program;
+	GLint transform_location;
+	GLuint texture;
+	GLuint vao;
+	GLsizei element_count;
+	glm::mat4 transform;
+
+	/* Array textures pick their layer with a uniform, -1 when the program has none */
+	GLenum texture_target = GL_TEXTURE_2D;
+	GLint layer_location = -1;
+	GLint layer = 0;
+
+	/* Replaces glDrawElements for instanced or indirect draws, state is bound before it runs */
+	void(*custom_draw)(const DrawItem& item) = nullptr;
+	const void* user_data = nullptr;
+
+	DrawQuery query_use = DRAW_QUERY_NONE;
+	GLuint query = 0;
+};
+
+/*
+	64 bit sort key, most significant bits first:
+	pass (4) | program (8) | texture (12) | mesh (12) | depth (24) | unused (4)
+	Transparent items move depth right after the pass and invert it so they sort back to front.
+	depth is the normalized view depth in [0, 1].
+*/
+uint64_t MakeSortKey(RenderPass pass, GLuint program, GLuint texture, GLuint mesh, float depth);
+
+/* Fixed capacity queue, all storage is allocated once in the constructor */
+class RenderQueue
+{
+public:
+	explicit RenderQueue(size_t capacity);
+
+	void Clear();
+	bool Submit(uint64_t key, const DrawItem& item);
+	void Sort();
+	void Execute();
+
+	size_t Size() const { return count; }
+	size_t Capacity() const { return items.size(); }
+
+private:
+	size_t count;
+	std::vector<DrawItem> items;
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> order;
+	std::vector<uint64_t> scratch_keys;
+	std::vector<uint32_t> scratch_order;
+};
@@ -0,0 +1,65 @@
+#include "shader_compiler.h"
+#include "opengl_utilities.h"
+
+/* Shader Compiler */
+ShaderCompiler::ShaderCompiler()
+{
+	/* 0xFFFFFFFF lets the driver pick the thread count */
+	if (GLAD_GL_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else if (GLAD_GL_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+}
+
+static GLuint SubmitShader(GLenum shader_type, const std::string& source)
+{
+	const GLchar* source_pointer = source.c_str();
+
+	GLuint shader = glCreateShader(shader_type);
+	glShaderSource(shader, 1, &source_pointer, NULL);
+	glCompileShader(shader);
+	return shader;
+}
+
+ShaderCompiler::Handle ShaderCompiler::Submit(const std::string& vertex_source, const std::string& fragment_source, bool retrievable_binary)
+{
+	Job job;
+	job.vertex_shader = SubmitShader(GL_VERTEX_SHADER, vertex_source);
+	job.fragment_shader = SubmitShader(GL_FRAGMENT_SHADER, fragment_source);
+	job.resolved = false;
+
+	/* Linking does not wait for the compiles, a failed compile shows up as a failed link */
+	job.program = glCreateProgram();
+	glAttachShader(job.program, job.vertex_shader);
+	glAttachShader(job.program, job.fragment_shader);
+	if (retrievable_binary && GLAD_GL_ARB_get_program_binary)
+		glProgramParameteri(job.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(job.program);
+
+	jobs.push_back(job);
+	return jobs.size() - 1;
+}
+
+GLuint ShaderCompiler::Resolve(Handle handle)
+{
+	Job& job = jobs[handle];
+	if (job.resolved)
+		return job.program;
+	job.resolved = true;
+
+	bool compiled = CheckShaderCompileStatus(job.vertex_shader);
+	compiled = CheckShaderCompileStatus(job.fragment_shader) && compiled;
+
+	glDetachShader(job.program, job.vertex_shader);
+	glDetachShader(job.program, job.fragment_shader);
+	glDeleteShader(job.vertex_shader);
+	glDeleteShader(job.fragment_shader);
+
+	if (!compiled || !CheckProgramLinkStatus(job.program))
+	{
+		glDeleteProgram(job.program);
+		job.program = 0;
+	}
+
+	return job.program;
+}
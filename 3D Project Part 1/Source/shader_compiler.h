@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "GLAD/glad.h"
+
+/*
+	Shader Compiler: issues every compile and link immediately but only queries
+	their status once the program is needed, so the driver can work on all of them
+	at once. With KHR/ARB_parallel_shader_compile the work runs on driver threads.
+*/
+class ShaderCompiler
+{
+public:
+	typedef size_t Handle;
+
+	/* Must be constructed with a current context */
+	ShaderCompiler();
+
+	Handle Submit(const std::string& vertex_source, const std::string& fragment_source, bool retrievable_binary = false);
+
+	/* Waits if needed, logs like CreateProgramFromSources and returns 0 on failure */
+	GLuint Resolve(Handle handle);
+
+private:
+	struct Job
+	{
+		GLuint vertex_shader;
+		GLuint fragment_shader;
+		GLuint program;
+		bool resolved;
+	};
+
+	std::vector<Job> jobs;
+};
@@ -0,0 +1,124 @@
+#include "shader_permutations.h"
+
+#include <iostream>
+#include "startup_report.h"
+
+static const struct
+{
+	ShaderFeature feature;
+	const char* define;
+} feature_defines[] =
+{
+	{ SHADER_FEATURE_ALPHA_TEST, "ALPHA_TEST" },
+	{ SHADER_FEATURE_LIGHTING, "LIGHTING" },
+	{ SHADER_FEATURE_INSTANCING, "INSTANCING" },
+	{ SHADER_FEATURE_TEXTURE_ARRAY, "TEXTURE_ARRAY" },
+	{ SHADER_FEATURE_VIRTUAL_TEXTURE, "VIRTUAL_TEXTURE" },
+	{ SHADER_FEATURE_CUBE_MAP, "CUBE_MAP" },
+};
+
+GLenum MaterialTextureTarget(const Material& material)
+{
+	if (material.features & SHADER_FEATURE_TEXTURE_ARRAY)
+		return GL_TEXTURE_2D_ARRAY;
+	if (material.features & SHADER_FEATURE_CUBE_MAP)
+		return GL_TEXTURE_CUBE_MAP;
+	return GL_TEXTURE_2D;
+}
+
+std::string InjectFeatureDefines(const std::string& source, unsigned features)
+{
+	std::string defines;
+	for (const auto& entry : feature_defines)
+		if (features & entry.feature)
+			defines += std::string("#define ") + entry.define + "\n";
+
+	/* #version has to stay the first statement of the shader */
+	size_t version = source.find("#version");
+	size_t insert_at = version == std::string::npos ? 0 : source.find('\n', version);
+	if (insert_at == std::string::npos)
+		return source + "\n" + defines;
+	if (version != std::string::npos)
+		++insert_at;
+
+	return source.substr(0, insert_at) + defines + source.substr(insert_at);
+}
+
+/* Shader Permutations */
+ShaderPermutations::ShaderPermutations(ShaderCompiler& compiler, const std::string& name, const GLchar * vertex_shader_source, const GLchar * fragment_shader_source)
+	: name(name),
+	vertex_source(vertex_shader_source),
+	fragment_source(fragment_shader_source),
+	compiler(compiler),
+	program_cache(nullptr)
+{
+}
+
+void ShaderPermutations::Prepare(unsigned features)
+{
+	if (variants.count(features))
+		return;
+
+	Variant& variant = variants[features];
+	variant.program.id = 0;
+	variant.program.features = features;
+	variant.vertex_source = InjectFeatureDefines(vertex_source, features);
+	variant.fragment_source = InjectFeatureDefines(fragment_source, features);
+
+	variant.program.id = program_cache ? program_cache->Load(variant.vertex_source, variant.fragment_source) : 0;
+	if (variant.program.id != 0)
+	{
+		RecordStartupTiming("shader cache", name + " variant " + std::to_string(features), variant.timer.ElapsedMilliseconds());
+		Finish(variant);
+		return;
+	}
+
+	variant.handle = compiler.Submit(variant.vertex_source, variant.fragment_source, program_cache != nullptr);
+	variant.pending = true;
+}
+
+const ShaderProgram* ShaderPermutations::Get(unsigned features)
+{
+	Prepare(features);
+
+	Variant& variant = variants[features];
+	if (variant.pending)
+	{
+		variant.pending = false;
+		variant.program.id = compiler.Resolve(variant.handle);
+
+		/* Covers submit to resolve, other variants compile in the meantime */
+		RecordStartupTiming("shader compile", name + " variant " + std::to_string(features), variant.timer.ElapsedMilliseconds());
+
+		if (variant.program.id == 0)
+			std::cout << "Error: Shader variant " << name << " " << features << " is unavailable" << std::endl;
+		else
+		{
+			if (program_cache)
+				program_cache->Store(variant.program.id, variant.vertex_source, variant.fragment_source);
+			Finish(variant);
+		}
+	}
+
+	/* Failed variants stay in the map so they are not recompiled every lookup */
+	return variant.program.id == 0 ? nullptr : &variant.program;
+}
+
+void ShaderPermutations::Finish(Variant& variant)
+{
+	variant.vertex_source.clear();
+	variant.fragment_source.clear();
+
+	variant.program.transform_location = glGetUniformLocation(variant.program.id, "u_transform");
+	variant.program.texture_location = glGetUniformLocation(variant.program.id, "u_texture");
+	variant.program.layer_location = glGetUniformLocation(variant.program.id, "u_layer");
+
+	glUseProgram(variant.program.id);
+	glUniform1i(variant.program.texture_location, 0);
+}
+
+bool ShaderPermutations::Bind(Material& material)
+{
+	material.program = Get(material.features);
+	return material.program != nullptr;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "GLAD/glad.h"
+#include "program_cache.h"
+#include "render_queue.h"
+#include "shader_compiler.h"
+#include "startup_report.h"
+
+/* Shader features, each one becomes a #define in the compiled variant */
+enum ShaderFeature
+{
+	SHADER_FEATURE_ALPHA_TEST = 1 << 0,
+	SHADER_FEATURE_LIGHTING = 1 << 1,
+	SHADER_FEATURE_INSTANCING = 1 << 2,
+	/* u_texture is a sampler2DArray indexed by u_layer */
+	SHADER_FEATURE_TEXTURE_ARRAY = 1 << 3,
+	/* u_texture is a virtual texture cache addressed through u_indirection, see virtual_texture.h */
+	SHADER_FEATURE_VIRTUAL_TEXTURE = 1 << 4,
+	/* u_texture is a samplerCube looked up by the object space position, for spheres */
+	SHADER_FEATURE_CUBE_MAP = 1 << 5,
+};
+
+/* A linked variant and the uniform locations the renderer needs */
+struct ShaderProgram
+{
+	GLuint id;
+	unsigned features;
+	GLint transform_location;
+	GLint texture_location;
+	GLint layer_location;
+};
+
+/* What to draw a surface with, the variant is the cheapest one covering the features */
+struct Material
+{
+	GLuint texture;
+	/* Only used with SHADER_FEATURE_TEXTURE_ARRAY */
+	GLint layer;
+	unsigned features;
+	RenderPass pass;
+	const ShaderProgram* program;
+};
+
+/* GL_TEXTURE_2D_ARRAY or GL_TEXTURE_CUBE_MAP for materials using those features, GL_TEXTURE_2D otherwise */
+GLenum MaterialTextureTarget(const Material& material);
+
+/* Returns the source with one #define per feature inserted after the #version line */
+std::string InjectFeatureDefines(const std::string& source, unsigned features);
+
+/*
+	Variants of one vertex/fragment source pair, cached by feature mask.
+	Prepare submits a variant without waiting for it, Get waits for it on first use.
+*/
+class ShaderPermutations
+{
+public:
+	ShaderPermutations(ShaderCompiler& compiler, const std::string& name, const GLchar * vertex_shader_source, const GLchar * fragment_shader_source);
+
+	/* Variants are looked up in the cache before compiling, and stored after */
+	void UseCache(ProgramCache* cache) { program_cache = cache; }
+
+	void Prepare(unsigned features);
+
+	/* NULL if the variant failed to compile or link */
+	const ShaderProgram* Get(unsigned features);
+
+	/* Fills in the program for a material, false if its variant is unavailable */
+	bool Bind(Material& material);
+
+private:
+	struct Variant
+	{
+		ShaderProgram program;
+		std::string vertex_source;
+		std::string fragment_source;
+		ShaderCompiler::Handle handle = 0;
+		bool pending = false;
+		StartupTimer timer;
+	};
+
+	void Finish(Variant& variant);
+
+	std::string name;
+	std::string vertex_source;
+	std::string fragment_source;
+	ShaderCompiler& compiler;
+	ProgramCache* program_cache;
+	std::map<unsigned, Variant> variants;
+};
@@ -0,0 +1,473 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include "GLM/gtx/transform.hpp"
+#include "hash.h"
+#include "job_system.h"
+#include "swept_collision.h"
+
+/* Degrees per tick at the default tick rate */
+static const float player_speed = 2.0f;
+static const float circling_speed = 0.5f;
+/* Wheel turn per unit of driving or turning */
+static const float wheel_spin_per_drive = 25.0f / 60.0f;
+/* Fraction of the angle to the player the chaser turns per tick */
+static const float chase_rate = 0.001f;
+/* Free camera units per tick */
+static const float camera_speed = 0.01f;
+/* Rovers per job, smaller chunks cost more in queueing than they gain */
+static const size_t rover_grain = 2048;
+
+/* Scoped time of one system, added to the total on destruction */
+class SystemTimer
+{
+public:
+	explicit SystemTimer(double* total)
+		: total(total)
+	{
+		if (total)
+			start = std::chrono::steady_clock::now();
+	}
+
+	~SystemTimer()
+	{
+		if (total)
+			*total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	double* total;
+	std::chrono::steady_clock::time_point start;
+};
+
+/* Runs body(begin, end) over every rover, in parallel chunks when there is a job system */
+template <typename Body>
+static void ForEachRover(JobSystem* jobs, const char* name, size_t count, const Body& body)
+{
+	if (jobs)
+		jobs->ParallelFor(name, count, rover_grain, body);
+	else
+		body(0, count);
+}
+
+/* Rover Store */
+void RoverStore::Resize(size_t count)
+{
+	behavior.resize(count);
+	orientation.resize(count);
+	previous_orientation.resize(count);
+	local_x.resize(count);
+	local_y.resize(count);
+	local_z.resize(count);
+	position_x.resize(count);
+	position_y.resize(count);
+	position_z.resize(count);
+	drive_rate.resize(count);
+	turn_rate.resize(count);
+	wheel_angle.resize(count);
+	colliding.resize(count);
+}
+
+/* Rovers all track points at the same distance from the center of Mars */
+static float RoverRadius()
+{
+	return Simulation::MarsTransform()[0][0] * glm::length(Simulation::RoverLocalPoint(ROVER_PLAYER));
+}
+
+/* Boxes overlap when every axis is within two half sizes, so their centers are at most this far apart */
+static float CollisionReach()
+{
+	return 2.0f * Simulation::CollisionHalfSize() * std::sqrt(3.0f);
+}
+
+/* Orientation integration */
+void IntegrateOrientations(glm::quat* orientation, const float* drive_rate, const float* turn_rate, float rate_scale, size_t count)
+{
+	/* Most rovers share a rate, the step is only rebuilt when it changes */
+	float cached_drive = 0.0f, cached_turn = 0.0f;
+	glm::quat step(1, 0, 0, 0);
+
+	for (size_t i = 0; i < count; ++i)
+	{
+		float drive = drive_rate[i] * rate_scale;
+		float turn = turn_rate[i] * rate_scale;
+		if (drive != cached_drive || turn != cached_turn)
+		{
+			cached_drive = drive;
+			cached_turn = turn;
+			step = glm::angleAxis(drive, glm::vec3(0, 0, 1)) * glm::angleAxis(turn, glm::vec3(0, 1, 0));
+		}
+		orientation[i] = orientation[i] * step;
+	}
+}
+
+void NormalizeOrientations(glm::quat* orientation, size_t count)
+{
+	/* Close to unit length 1 / sqrt(n) is (3 - n) / 2 to first order */
+	for (size_t i = 0; i < count; ++i)
+	{
+		glm::quat& q = orientation[i];
+		float correction = 0.5f * (3.0f - (q.w * q.w + q.x * q.x + q.y * q.y + q.z * q.z));
+		q.w *= correction;
+		q.x *= correction;
+		q.y *= correction;
+		q.z *= correction;
+	}
+}
+
+/* Simulation */
+Simulation::Simulation(int rover_count, int tick_rate, bool continuous_collision)
+	: jobs(nullptr),
+	tick_rate(tick_rate > 0 ? tick_rate : default_tick_rate),
+	step_scale(float(default_tick_rate) / float(this->tick_rate)),
+	continuous_collision(continuous_collision),
+	stop_on_collision(true),
+	contact_time(1.0f),
+	grid(CubeSphereGrid::ResolutionFor(RoverRadius(), CollisionReach()), RoverRadius(), CollisionReach()),
+	collision_stats(),
+	camera(0.0f, 0.0f, -3.0f),
+	previous_camera(camera),
+	collision(false),
+	tick_count(0)
+{
+	rovers.Resize(rover_count < 3 ? 3 : size_t(rover_count));
+	for (size_t i = 0; i < rovers.Size(); ++i)
+	{
+		RoverBehavior behavior = i == 0 ? ROVER_PLAYER : i == 2 ? ROVER_CHASER : ROVER_CIRCLING;
+		rovers.behavior[i] = behavior;
+
+		/* Extra rovers start spread evenly over the planet, placed by a 2D low discrepancy sequence (R2), with varied headings */
+		glm::quat orientation(1, 0, 0, 0);
+		if (i >= 3)
+		{
+			double u = double(i) * 0.7548776662, v = double(i) * 0.5698402910;
+			float longitude = float(6.283185307 * (u - std::floor(u)));
+			float latitude = float(std::asin(2.0 * (v - std::floor(v)) - 1.0));
+			orientation = glm::angleAxis(longitude, glm::vec3(0, 1, 0)) * glm::angleAxis(latitude, glm::vec3(0, 0, 1)) * glm::angleAxis(float(i) * 0.7f, glm::vec3(1, 0, 0));
+		}
+		rovers.orientation[i] = orientation;
+		rovers.previous_orientation[i] = orientation;
+
+		glm::vec3 local = RoverLocalPoint(behavior);
+		rovers.local_x[i] = local.x;
+		rovers.local_y[i] = local.y;
+		rovers.local_z[i] = local.z;
+
+		rovers.drive_rate[i] = behavior == ROVER_CIRCLING ? glm::radians(circling_speed) * step_scale : 0.0f;
+		rovers.turn_rate[i] = 0.0f;
+		rovers.wheel_angle[i] = 0.0f;
+		rovers.colliding[i] = 0;
+	}
+	UpdatePositions();
+}
+
+glm::mat4 Simulation::MarsTransform()
+{
+	return glm::scale(glm::vec3(0.7));
+}
+
+glm::mat4 Simulation::RoverBase(RoverBehavior behavior)
+{
+	switch (behavior)
+	{
+	case ROVER_PLAYER:
+		return glm::translate(glm::vec3(1.05, 0, 0)) * glm::scale(glm::vec3(0.08));
+	case ROVER_CHASER:
+		return glm::translate(glm::vec3(0, 0, -1.05)) * glm::scale(glm::vec3(0.08));
+	default:
+		return glm::translate(glm::vec3(-1.05, 0, 0)) * glm::scale(glm::vec3(0.08));
+	}
+}
+
+glm::vec3 Simulation::RoverLocalPoint(RoverBehavior behavior)
+{
+	/* The rover space point the game always tracked, 1.05 out along the base direction */
+	switch (behavior)
+	{
+	case ROVER_PLAYER:
+		return glm::vec3(RoverBase(behavior) * glm::vec4(1.05, 0, 0, 1));
+	case ROVER_CHASER:
+		return glm::vec3(RoverBase(behavior) * glm::vec4(0, 0, -1.05, 1));
+	default:
+		return glm::vec3(RoverBase(behavior) * glm::vec4(-1.05, 0, 0, 1));
+	}
+}
+
+float Simulation::CollisionHalfSize()
+{
+	return 0.055f;
+}
+
+void Simulation::Tick(const SimulationInput& input, SimulationTimings* timings)
+{
+	rovers.previous_orientation = rovers.orientation;
+	previous_camera = camera;
+
+	{
+		SystemTimer timer(timings ? &timings->movement : nullptr);
+		ApplyInput(input);
+		Integrate();
+	}
+	{
+		SystemTimer timer(timings ? &timings->chase : nullptr);
+		Chase();
+	}
+	{
+		SystemTimer timer(timings ? &timings->movement : nullptr);
+		UpdatePositions();
+	}
+	{
+		SystemTimer timer(timings ? &timings->camera : nullptr);
+		MoveCamera(input);
+	}
+	{
+		SystemTimer timer(timings ? &timings->collision : nullptr);
+		CheckCollisions();
+	}
+	++tick_count;
+}
+
+uint64_t Simulation::StateHash() const
+{
+	uint64_t hash = HashBytes(nullptr, 0);
+	auto add = [&hash](const void* data, size_t size)
+	{
+		hash = HashBytes(data, size, hash);
+	};
+
+	size_t count = rovers.Size();
+	add(rovers.orientation.data(), sizeof(glm::quat) * count);
+	add(rovers.position_x.data(), sizeof(float) * count);
+	add(rovers.position_y.data(), sizeof(float) * count);
+	add(rovers.position_z.data(), sizeof(float) * count);
+	add(&camera, sizeof(camera));
+	unsigned char flag = collision ? 1 : 0;
+	add(&flag, sizeof(flag));
+	add(&tick_count, sizeof(tick_count));
+	return hash;
+}
+
+void Simulation::ApplyInput(const SimulationInput& input)
+{
+	float drive = 0.0f, turn = 0.0f;
+	if (input.held)
+	{
+		float speed = glm::radians(player_speed) * step_scale;
+		if (input.key == SIM_KEY_FORWARD)
+			drive = speed;
+		else if (input.key == SIM_KEY_BACK)
+			drive = -speed;
+		else if (input.key == SIM_KEY_LEFT)
+			turn = speed;
+		else if (input.key == SIM_KEY_RIGHT)
+			turn = -speed;
+	}
+
+	for (size_t i = 0; i < rovers.Size(); ++i)
+	{
+		if (rovers.behavior[i] == ROVER_PLAYER)
+		{
+			rovers.drive_rate[i] = drive;
+			rovers.turn_rate[i] = turn;
+		}
+	}
+}
+
+void Simulation::Integrate()
+{
+	/* Stopped rovers turn by an identity rotation, which leaves them exactly where they were */
+	float moving = Stopped() ? 0.0f : 1.0f;
+	bool normalize = (tick_count + 1) % normalize_interval == 0;
+	ForEachRover(jobs, "integrate", rovers.Size(), [&](size_t begin, size_t end)
+	{
+		IntegrateOrientations(rovers.orientation.data() + begin, rovers.drive_rate.data() + begin, rovers.turn_rate.data() + begin, moving, end - begin);
+		if (normalize)
+			NormalizeOrientations(rovers.orientation.data() + begin, end - begin);
+
+		for (size_t i = begin; i < end; ++i)
+			rovers.wheel_angle[i] += (rovers.drive_rate[i] + std::fabs(rovers.turn_rate[i])) * moving * wheel_spin_per_drive;
+	});
+}
+
+void Simulation::Chase()
+{
+	if (Stopped())
+		return;
+
+	/* Turns about the world axes by a small part of the player's angles, not toward the chaser's own position */
+	glm::vec3 target = MarsTransform()[0][0] * (rovers.orientation[0] * RoverLocalPoint(ROVER_PLAYER));
+	float y_angle = std::atan2(target.z, target.y);
+	float z_angle = std::atan2(target.x, target.z);
+	float rate = chase_rate * step_scale;
+	glm::quat rotation = glm::angleAxis(z_angle * rate, glm::vec3(0, 1, 0)) * glm::angleAxis(y_angle * rate, glm::vec3(0, 0, 1));
+
+	ForEachRover(jobs, "chase", rovers.Size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (rovers.behavior[i] == ROVER_CHASER)
+				rovers.orientation[i] = rovers.orientation[i] * rotation;
+		}
+	});
+}
+
+void Simulation::UpdatePositions()
+{
+	const float scale = MarsTransform()[0][0];
+	const glm::quat* orientation = rovers.orientation.data();
+	const float* local_x = rovers.local_x.data();
+	const float* local_y = rovers.local_y.data();
+	const float* local_z = rovers.local_z.data();
+	float* position_x = rovers.position_x.data();
+	float* position_y = rovers.position_y.data();
+	float* position_z = rovers.position_z.data();
+
+	/* v + w t + q x t with t = 2 q x v, q being the vector part */
+	ForEachRover(jobs, "positions", rovers.Size(), [=](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			const glm::quat& q = orientation[i];
+			float tx = 2.0f * (q.y * local_z[i] - q.z * local_y[i]);
+			float ty = 2.0f * (q.z * local_x[i] - q.x * local_z[i]);
+			float tz = 2.0f * (q.x * local_y[i] - q.y * local_x[i]);
+			position_x[i] = scale * (local_x[i] + q.w * tx + q.y * tz - q.z * ty);
+			position_y[i] = scale * (local_y[i] + q.w * ty + q.z * tx - q.x * tz);
+			position_z[i] = scale * (local_z[i] + q.w * tz + q.x * ty - q.y * tx);
+		}
+	});
+}
+
+void Simulation::MoveCamera(const SimulationInput& input)
+{
+	if (input.rover_cam || !input.held)
+		return;
+
+	float step = camera_speed * step_scale;
+	switch (input.key)
+	{
+	case SIM_KEY_CAMERA_RIGHT:
+		camera.x += step;
+		break;
+	case SIM_KEY_CAMERA_LEFT:
+		camera.x -= step;
+		break;
+	case SIM_KEY_CAMERA_FORWARD:
+		camera.z += step;
+		break;
+	case SIM_KEY_CAMERA_BACK:
+		camera.z -= step;
+		break;
+	case SIM_KEY_CAMERA_UP:
+		camera.y += step;
+		break;
+	case SIM_KEY_CAMERA_DOWN:
+		camera.y -= step;
+		break;
+	default:
+		break;
+	}
+}
+
+void Simulation::CheckCollisions()
+{
+	/* Rovers stand still once they collide, so only a tick that started apart can have swept through a contact */
+	bool moved = !Stopped();
+	FindOverlaps();
+	contact_time = 1.0f;
+	if (continuous_collision && moved)
+		SweepCollisions();
+}
+
+void Simulation::FindOverlaps()
+{
+	/* Axis aligned boxes of the same size around every position, they overlap when every axis is within two half sizes */
+	grid.Update(rovers.position_x.data(), rovers.position_y.data(), rovers.position_z.data(), rovers.Size(), jobs);
+	collision_stats = grid.Overlaps(2.0f * CollisionHalfSize(), rovers.colliding.data(), jobs);
+	collision = rovers.colliding[0] != 0;
+}
+
+void Simulation::SweepCollisions()
+{
+	/*
+		Spheres of one half size around both positions touch at two half sizes, where the
+		boxes overlap as well. A rover turning by angle covers at most pi * sin(angle / 2)
+		times its radius, which bounds it without an inverse cosine, so most rovers are
+		ruled out from their end positions alone.
+	*/
+	const float reach = 2.0f * CollisionHalfSize();
+	const float scale = MarsTransform()[0][0];
+	const float radius = RoverRadius();
+	const float pi = 3.14159265f;
+
+	ArcMotion player = ArcMotion::Between(rovers.previous_orientation[0], rovers.orientation[0], RoverLocalPoint(ROVER_PLAYER), scale);
+	glm::vec3 player_end = rovers.Position(0);
+	float player_travel = player.Speed();
+
+	/* The earliest contact, the lowest rover among equal times, whatever order the chunks finish in */
+	float first_contact = 2.0f;
+	size_t first_rover = 0;
+	std::mutex first_mutex;
+	ForEachRover(jobs, "sweep", rovers.Size(), [&](size_t begin, size_t end)
+	{
+		float chunk_contact = 2.0f;
+		size_t chunk_rover = 0;
+		for (size_t i = std::max<size_t>(begin, 1); i < end; ++i)
+		{
+			const glm::quat& from = rovers.previous_orientation[i];
+			const glm::quat& to = rovers.orientation[i];
+			float cosine = from.w * to.w + from.x * to.x + from.y * to.y + from.z * to.z;
+			float travel = pi * radius * std::sqrt(std::max(0.0f, 1.0f - cosine * cosine));
+			float dx = rovers.position_x[i] - player_end.x;
+			float dy = rovers.position_y[i] - player_end.y;
+			float dz = rovers.position_z[i] - player_end.z;
+			float range = reach + player_travel + travel;
+			if (dx * dx + dy * dy + dz * dz > range * range)
+				continue;
+
+			glm::vec3 local(rovers.local_x[i], rovers.local_y[i], rovers.local_z[i]);
+			float t = TimeOfImpact(player, ArcMotion::Between(from, to, local, scale), reach);
+			if (t >= 0.0f && t < chunk_contact)
+			{
+				chunk_contact = t;
+				chunk_rover = i;
+			}
+		}
+		if (chunk_rover == 0)
+			return;
+		std::lock_guard<std::mutex> lock(first_mutex);
+		if (chunk_contact < first_contact || (chunk_contact == first_contact && chunk_rover < first_rover))
+		{
+			first_contact = chunk_contact;
+			first_rover = chunk_rover;
+		}
+	});
+	if (first_rover == 0 || (collision && first_contact >= 1.0f))
+		return;
+
+	/* Without the stop the contact is only reported, the rovers go on */
+	if (!stop_on_collision)
+	{
+		rovers.colliding[0] = 1;
+		rovers.colliding[first_rover] = 1;
+		collision = true;
+		contact_time = first_contact;
+		return;
+	}
+
+	/* Every rover back to the moment of contact, all of them stop there */
+	ForEachRover(jobs, "rewind", rovers.Size(), [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+			rovers.orientation[i] = glm::slerp(rovers.previous_orientation[i], rovers.orientation[i], first_contact);
+	});
+	UpdatePositions();
+	FindOverlaps();
+	rovers.colliding[0] = 1;
+	rovers.colliding[first_rover] = 1;
+	collision = true;
+	contact_time = first_contact;
+}
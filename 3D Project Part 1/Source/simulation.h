@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "GLM/glm.hpp"
+#include "GLM/gtc/quaternion.hpp"
+#include "broadphase.h"
+
+class JobSystem;
+
+/* The key of the last key event, mapped from GLFW by the game */
+enum SimulationKey
+{
+	SIM_KEY_NONE,
+	SIM_KEY_FORWARD,
+	SIM_KEY_BACK,
+	SIM_KEY_LEFT,
+	SIM_KEY_RIGHT,
+	SIM_KEY_CAMERA_RIGHT,
+	SIM_KEY_CAMERA_LEFT,
+	SIM_KEY_CAMERA_FORWARD,
+	SIM_KEY_CAMERA_BACK,
+	SIM_KEY_CAMERA_UP,
+	SIM_KEY_CAMERA_DOWN,
+};
+
+/* Everything the simulation reads from the player in one tick */
+struct SimulationInput
+{
+	SimulationKey key = SIM_KEY_NONE;
+	/* False once the key is released */
+	bool held = false;
+	/* The free camera only moves while the rover camera is off */
+	bool rover_cam = false;
+};
+
+/* Milliseconds spent per system, summed over ticks */
+struct SimulationTimings
+{
+	double movement = 0;
+	double chase = 0;
+	double camera = 0;
+	double collision = 0;
+};
+
+/* What moves a rover */
+enum RoverBehavior : uint8_t
+{
+	/* Drives and turns with the input */
+	ROVER_PLAYER,
+	/* Drives around Mars at a constant rate */
+	ROVER_CIRCLING,
+	/* Turns after the player */
+	ROVER_CHASER,
+};
+
+/*
+	Rover Store: the state of every rover, one array per field, indexed by rover. Each
+	system walks only the arrays it needs, front to back. The float loops have no
+	dependencies between rovers, so the compiler can vectorize them.
+*/
+struct RoverStore
+{
+	size_t Size() const { return behavior.size(); }
+	void Resize(size_t count);
+
+	glm::vec3 Position(size_t rover) const { return glm::vec3(position_x[rover], position_y[rover], position_z[rover]); }
+
+	std::vector<uint8_t> behavior;
+	/* Unit quaternion about the center of Mars, and the one of the tick before for rendering */
+	std::vector<glm::quat> orientation;
+	std::vector<glm::quat> previous_orientation;
+	/* The rover's point before its orientation, see Simulation::RoverLocalPoint */
+	std::vector<float> local_x, local_y, local_z;
+	/* World position of the latest tick, used for the chase and collisions */
+	std::vector<float> position_x, position_y, position_z;
+	/* Radians per tick about the rover's own z axis (driving) and y axis (turning) */
+	std::vector<float> drive_rate;
+	std::vector<float> turn_rate;
+	/* Radians, follows driving, only for show */
+	std::vector<float> wheel_angle;
+	/* 1 when the rover's box overlaps any other rover's box */
+	std::vector<uint8_t> colliding;
+};
+
+/*
+	Turns every orientation by its rover's drive and turn rates, times rate_scale, as
+	q = q * drive * turn. A rate of 0 multiplies by the identity, which is exact.
+*/
+void IntegrateOrientations(glm::quat* orientation, const float* drive_rate, const float* turn_rate, float rate_scale, size_t count);
+
+/* Pulls every orientation back to unit length, one Newton step, no square root */
+void NormalizeOrientations(glm::quat* orientation, size_t count);
+
+/*
+	Simulation: the game logic, advanced one fixed tick at a time. No GL and no window.
+	- Rover 0 is the player, rover 1 circles Mars, rover 2 chases rover 0. Further
+	  rovers circle Mars on their own great circles.
+	- Speeds are per tick at 60 ticks a second, other tick rates scale them so rovers
+	  cover the same ground per second in fewer, larger steps.
+	- The collision flag is set when the player's box overlaps any other rover's box and
+	  stops every rover for good, the player included, so the overlap never clears.
+	  Overlaps are found for every rover, a cube sphere grid picks the pairs to test.
+	- A stopped world costs less per tick, the chase and the sweep are skipped and no
+	  rover changes cell. Benchmarks turn the stop off, collisions are then found and
+	  reported every tick but nothing stops.
+	- With continuous collision the player is also swept against every rover along the
+	  arcs both turned through during the tick. A contact anywhere on the way stops the
+	  rovers where it happened, so large steps can not pass through a rover.
+	- Orientations are quaternions, renormalized every few ticks so rounding can not
+	  build up over long sessions. The renderer converts them to matrices.
+	- With a job system the per rover loops and the broadphase run in parallel chunks.
+	  Every rover is computed the same way either way, so the state is bit identical
+	  for any thread count.
+*/
+class Simulation
+{
+public:
+	/* Ticks between renormalizations of the orientations */
+	static const unsigned normalize_interval = 64;
+
+	/* The tick rate the speeds are given for */
+	static const int default_tick_rate = 60;
+
+	/* At least 3 rovers */
+	explicit Simulation(int rover_count, int tick_rate = default_tick_rate, bool continuous_collision = false);
+
+	/* Before the first tick, a replay takes it from the recording */
+	void SetContinuousCollision(bool continuous) { continuous_collision = continuous; }
+
+	/* On by default, off keeps every rover moving through collisions */
+	void SetStopOnCollision(bool stop) { stop_on_collision = stop; }
+	bool StopOnCollision() const { return stop_on_collision; }
+
+	/* NULL runs every system on the calling thread, the job system has to outlive the simulation */
+	void SetJobSystem(JobSystem* jobs) { this->jobs = jobs; }
+
+	/* timings may be NULL, timing every system costs a few clock reads per tick */
+	void Tick(const SimulationInput& input, SimulationTimings* timings = nullptr);
+
+	int RoverCount() const { return int(rovers.Size()); }
+	int TickRate() const { return tick_rate; }
+	bool ContinuousCollision() const { return continuous_collision; }
+	const RoverStore& Rovers() const { return rovers; }
+
+	const glm::vec3& Camera() const { return camera; }
+	const glm::vec3& PreviousCamera() const { return previous_camera; }
+
+	bool Collision() const { return collision; }
+	const BroadphaseStats& CollisionStats() const { return collision_stats; }
+	/* Fraction of the last tick at which the collision began, 1 when it was only found at the end of the tick */
+	float ContactTime() const { return contact_time; }
+	unsigned long long TickCount() const { return tick_count; }
+
+	/* FNV-1a over the exact bits of every rover, the camera, the collision flag and the tick count */
+	uint64_t StateHash() const;
+
+	/* The scale of Mars, rover positions are in the scaled space */
+	static glm::mat4 MarsTransform();
+	/* Places the rover model outside Mars, before the orientation */
+	static glm::mat4 RoverBase(RoverBehavior behavior);
+	/* The point of the base transformed rover whose world position is the rover position */
+	static glm::vec3 RoverLocalPoint(RoverBehavior behavior);
+	/* Half size of the collision box around every rover position */
+	static float CollisionHalfSize();
+
+private:
+	/* True while the collision stops the rovers */
+	bool Stopped() const { return collision && stop_on_collision; }
+	void ApplyInput(const SimulationInput& input);
+	void Integrate();
+	void Chase();
+	void UpdatePositions();
+	void MoveCamera(const SimulationInput& input);
+	void CheckCollisions();
+	void FindOverlaps();
+	void SweepCollisions();
+
+	JobSystem* jobs;
+	int tick_rate;
+	/* Speeds given per tick at the default tick rate are multiplied by this */
+	float step_scale;
+	bool continuous_collision;
+	bool stop_on_collision;
+	float contact_time;
+	RoverStore rovers;
+	CubeSphereGrid grid;
+	BroadphaseStats collision_stats;
+	glm::vec3 camera;
+	glm::vec3 previous_camera;
+	bool collision;
+	unsigned long long tick_count;
+};
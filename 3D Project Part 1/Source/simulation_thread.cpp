@@ -0,0 +1,107 @@
+#include "simulation_thread.h"
+
+#include <algorithm>
+#include "frame_clock.h"
+
+/* Like the single threaded loop, a longer stall slows the simulation down */
+static const int max_ticks_per_batch = 8;
+/* Below this the thread yields instead of sleeping, sleeps can overshoot by a timer period */
+static const double sleep_margin_seconds = 0.0015;
+
+/* Scene Snapshot */
+void SceneSnapshot::Capture(const Simulation& simulation, const SimulationInput& tick_input, std::chrono::steady_clock::time_point tick_due)
+{
+	const RoverStore& rovers = simulation.Rovers();
+	size_t count = rovers.Size();
+	if (behavior.size() != count)
+	{
+		behavior = rovers.behavior;
+		local_x = rovers.local_x;
+		local_y = rovers.local_y;
+		local_z = rovers.local_z;
+	}
+	/* Assignment reuses the capacity of the snapshot this slot held before */
+	orientation = rovers.orientation;
+	previous_orientation = rovers.previous_orientation;
+	wheel_angle = rovers.wheel_angle;
+
+	tick_count = simulation.TickCount();
+	due = tick_due;
+	tick_seconds = 1.0 / simulation.TickRate();
+	input = tick_input;
+	collision = simulation.Collision();
+	camera = simulation.Camera();
+	previous_camera = simulation.PreviousCamera();
+}
+
+float SceneSnapshot::Alpha(std::chrono::steady_clock::time_point now) const
+{
+	double since = std::chrono::duration<double>(now - due).count();
+	return float(std::min(1.0, std::max(0.0, since / tick_seconds)));
+}
+
+/* Simulation Thread */
+SimulationThread::SimulationThread(const Simulation& simulation, SnapshotBuffer& snapshots, TickFunction tick)
+	: simulation(simulation),
+	snapshots(snapshots),
+	tick(tick),
+	stopping(false),
+	late_ticks(0)
+{
+	thread = std::thread(&SimulationThread::Run, this);
+}
+
+SimulationThread::~SimulationThread()
+{
+	stopping = true;
+	thread.join();
+}
+
+void SimulationThread::SetInput(const SimulationInput& latest)
+{
+	std::lock_guard<std::mutex> lock(input_mutex);
+	input = latest;
+}
+
+void SimulationThread::Run()
+{
+	FrameClock clock(1.0 / simulation.TickRate(), max_ticks_per_batch);
+	while (!stopping)
+	{
+		int ticks = clock.BeginFrame();
+		/* The latest tick was due the time left in the accumulator ago */
+		std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now()
+			- std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(clock.Alpha() * clock.TickSeconds()));
+		if (ticks > 1)
+			late_ticks += ticks - 1;
+
+		SimulationInput used;
+		for (int i = 0; i < ticks; ++i)
+		{
+			SimulationInput latest;
+			{
+				std::lock_guard<std::mutex> lock(input_mutex);
+				latest = input;
+			}
+			used = tick(latest);
+		}
+		if (ticks > 0)
+		{
+			snapshots.Back().Capture(simulation, used, due);
+			snapshots.Publish();
+		}
+
+		/* Until the next tick is due */
+		std::chrono::steady_clock::time_point next = due + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(clock.TickSeconds()));
+		for (;;)
+		{
+			double left = std::chrono::duration<double>(next - std::chrono::steady_clock::now()).count();
+			if (left <= 0.0 || stopping)
+				break;
+			if (left > sleep_margin_seconds)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			else
+				std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "GLM/glm.hpp"
+#include "GLM/gtc/quaternion.hpp"
+#include "simulation.h"
+#include "triple_buffer.h"
+
+/*
+	Scene Snapshot: everything the renderer reads from one tick, copied out of the
+	simulation so it can be drawn while the next ticks run. Orientations of the last two
+	ticks are kept so the renderer can interpolate the rover transforms, the collision
+	boxes are drawn at the points the rovers track.
+*/
+struct SceneSnapshot
+{
+	unsigned long long tick_count = 0;
+	/* When the tick was due, the renderer interpolates by the time since */
+	std::chrono::steady_clock::time_point due;
+	double tick_seconds = 0;
+	/* The input of the tick, the renderer takes the camera mode and the steering from it */
+	SimulationInput input;
+	bool collision = false;
+	glm::vec3 camera;
+	glm::vec3 previous_camera;
+
+	std::vector<uint8_t> behavior;
+	std::vector<glm::quat> orientation;
+	std::vector<glm::quat> previous_orientation;
+	std::vector<float> local_x, local_y, local_z;
+	std::vector<float> wheel_angle;
+
+	size_t RoverCount() const { return behavior.size(); }
+	/* Behaviors and local points never change, they are copied only when the rover count does */
+	void Capture(const Simulation& simulation, const SimulationInput& tick_input, std::chrono::steady_clock::time_point tick_due);
+	/* 0 draws the previous tick and 1 this one, for a frame at now */
+	float Alpha(std::chrono::steady_clock::time_point now) const;
+};
+
+typedef TripleBuffer<SceneSnapshot> SnapshotBuffer;
+
+/*
+	Simulation Thread: runs the fixed ticks on a thread of their own, paced by a frame
+	clock like the single threaded loop, and publishes a snapshot after every batch of
+	ticks. A frame that stalls in the driver no longer holds up the simulation, and a
+	slow tick no longer holds up the frame.
+	- The tick function is the only code touching the simulation while the thread runs.
+	- The main thread hands over the keyboard input with SetInput once per frame.
+	- Between batches the thread sleeps in steps of a millisecond, coarse timers make it
+	  catch up with late ticks, which are counted.
+*/
+class SimulationThread
+{
+public:
+	/* Runs one tick with the latest input from SetInput, returns the input it used */
+	typedef std::function<SimulationInput(const SimulationInput& latest)> TickFunction;
+
+	/* Starts at once, the snapshot buffer has to outlive the thread */
+	SimulationThread(const Simulation& simulation, SnapshotBuffer& snapshots, TickFunction tick);
+	/* Stops after the current batch */
+	~SimulationThread();
+
+	void SetInput(const SimulationInput& input);
+
+	/* Ticks run after the first of a batch, because the thread woke up late */
+	unsigned long long LateTicks() const { return late_ticks.load(); }
+
+private:
+	void Run();
+
+	const Simulation& simulation;
+	SnapshotBuffer& snapshots;
+	TickFunction tick;
+	std::mutex input_mutex;
+	SimulationInput input;
+	std::atomic<bool> stopping;
+	std::atomic<unsigned long long> late_ticks;
+	std::thread thread;
+};
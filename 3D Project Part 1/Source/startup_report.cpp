@@ -0,0 +1,39 @@
+#include "startup_report.h"
+
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+static struct
+{
+	struct Entry
+	{
+		std::string category;
+		std::string name;
+		double milliseconds;
+	};
+
+	std::mutex mutex;
+	std::vector<Entry> entries;
+} Report;
+
+void RecordStartupTiming(const std::string& category, const std::string& name, double milliseconds)
+{
+	std::lock_guard<std::mutex> lock(Report.mutex);
+	Report.entries.push_back({ category, name, milliseconds });
+}
+
+void PrintStartupReport()
+{
+	std::lock_guard<std::mutex> lock(Report.mutex);
+
+	std::cout << "Startup report:" << std::endl;
+	for (const auto& entry : Report.entries)
+	{
+		std::cout << "  " << std::left << std::setw(16) << entry.category
+			<< std::setw(40) << entry.name
+			<< std::right << std::fixed << std::setprecision(2) << std::setw(10) << entry.milliseconds << " ms" << std::endl;
+	}
+	std::cout.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+/* Startup Report: named timings collected while loading, printed before the first frame */
+
+class StartupTimer
+{
+public:
+	StartupTimer() : start(std::chrono::steady_clock::now()) {}
+
+	double ElapsedMilliseconds() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start;
+};
+
+void RecordStartupTiming(const std::string& category, const std::string& name, double milliseconds);
+
+void PrintStartupReport();
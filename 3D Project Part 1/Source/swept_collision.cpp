@@ -0,0 +1,64 @@
+#include "swept_collision.h"
+
+#include <cmath>
+
+/* Contacts are reported within this fraction of the reach */
+static const float contact_tolerance = 1e-3f;
+/* Only grazing paths that never close in take this many steps, they count as misses */
+static const int max_advancement_steps = 64;
+
+ArcMotion ArcMotion::Between(const glm::quat& from, const glm::quat& to, const glm::vec3& point, float scale)
+{
+	ArcMotion motion;
+	motion.start = scale * (from * point);
+
+	/* The world rotation taking from to to, the short way round */
+	glm::quat delta = to * glm::conjugate(from);
+	if (delta.w < 0.0f)
+		delta = -delta;
+	glm::vec3 v(delta.x, delta.y, delta.z);
+	float sine = glm::length(v);
+	if (sine < 1e-9f)
+	{
+		motion.axis = glm::vec3(0, 0, 1);
+		motion.angle = 0.0f;
+	}
+	else
+	{
+		motion.axis = v / sine;
+		motion.angle = 2.0f * std::atan2(sine, delta.w);
+	}
+	return motion;
+}
+
+glm::vec3 ArcMotion::At(float t) const
+{
+	/* Rodrigues' rotation of the start about the axis */
+	float theta = angle * t;
+	float c = std::cos(theta), s = std::sin(theta);
+	return start * c + glm::cross(axis, start) * s + axis * (glm::dot(axis, start) * (1.0f - c));
+}
+
+float ArcMotion::Speed() const
+{
+	return std::fabs(angle) * glm::length(start - axis * glm::dot(axis, start));
+}
+
+float TimeOfImpact(const ArcMotion& a, const ArcMotion& b, float reach)
+{
+	float closing_speed = a.Speed() + b.Speed();
+	float tolerance = reach * contact_tolerance;
+	float t = 0.0f;
+	for (int step = 0; step < max_advancement_steps; ++step)
+	{
+		float gap = glm::distance(a.At(t), b.At(t)) - reach;
+		if (gap <= tolerance)
+			return t;
+		if (closing_speed <= 0.0f)
+			return -1.0f;
+		t += gap / closing_speed;
+		if (t > 1.0f)
+			return -1.0f;
+	}
+	return -1.0f;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "GLM/glm.hpp"
+#include "GLM/gtc/quaternion.hpp"
+
+/*
+	Swept Collision: contacts between points turning about the center of Mars during a
+	tick, so rovers taking large steps can not pass through each other unseen.
+	- A rover's motion over a tick is the rotation from its previous orientation to the
+	  current one, which is a turn about a single axis through the center. Driving
+	  straight moves the rover along a great circle arc.
+	- Time of impact uses conservative advancement. The distance between two points
+	  shrinks no faster than the sum of their speeds along the arcs, so advancing by the
+	  gap over that speed never steps past a contact.
+	No GL.
+*/
+struct ArcMotion
+{
+	/* Position at the start of the tick */
+	glm::vec3 start;
+	/* Unit axis through the center, and the angle turned over the whole tick */
+	glm::vec3 axis;
+	float angle;
+
+	/* The motion of point, given before both orientations, scaled after them */
+	static ArcMotion Between(const glm::quat& from, const glm::quat& to, const glm::vec3& point, float scale);
+
+	/* Position at t between 0 (start of the tick) and 1 (end) */
+	glm::vec3 At(float t) const;
+	/* Distance covered per unit of t, the distance from the axis times the angle */
+	float Speed() const;
+};
+
+/* The first t in [0, 1] where the points are at most reach apart, negative when they never are */
+float TimeOfImpact(const ArcMotion& a, const ArcMotion& b, float reach);
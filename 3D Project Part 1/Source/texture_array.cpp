@@ -0,0 +1,196 @@
+#include "texture_array.h"
+
+#include <algorithm>
+#include <cmath>
+#include "mip_chain.h"
+#include "texture_loader.h"
+
+/* RGBA of one texel, missing channels come from the grey value and an opaque alpha */
+static void FetchRGBA(const unsigned char* pixels, int width, int channels, int x, int y, float* rgba)
+{
+	const unsigned char* texel = pixels + (size_t(y) * width + x) * channels;
+	switch (channels)
+	{
+	case 1:
+		rgba[0] = rgba[1] = rgba[2] = texel[0];
+		rgba[3] = 255.f;
+		break;
+	case 2:
+		rgba[0] = rgba[1] = rgba[2] = texel[0];
+		rgba[3] = texel[1];
+		break;
+	case 3:
+		rgba[0] = texel[0];
+		rgba[1] = texel[1];
+		rgba[2] = texel[2];
+		rgba[3] = 255.f;
+		break;
+	default:
+		rgba[0] = texel[0];
+		rgba[1] = texel[1];
+		rgba[2] = texel[2];
+		rgba[3] = texel[3];
+		break;
+	}
+}
+
+/* Source texels and their weights for every target texel along one axis, taps of them per texel */
+struct AxisFilter
+{
+	int taps;
+	std::vector<int> first;
+	std::vector<float> weights;
+};
+
+static AxisFilter BuildAxisFilter(int source_size, int target_size)
+{
+	AxisFilter filter;
+	float scale = float(source_size) / target_size;
+	/* A box of scale texels overlaps at most ceil(scale) + 1 of them */
+	filter.taps = scale > 1.f ? int(std::ceil(scale)) + 1 : 2;
+	filter.first.resize(target_size);
+	filter.weights.assign(size_t(target_size) * filter.taps, 0.f);
+
+	for (int i = 0; i < target_size; ++i)
+	{
+		float* weights = &filter.weights[size_t(i) * filter.taps];
+		if (scale > 1.f)
+		{
+			/* Each source texel counts by how much of the target texel it covers */
+			float begin = i * scale;
+			float end = std::min(float(source_size), (i + 1) * scale);
+			int first = std::min(int(begin), source_size - 1);
+			filter.first[i] = first;
+			for (int tap = 0; tap < filter.taps && first + tap < source_size; ++tap)
+			{
+				float covered = std::min(end, float(first + tap + 1)) - std::max(begin, float(first + tap));
+				weights[tap] = std::max(0.f, covered) / (end - begin);
+			}
+		}
+		else
+		{
+			/* Texel centers map onto texel centers */
+			float source = std::max(0.f, (i + 0.5f) * scale - 0.5f);
+			int first = std::min(int(source), source_size - 1);
+			float fraction = source - first;
+			filter.first[i] = first;
+			if (first + 1 < source_size)
+			{
+				weights[0] = 1.f - fraction;
+				weights[1] = fraction;
+			}
+			else
+			{
+				weights[0] = 1.f;
+			}
+		}
+	}
+	return filter;
+}
+
+std::vector<unsigned char> ResampleToRGBA(const unsigned char* pixels, int width, int height, int channels, int target_width, int target_height)
+{
+	std::vector<unsigned char> result(size_t(target_width) * target_height * 4);
+
+	AxisFilter filter_x = BuildAxisFilter(width, target_width);
+	AxisFilter filter_y = BuildAxisFilter(height, target_height);
+
+	for (int y = 0; y < target_height; ++y)
+	{
+		const float* weights_y = &filter_y.weights[size_t(y) * filter_y.taps];
+		for (int x = 0; x < target_width; ++x)
+		{
+			const float* weights_x = &filter_x.weights[size_t(x) * filter_x.taps];
+
+			/* Taps past the edge have no weight and are skipped */
+			float sum[4] = { 0.f, 0.f, 0.f, 0.f };
+			for (int tap_y = 0; tap_y < filter_y.taps; ++tap_y)
+			{
+				if (weights_y[tap_y] == 0.f)
+					continue;
+				for (int tap_x = 0; tap_x < filter_x.taps; ++tap_x)
+				{
+					if (weights_x[tap_x] == 0.f)
+						continue;
+					float texel[4];
+					FetchRGBA(pixels, width, channels, filter_x.first[x] + tap_x, filter_y.first[y] + tap_y, texel);
+					float weight = weights_x[tap_x] * weights_y[tap_y];
+					for (int c = 0; c < 4; ++c)
+						sum[c] += texel[c] * weight;
+				}
+			}
+
+			unsigned char* out = &result[(size_t(y) * target_width + x) * 4];
+			for (int c = 0; c < 4; ++c)
+				out[c] = (unsigned char)std::lround(std::min(255.f, sum[c]));
+		}
+	}
+
+	return result;
+}
+
+/* Texture Array */
+TextureArray::TextureArray(int width, int height)
+	: width(width),
+	height(height),
+	texture(0)
+{
+}
+
+GLint TextureArray::AddLayer(const unsigned char* pixels, int width, int height, int channels)
+{
+	/* A failed load keeps its layer so the other indices stay valid, it just stays black */
+	if (pixels == nullptr)
+	{
+		layers.push_back(std::vector<unsigned char>(size_t(this->width) * this->height * 4, 0));
+		return GLint(layers.size() - 1);
+	}
+
+	/* Same size images only need the channel expansion, which the resample does at scale 1 */
+	layers.push_back(ResampleToRGBA(pixels, width, height, channels, this->width, this->height));
+	return GLint(layers.size() - 1);
+}
+
+GLuint TextureArray::Upload(PixelUploader* uploader)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+
+	GLsizei layer_count = GLsizei(layers.size());
+	int level_count = 0;
+	for (int level_width = width, level_height = height;; level_width = std::max(1, level_width / 2), level_height = std::max(1, level_height / 2))
+	{
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level_count++, GL_RGBA8, level_width, level_height, layer_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		if (level_width == 1 && level_height == 1)
+			break;
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+
+	auto uploadLevel = [&](GLint level, GLint layer, int level_width, int level_height, const unsigned char* pixels)
+	{
+		if (uploader)
+			uploader->Upload(GL_TEXTURE_2D_ARRAY, texture, level, layer, level_width, level_height, GL_RGBA, 4, pixels);
+		else
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, level_width, level_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	};
+
+	for (size_t layer = 0; layer < layers.size(); ++layer)
+	{
+		std::vector<MipLevel> mips = BuildMipChain(layers[layer].data(), width, height, 4);
+
+		uploadLevel(0, GLint(layer), width, height, layers[layer].data());
+		for (size_t i = 0; i < mips.size(); ++i)
+			uploadLevel(GLint(i + 1), GLint(layer), mips[i].width, mips[i].height, mips[i].pixels.data());
+
+		std::vector<unsigned char>().swap(layers[layer]);
+	}
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	return texture;
+}
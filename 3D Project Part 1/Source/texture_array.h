@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include "GLAD/glad.h"
+
+class PixelUploader;
+
+/*
+	Expands 1 to 4 channel pixels to RGBA and resamples them to the target size. An axis
+	that shrinks averages the source texels under each target texel by their coverage,
+	so detail between the samples is not dropped. An axis that grows is interpolated
+	linearly.
+*/
+std::vector<unsigned char> ResampleToRGBA(const unsigned char* pixels, int width, int height, int channels, int target_width, int target_height);
+
+/*
+	Texture Array: RGBA layers of one size in a single GL_TEXTURE_2D_ARRAY, so draws that
+	only differ in their texture keep the same binding and pick a layer instead.
+	Images of another size are resampled to the array size when they are added.
+*/
+class TextureArray
+{
+public:
+	TextureArray(int width, int height);
+
+	/* Returns the layer the image was placed in, pixels are rows of width * channels bytes */
+	GLint AddLayer(const unsigned char* pixels, int width, int height, int channels);
+
+	/* Creates the texture with a full mip chain per layer and frees the CPU copies, through the uploader if given */
+	GLuint Upload(PixelUploader* uploader = nullptr);
+
+	GLuint Id() const { return texture; }
+	int LayerCount() const { return int(layers.size()); }
+
+private:
+	int width;
+	int height;
+	std::vector<std::vector<unsigned char>> layers;
+	GLuint texture;
+};
@@ -0,0 +1,914 @@
+#include "texture_compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+/* 16 RGBA texels of one block, row by row */
+typedef unsigned char BlockTexels[16][4];
+
+const char* BlockFormatName(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1: return "bc1";
+	case BLOCK_FORMAT_BC3: return "bc3";
+	case BLOCK_FORMAT_BC7: return "bc7";
+	case BLOCK_FORMAT_ETC2_RGB: return "etc2";
+	case BLOCK_FORMAT_ETC2_RGBA: return "etc2a";
+	default: return "unknown";
+	}
+}
+
+bool BlockFormatHasAlpha(BlockFormat format)
+{
+	return format == BLOCK_FORMAT_BC3 || format == BLOCK_FORMAT_BC7 || format == BLOCK_FORMAT_ETC2_RGBA;
+}
+
+size_t BlockBytes(BlockFormat format)
+{
+	return (format == BLOCK_FORMAT_BC1 || format == BLOCK_FORMAT_ETC2_RGB) ? 8 : 16;
+}
+
+size_t CompressedSize(BlockFormat format, int width, int height)
+{
+	return size_t((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+static void FetchBlock(const unsigned char* pixels, int width, int height, int channels, int block_x, int block_y, BlockTexels block)
+{
+	for (int y = 0; y < 4; ++y)
+	{
+		int source_y = std::min(block_y * 4 + y, height - 1);
+		for (int x = 0; x < 4; ++x)
+		{
+			int source_x = std::min(block_x * 4 + x, width - 1);
+			const unsigned char* texel = pixels + (size_t(source_y) * width + source_x) * channels;
+			unsigned char* out = block[y * 4 + x];
+			switch (channels)
+			{
+			case 1:
+				out[0] = out[1] = out[2] = texel[0];
+				out[3] = 255;
+				break;
+			case 2:
+				out[0] = out[1] = out[2] = texel[0];
+				out[3] = texel[1];
+				break;
+			case 3:
+				out[0] = texel[0];
+				out[1] = texel[1];
+				out[2] = texel[2];
+				out[3] = 255;
+				break;
+			default:
+				std::memcpy(out, texel, 4);
+				break;
+			}
+		}
+	}
+}
+
+static int ClampInt(int value, int low, int high)
+{
+	return std::min(high, std::max(low, value));
+}
+
+static int SquaredError(const unsigned char* a, const int* b, int channels)
+{
+	int error = 0;
+	for (int c = 0; c < channels; ++c)
+	{
+		int d = int(a[c]) - b[c];
+		error += d * d;
+	}
+	return error;
+}
+
+/*
+	Endpoints on the principal axis of the block colors, found by power iteration on the
+	covariance. low and high are the extremes of the texels projected onto the axis.
+*/
+static void PrincipalEndpoints(const BlockTexels block, int channels, float low[4], float high[4])
+{
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+		for (int c = 0; c < channels; ++c)
+			mean[c] += block[i][c] / 16.f;
+
+	float covariance[4][4] = {};
+	for (int i = 0; i < 16; ++i)
+		for (int a = 0; a < channels; ++a)
+			for (int b = 0; b < channels; ++b)
+				covariance[a][b] += (block[i][a] - mean[a]) * (block[i][b] - mean[b]);
+
+	float axis[4] = { 1, 1, 1, 1 };
+	for (int iteration = 0; iteration < 8; ++iteration)
+	{
+		float next[4] = { 0, 0, 0, 0 };
+		float length = 0;
+		for (int a = 0; a < channels; ++a)
+		{
+			for (int b = 0; b < channels; ++b)
+				next[a] += covariance[a][b] * axis[b];
+			length += next[a] * next[a];
+		}
+		/* Flat blocks have no axis, both endpoints end up on the mean */
+		if (length < 1e-6f)
+			break;
+		length = std::sqrt(length);
+		for (int c = 0; c < channels; ++c)
+			axis[c] = next[c] / length;
+	}
+
+	float t_min = 0, t_max = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		float t = 0;
+		for (int c = 0; c < channels; ++c)
+			t += (block[i][c] - mean[c]) * axis[c];
+		t_min = std::min(t_min, t);
+		t_max = std::max(t_max, t);
+	}
+
+	for (int c = 0; c < 4; ++c)
+	{
+		low[c] = c < channels ? std::min(255.f, std::max(0.f, mean[c] + t_min * axis[c])) : 255.f;
+		high[c] = c < channels ? std::min(255.f, std::max(0.f, mean[c] + t_max * axis[c])) : 255.f;
+	}
+}
+
+/* Least squares endpoints for fixed interpolation weights, false when the weights are degenerate */
+static bool RefitEndpoints(const BlockTexels block, int channels, const float weights[16], float first[4], float second[4])
+{
+	float aa = 0, ab = 0, bb = 0;
+	float ax[4] = { 0, 0, 0, 0 }, bx[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; ++i)
+	{
+		float a = 1.f - weights[i];
+		float b = weights[i];
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for (int c = 0; c < channels; ++c)
+		{
+			ax[c] += a * block[i][c];
+			bx[c] += b * block[i][c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::fabs(determinant) < 1e-6f)
+		return false;
+
+	for (int c = 0; c < channels; ++c)
+	{
+		first[c] = std::min(255.f, std::max(0.f, (bb * ax[c] - ab * bx[c]) / determinant));
+		second[c] = std::min(255.f, std::max(0.f, (aa * bx[c] - ab * ax[c]) / determinant));
+	}
+	return true;
+}
+
+/* BC1 */
+static uint16_t Pack565(const float color[3])
+{
+	int r = ClampInt(int(std::floor(color[0] * 31.f / 255.f + 0.5f)), 0, 31);
+	int g = ClampInt(int(std::floor(color[1] * 63.f / 255.f + 0.5f)), 0, 63);
+	int b = ClampInt(int(std::floor(color[2] * 31.f / 255.f + 0.5f)), 0, 31);
+	return uint16_t((r << 11) | (g << 5) | b);
+}
+
+static void Unpack565(uint16_t packed, int color[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+/* Four color palette, or the three color palette with black when color0 <= color1 */
+static void BC1Palette(uint16_t color0, uint16_t color1, bool four_colors, int palette[4][3])
+{
+	Unpack565(color0, palette[0]);
+	Unpack565(color1, palette[1]);
+	for (int c = 0; c < 3; ++c)
+	{
+		if (four_colors)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		else
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+}
+
+/* Encodes in four color order whichever endpoint packs larger, returns the squared error */
+static int EncodeBC1Colors(const BlockTexels block, const float high[3], const float low[3], unsigned char* out, float weights[16])
+{
+	uint16_t color0 = Pack565(high);
+	uint16_t color1 = Pack565(low);
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	int palette[4][3];
+	BC1Palette(color0, color1, true, palette);
+	static const float palette_weights[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+	uint32_t indices = 0;
+	int total_error = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		/* Equal endpoints decode as the three color palette, index 0 is the same in both */
+		int best = 0;
+		int best_error = SquaredError(block[i], palette[0], 3);
+		for (int k = 1; k < 4 && color0 != color1; ++k)
+		{
+			int error = SquaredError(block[i], palette[k], 3);
+			if (error < best_error)
+			{
+				best = k;
+				best_error = error;
+			}
+		}
+		indices |= uint32_t(best) << (2 * i);
+		weights[i] = palette_weights[best];
+		total_error += best_error;
+	}
+
+	out[0] = uint8_t(color0);
+	out[1] = uint8_t(color0 >> 8);
+	out[2] = uint8_t(color1);
+	out[3] = uint8_t(color1 >> 8);
+	for (int i = 0; i < 4; ++i)
+		out[4 + i] = uint8_t(indices >> (8 * i));
+	return total_error;
+}
+
+static void EncodeBC1(const BlockTexels block, unsigned char* out)
+{
+	float low[4], high[4];
+	PrincipalEndpoints(block, 3, low, high);
+
+	float weights[16];
+	int error = EncodeBC1Colors(block, high, low, out, weights);
+
+	/* One least squares pass over the chosen indices, kept when it helps. The weights are relative to color0 */
+	float first[4], second[4];
+	if (RefitEndpoints(block, 3, weights, first, second))
+	{
+		unsigned char refit[8];
+		float refit_weights[16];
+		if (EncodeBC1Colors(block, first, second, refit, refit_weights) < error)
+			std::memcpy(out, refit, 8);
+	}
+}
+
+static void DecodeBC1(const unsigned char* in, BlockTexels block, bool force_four_colors)
+{
+	uint16_t color0 = uint16_t(in[0] | (in[1] << 8));
+	uint16_t color1 = uint16_t(in[2] | (in[3] << 8));
+	uint32_t indices = uint32_t(in[4]) | (uint32_t(in[5]) << 8) | (uint32_t(in[6]) << 16) | (uint32_t(in[7]) << 24);
+
+	bool four_colors = force_four_colors || color0 > color1;
+	int palette[4][3];
+	BC1Palette(color0, color1, four_colors, palette);
+
+	for (int i = 0; i < 16; ++i)
+	{
+		int index = (indices >> (2 * i)) & 3;
+		for (int c = 0; c < 3; ++c)
+			block[i][c] = uint8_t(palette[index][c]);
+		block[i][3] = (!four_colors && index == 3) ? 0 : 255;
+	}
+}
+
+/* BC3 alpha, eight interpolated values between the extremes */
+static void AlphaPalette(int alpha0, int alpha1, int palette[8])
+{
+	palette[0] = alpha0;
+	palette[1] = alpha1;
+	if (alpha0 > alpha1)
+	{
+		for (int k = 2; k < 8; ++k)
+			palette[k] = ((8 - k) * alpha0 + (k - 1) * alpha1) / 7;
+	}
+	else
+	{
+		for (int k = 2; k < 6; ++k)
+			palette[k] = ((6 - k) * alpha0 + (k - 1) * alpha1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void EncodeBC3Alpha(const BlockTexels block, unsigned char* out)
+{
+	int alpha_min = 255, alpha_max = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		alpha_min = std::min(alpha_min, int(block[i][3]));
+		alpha_max = std::max(alpha_max, int(block[i][3]));
+	}
+
+	int palette[8];
+	AlphaPalette(alpha_max, alpha_min, palette);
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		int best = 0;
+		for (int k = 1; k < 8 && alpha_max != alpha_min; ++k)
+			if (std::abs(palette[k] - block[i][3]) < std::abs(palette[best] - block[i][3]))
+				best = k;
+		indices |= uint64_t(best) << (3 * i);
+	}
+
+	out[0] = uint8_t(alpha_max);
+	out[1] = uint8_t(alpha_min);
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = uint8_t(indices >> (8 * i));
+}
+
+static void DecodeBC3Alpha(const unsigned char* in, BlockTexels block)
+{
+	int palette[8];
+	AlphaPalette(in[0], in[1], palette);
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; ++i)
+		indices |= uint64_t(in[2 + i]) << (8 * i);
+
+	for (int i = 0; i < 16; ++i)
+		block[i][3] = uint8_t(palette[(indices >> (3 * i)) & 7]);
+}
+
+/* BC7 mode 6 */
+static const int bc7_weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter
+{
+	unsigned char* out;
+	int position;
+
+	void Write(uint32_t value, int bits)
+	{
+		for (int i = 0; i < bits; ++i, ++position)
+			if ((value >> i) & 1)
+				out[position >> 3] |= uint8_t(1 << (position & 7));
+	}
+};
+
+struct BitReader
+{
+	const unsigned char* in;
+	int position;
+
+	uint32_t Read(int bits)
+	{
+		uint32_t value = 0;
+		for (int i = 0; i < bits; ++i, ++position)
+			value |= uint32_t((in[position >> 3] >> (position & 7)) & 1) << i;
+		return value;
+	}
+};
+
+/* 7 bit endpoint and the p-bit that together land closest to the color */
+static void QuantizeBC7Endpoint(const float color[4], int quantized[4], int& p_bit)
+{
+	int best_error = -1;
+	for (int p = 0; p < 2; ++p)
+	{
+		int candidate[4];
+		int error = 0;
+		for (int c = 0; c < 4; ++c)
+		{
+			candidate[c] = ClampInt(int(std::floor((color[c] - p) / 2.f + 0.5f)), 0, 127);
+			int d = ((candidate[c] << 1) | p) - int(color[c] + 0.5f);
+			error += d * d;
+		}
+		if (best_error < 0 || error < best_error)
+		{
+			best_error = error;
+			p_bit = p;
+			std::memcpy(quantized, candidate, sizeof(candidate));
+		}
+	}
+}
+
+/* Returns the squared error, weights receive the interpolation factors towards second before any anchor swap */
+static int EncodeBC7Endpoints(const BlockTexels block, const float first[4], const float second[4], unsigned char* out, float weights[16])
+{
+	int quantized[2][4], p_bits[2];
+	QuantizeBC7Endpoint(first, quantized[0], p_bits[0]);
+	QuantizeBC7Endpoint(second, quantized[1], p_bits[1]);
+
+	int endpoints[2][4];
+	for (int e = 0; e < 2; ++e)
+		for (int c = 0; c < 4; ++c)
+			endpoints[e][c] = (quantized[e][c] << 1) | p_bits[e];
+
+	int palette[16][4];
+	for (int k = 0; k < 16; ++k)
+		for (int c = 0; c < 4; ++c)
+			palette[k][c] = ((64 - bc7_weights[k]) * endpoints[0][c] + bc7_weights[k] * endpoints[1][c] + 32) >> 6;
+
+	int indices[16];
+	int total_error = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		int best = 0;
+		int best_error = SquaredError(block[i], palette[0], 4);
+		for (int k = 1; k < 16; ++k)
+		{
+			int error = SquaredError(block[i], palette[k], 4);
+			if (error < best_error)
+			{
+				best = k;
+				best_error = error;
+			}
+		}
+		indices[i] = best;
+		weights[i] = bc7_weights[best] / 64.f;
+		total_error += best_error;
+	}
+
+	/* The anchor index is stored without its top bit, swap the endpoints when it is set */
+	if (indices[0] & 8)
+	{
+		for (int c = 0; c < 4; ++c)
+			std::swap(quantized[0][c], quantized[1][c]);
+		std::swap(p_bits[0], p_bits[1]);
+		for (int i = 0; i < 16; ++i)
+			indices[i] = 15 - indices[i];
+	}
+
+	std::memset(out, 0, 16);
+	BitWriter writer = { out, 0 };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; ++c)
+	{
+		writer.Write(quantized[0][c], 7);
+		writer.Write(quantized[1][c], 7);
+	}
+	writer.Write(p_bits[0], 1);
+	writer.Write(p_bits[1], 1);
+	writer.Write(indices[0], 3);
+	for (int i = 1; i < 16; ++i)
+		writer.Write(indices[i], 4);
+
+	return total_error;
+}
+
+static void EncodeBC7(const BlockTexels block, unsigned char* out)
+{
+	float low[4], high[4];
+	PrincipalEndpoints(block, 4, low, high);
+
+	float weights[16];
+	int error = EncodeBC7Endpoints(block, low, high, out, weights);
+
+	float first[4], second[4];
+	if (RefitEndpoints(block, 4, weights, first, second))
+	{
+		unsigned char refit[16];
+		float refit_weights[16];
+		if (EncodeBC7Endpoints(block, first, second, refit, refit_weights) < error)
+			std::memcpy(out, refit, 16);
+	}
+}
+
+static void DecodeBC7(const unsigned char* in, BlockTexels block)
+{
+	/* Mode 6 is the only one the encoder writes, anything else decodes as magenta */
+	if ((in[0] & 0x7F) != (1 << 6))
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			block[i][0] = 255;
+			block[i][1] = 0;
+			block[i][2] = 255;
+			block[i][3] = 255;
+		}
+		return;
+	}
+
+	BitReader reader = { in, 7 };
+	int quantized[2][4];
+	for (int c = 0; c < 4; ++c)
+	{
+		quantized[0][c] = reader.Read(7);
+		quantized[1][c] = reader.Read(7);
+	}
+	int p_bits[2];
+	p_bits[0] = reader.Read(1);
+	p_bits[1] = reader.Read(1);
+
+	for (int i = 0; i < 16; ++i)
+	{
+		int index = reader.Read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; ++c)
+		{
+			int e0 = (quantized[0][c] << 1) | p_bits[0];
+			int e1 = (quantized[1][c] << 1) | p_bits[1];
+			block[i][c] = uint8_t(((64 - bc7_weights[index]) * e0 + bc7_weights[index] * e1 + 32) >> 6);
+		}
+	}
+}
+
+/* ETC1 compatible ETC2 color blocks, pixels are indexed column by column inside a block */
+static const int etc1_modifiers[8][4] =
+{
+	{ 2, 8, -2, -8 },
+	{ 5, 17, -5, -17 },
+	{ 9, 29, -9, -29 },
+	{ 13, 42, -13, -42 },
+	{ 18, 60, -18, -60 },
+	{ 24, 80, -24, -80 },
+	{ 33, 106, -33, -106 },
+	{ 47, 183, -47, -183 },
+};
+
+static bool InSecondSubblock(int x, int y, bool flip)
+{
+	return flip ? y >= 2 : x >= 2;
+}
+
+struct ETC1Subblock
+{
+	int table;
+	int error;
+	int modifiers[16];
+};
+
+/* Best table and per texel modifiers for one sub-block around the base color */
+static ETC1Subblock FitETC1Subblock(const BlockTexels block, const int base[3], bool flip, bool second)
+{
+	ETC1Subblock best;
+	best.error = -1;
+
+	for (int table = 0; table < 8; ++table)
+	{
+		ETC1Subblock candidate;
+		candidate.table = table;
+		candidate.error = 0;
+		for (int y = 0; y < 4; ++y)
+			for (int x = 0; x < 4; ++x)
+			{
+				if (InSecondSubblock(x, y, flip) != second)
+					continue;
+
+				const unsigned char* texel = block[y * 4 + x];
+				int best_error = -1;
+				for (int m = 0; m < 4; ++m)
+				{
+					int color[3];
+					for (int c = 0; c < 3; ++c)
+						color[c] = ClampInt(base[c] + etc1_modifiers[table][m], 0, 255);
+					int error = SquaredError(texel, color, 3);
+					if (best_error < 0 || error < best_error)
+					{
+						best_error = error;
+						candidate.modifiers[x * 4 + y] = m;
+					}
+				}
+				candidate.error += best_error;
+			}
+
+		if (best.error < 0 || candidate.error < best.error)
+			best = candidate;
+	}
+	return best;
+}
+
+static void EncodeETC1(const BlockTexels block, unsigned char* out)
+{
+	int best_error = -1;
+
+	for (int flip = 0; flip < 2; ++flip)
+	{
+		float average[2][3] = {};
+		for (int y = 0; y < 4; ++y)
+			for (int x = 0; x < 4; ++x)
+				for (int c = 0; c < 3; ++c)
+					average[InSecondSubblock(x, y, flip != 0)][c] += block[y * 4 + x][c] / 8.f;
+
+		for (int differential = 0; differential < 2; ++differential)
+		{
+			int quantized[2][3];
+			int base[2][3];
+			bool valid = true;
+			for (int s = 0; s < 2; ++s)
+				for (int c = 0; c < 3; ++c)
+				{
+					if (differential)
+					{
+						quantized[s][c] = ClampInt(int(std::floor(average[s][c] * 31.f / 255.f + 0.5f)), 0, 31);
+						base[s][c] = (quantized[s][c] << 3) | (quantized[s][c] >> 2);
+					}
+					else
+					{
+						quantized[s][c] = ClampInt(int(std::floor(average[s][c] * 15.f / 255.f + 0.5f)), 0, 15);
+						base[s][c] = (quantized[s][c] << 4) | quantized[s][c];
+					}
+				}
+			/* Deltas outside [-4, 3] would turn into the ETC2 T, H or planar modes */
+			if (differential)
+				for (int c = 0; c < 3; ++c)
+					valid = valid && quantized[1][c] - quantized[0][c] >= -4 && quantized[1][c] - quantized[0][c] <= 3;
+			if (!valid)
+				continue;
+
+			ETC1Subblock subblocks[2] =
+			{
+				FitETC1Subblock(block, base[0], flip != 0, false),
+				FitETC1Subblock(block, base[1], flip != 0, true),
+			};
+			int error = subblocks[0].error + subblocks[1].error;
+			if (best_error >= 0 && error >= best_error)
+				continue;
+			best_error = error;
+
+			for (int c = 0; c < 3; ++c)
+			{
+				if (differential)
+					out[c] = uint8_t((quantized[0][c] << 3) | ((quantized[1][c] - quantized[0][c]) & 7));
+				else
+					out[c] = uint8_t((quantized[0][c] << 4) | quantized[1][c]);
+			}
+			out[3] = uint8_t((subblocks[0].table << 5) | (subblocks[1].table << 2) | (differential << 1) | flip);
+
+			uint32_t index_bits = 0;
+			for (int y = 0; y < 4; ++y)
+				for (int x = 0; x < 4; ++x)
+				{
+					int i = x * 4 + y;
+					int m = subblocks[InSecondSubblock(x, y, flip != 0)].modifiers[i];
+					index_bits |= uint32_t(m >> 1) << (16 + i);
+					index_bits |= uint32_t(m & 1) << i;
+				}
+			out[4] = uint8_t(index_bits >> 24);
+			out[5] = uint8_t(index_bits >> 16);
+			out[6] = uint8_t(index_bits >> 8);
+			out[7] = uint8_t(index_bits);
+		}
+	}
+}
+
+static void DecodeETC1(const unsigned char* in, BlockTexels block)
+{
+	bool differential = (in[3] & 2) != 0;
+	bool flip = (in[3] & 1) != 0;
+	int tables[2] = { in[3] >> 5, (in[3] >> 2) & 7 };
+
+	int base[2][3];
+	for (int c = 0; c < 3; ++c)
+	{
+		if (differential)
+		{
+			int first = in[c] >> 3;
+			int delta = in[c] & 7;
+			if (delta >= 4)
+				delta -= 8;
+			int second = ClampInt(first + delta, 0, 31);
+			base[0][c] = (first << 3) | (first >> 2);
+			base[1][c] = (second << 3) | (second >> 2);
+		}
+		else
+		{
+			base[0][c] = (in[c] >> 4) * 17;
+			base[1][c] = (in[c] & 15) * 17;
+		}
+	}
+
+	uint32_t index_bits = (uint32_t(in[4]) << 24) | (uint32_t(in[5]) << 16) | (uint32_t(in[6]) << 8) | uint32_t(in[7]);
+	for (int y = 0; y < 4; ++y)
+		for (int x = 0; x < 4; ++x)
+		{
+			int i = x * 4 + y;
+			int m = int(((index_bits >> (16 + i)) & 1) << 1 | ((index_bits >> i) & 1));
+			int s = InSecondSubblock(x, y, flip);
+			for (int c = 0; c < 3; ++c)
+				block[y * 4 + x][c] = uint8_t(ClampInt(base[s][c] + etc1_modifiers[tables[s]][m], 0, 255));
+			block[y * 4 + x][3] = 255;
+		}
+}
+
+/* EAC alpha, a base value plus a multiplied modifier from one of 16 tables */
+static const int eac_modifiers[16][8] =
+{
+	{ -3, -6, -9, -15, 2, 5, 8, 14 },
+	{ -3, -7, -10, -13, 2, 6, 9, 12 },
+	{ -2, -5, -8, -13, 1, 4, 7, 12 },
+	{ -2, -4, -6, -13, 1, 3, 5, 12 },
+	{ -3, -6, -8, -12, 2, 5, 7, 11 },
+	{ -3, -7, -9, -11, 2, 6, 8, 10 },
+	{ -4, -7, -8, -11, 3, 6, 7, 10 },
+	{ -3, -5, -8, -11, 2, 4, 7, 10 },
+	{ -2, -6, -8, -10, 1, 5, 7, 9 },
+	{ -2, -5, -8, -10, 1, 4, 7, 9 },
+	{ -2, -4, -8, -10, 1, 3, 7, 9 },
+	{ -2, -5, -7, -10, 1, 4, 6, 9 },
+	{ -3, -4, -7, -10, 2, 3, 6, 9 },
+	{ -1, -2, -3, -10, 0, 1, 2, 9 },
+	{ -4, -6, -8, -9, 3, 5, 7, 8 },
+	{ -3, -5, -7, -9, 2, 4, 6, 8 },
+};
+
+static void EncodeEACAlpha(const BlockTexels block, unsigned char* out)
+{
+	int alpha_min = 255, alpha_max = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		alpha_min = std::min(alpha_min, int(block[i][3]));
+		alpha_max = std::max(alpha_max, int(block[i][3]));
+	}
+
+	/* Table 13 has a zero modifier, constant alpha is exact without a search */
+	int best_error = alpha_min == alpha_max ? 0 : -1;
+	int best_base = alpha_max, best_multiplier = 1, best_table = 13;
+	uint64_t best_indices = 0;
+	if (best_error == 0)
+		for (int i = 0; i < 16; ++i)
+			best_indices |= uint64_t(4) << (45 - 3 * i);
+
+	for (int table = 0; table < 16 && best_error != 0; ++table)
+	{
+		const int* modifiers = eac_modifiers[table];
+		int span = modifiers[7] - modifiers[3];
+		int multiplier_guess = std::max(1, (alpha_max - alpha_min + span / 2) / span);
+
+		for (int multiplier = multiplier_guess - 1; multiplier <= multiplier_guess + 1; ++multiplier)
+		{
+			if (multiplier < 1 || multiplier > 15)
+				continue;
+			int base_guess = ClampInt(alpha_min - modifiers[3] * multiplier, 0, 255);
+			for (int offset = -1; offset <= 1; ++offset)
+			{
+				int base = ClampInt(base_guess + offset, 0, 255);
+
+				int error = 0;
+				uint64_t indices = 0;
+				for (int y = 0; y < 4; ++y)
+					for (int x = 0; x < 4; ++x)
+					{
+						int alpha = block[y * 4 + x][3];
+						int best = 0, best_difference = 256;
+						for (int m = 0; m < 8; ++m)
+						{
+							int difference = std::abs(ClampInt(base + modifiers[m] * multiplier, 0, 255) - alpha);
+							if (difference < best_difference)
+							{
+								best = m;
+								best_difference = difference;
+							}
+						}
+						error += best_difference * best_difference;
+						indices |= uint64_t(best) << (45 - 3 * (x * 4 + y));
+					}
+
+				if (best_error < 0 || error < best_error)
+				{
+					best_error = error;
+					best_base = base;
+					best_multiplier = multiplier;
+					best_table = table;
+					best_indices = indices;
+				}
+			}
+		}
+	}
+
+	out[0] = uint8_t(best_base);
+	out[1] = uint8_t((best_multiplier << 4) | best_table);
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = uint8_t(best_indices >> (40 - 8 * i));
+}
+
+static void DecodeEACAlpha(const unsigned char* in, BlockTexels block)
+{
+	int base = in[0];
+	int multiplier = in[1] >> 4;
+	const int* modifiers = eac_modifiers[in[1] & 15];
+
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; ++i)
+		indices = (indices << 8) | in[2 + i];
+
+	for (int y = 0; y < 4; ++y)
+		for (int x = 0; x < 4; ++x)
+		{
+			int m = int((indices >> (45 - 3 * (x * 4 + y))) & 7);
+			block[y * 4 + x][3] = uint8_t(ClampInt(base + modifiers[m] * multiplier, 0, 255));
+		}
+}
+
+/* Images */
+static void EncodeBlock(BlockFormat format, const BlockTexels block, unsigned char* out)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1:
+		EncodeBC1(block, out);
+		break;
+	case BLOCK_FORMAT_BC3:
+		EncodeBC3Alpha(block, out);
+		EncodeBC1(block, out + 8);
+		break;
+	case BLOCK_FORMAT_BC7:
+		EncodeBC7(block, out);
+		break;
+	case BLOCK_FORMAT_ETC2_RGB:
+		EncodeETC1(block, out);
+		break;
+	case BLOCK_FORMAT_ETC2_RGBA:
+		EncodeEACAlpha(block, out);
+		EncodeETC1(block, out + 8);
+		break;
+	default:
+		break;
+	}
+}
+
+static void DecodeBlock(BlockFormat format, const unsigned char* in, BlockTexels block)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1:
+		DecodeBC1(in, block, false);
+		break;
+	case BLOCK_FORMAT_BC3:
+		DecodeBC1(in + 8, block, true);
+		DecodeBC3Alpha(in, block);
+		break;
+	case BLOCK_FORMAT_BC7:
+		DecodeBC7(in, block);
+		break;
+	case BLOCK_FORMAT_ETC2_RGB:
+		DecodeETC1(in, block);
+		break;
+	case BLOCK_FORMAT_ETC2_RGBA:
+		DecodeETC1(in + 8, block);
+		DecodeEACAlpha(in, block);
+		break;
+	default:
+		break;
+	}
+}
+
+std::vector<unsigned char> CompressImage(BlockFormat format, const unsigned char* pixels, int width, int height, int channels)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	size_t block_bytes = BlockBytes(format);
+	std::vector<unsigned char> result(CompressedSize(format, width, height));
+
+	auto encodeRows = [&](int first_row, int last_row)
+	{
+		BlockTexels block;
+		for (int by = first_row; by < last_row; ++by)
+			for (int bx = 0; bx < blocks_x; ++bx)
+			{
+				FetchBlock(pixels, width, height, channels, bx, by, block);
+				EncodeBlock(format, block, &result[(size_t(by) * blocks_x + bx) * block_bytes]);
+			}
+	};
+
+	unsigned bands = std::min<unsigned>(std::max(1u, std::thread::hardware_concurrency()), unsigned(blocks_y));
+	if (size_t(blocks_x) * blocks_y < 1024)
+		bands = 1;
+
+	std::vector<std::thread> threads;
+	for (unsigned band = 1; band < bands; ++band)
+		threads.emplace_back(encodeRows, int(size_t(blocks_y) * band / bands), int(size_t(blocks_y) * (band + 1) / bands));
+	encodeRows(0, int(blocks_y / bands));
+	for (std::thread& thread : threads)
+		thread.join();
+
+	return result;
+}
+
+std::vector<unsigned char> DecompressImage(BlockFormat format, const unsigned char* blocks, int width, int height)
+{
+	int blocks_x = (width + 3) / 4;
+	int blocks_y = (height + 3) / 4;
+	size_t block_bytes = BlockBytes(format);
+	std::vector<unsigned char> result(size_t(width) * height * 4);
+
+	BlockTexels block;
+	for (int by = 0; by < blocks_y; ++by)
+		for (int bx = 0; bx < blocks_x; ++bx)
+		{
+			DecodeBlock(format, blocks + (size_t(by) * blocks_x + bx) * block_bytes, block);
+			for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+				for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+					std::memcpy(&result[(size_t(by * 4 + y) * width + bx * 4 + x) * 4], block[y * 4 + x], 4);
+		}
+
+	return result;
+}
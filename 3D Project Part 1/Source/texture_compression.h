@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/* Texture Compression: 4x4 block encoders and decoders, no GL so the asset cooker can use them */
+
+enum BlockFormat
+{
+	/* RGB, 4 bits per texel */
+	BLOCK_FORMAT_BC1 = 0,
+	/* RGBA, BC1 color plus an interpolated alpha block, 8 bits per texel */
+	BLOCK_FORMAT_BC3 = 1,
+	/* RGBA, mode 6 only (one subset, 7 bit endpoints with p-bits, 4 bit indices), 8 bits per texel */
+	BLOCK_FORMAT_BC7 = 2,
+	/* RGB, the encoder only emits ETC1 compatible individual and differential blocks */
+	BLOCK_FORMAT_ETC2_RGB = 3,
+	/* RGBA, EAC alpha block followed by an ETC2 color block */
+	BLOCK_FORMAT_ETC2_RGBA = 4,
+	BLOCK_FORMAT_COUNT
+};
+
+/* Short lowercase name, also used in cooked file names */
+const char* BlockFormatName(BlockFormat format);
+
+bool BlockFormatHasAlpha(BlockFormat format);
+
+size_t BlockBytes(BlockFormat format);
+
+size_t CompressedSize(BlockFormat format, int width, int height);
+
+/*
+	Encodes 1 to 4 channel pixels, rows of width * channels bytes. Partial blocks at the
+	right and bottom edges repeat the last column and row. Block rows are split across threads.
+*/
+std::vector<unsigned char> CompressImage(BlockFormat format, const unsigned char* pixels, int width, int height, int channels);
+
+/* Decodes to RGBA, only understands the block modes the encoder emits */
+std::vector<unsigned char> DecompressImage(BlockFormat format, const unsigned char* blocks, int width, int height);
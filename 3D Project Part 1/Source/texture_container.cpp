@@ -0,0 +1,91 @@
+#include "texture_container.h"
+
+#include <cstring>
+#include <fstream>
+
+static const unsigned char texture_file_identifier[12] = { 0xAB, 'M', 'T', 'X', ' ', '1', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+static uint64_t AlignTo16(uint64_t offset)
+{
+	return (offset + 15) & ~uint64_t(15);
+}
+
+bool WriteTextureFile(const std::string& path, BlockFormat format, int width, int height, int source_channels, const std::vector<std::vector<unsigned char>>& levels)
+{
+	TextureFileHeader header;
+	std::memcpy(header.identifier, texture_file_identifier, sizeof(header.identifier));
+	header.format = uint32_t(format);
+	header.width = uint32_t(width);
+	header.height = uint32_t(height);
+	header.level_count = uint32_t(levels.size());
+	header.source_channels = uint32_t(source_channels);
+
+	/* Smallest level first, a partial read already has every level below some size */
+	std::vector<TextureFileLevel> index(levels.size());
+	uint64_t offset = AlignTo16(sizeof(header) + sizeof(TextureFileLevel) * levels.size());
+	int level_width = width, level_height = height;
+	for (size_t i = 0; i < levels.size(); ++i)
+	{
+		index[i].width = uint32_t(level_width);
+		index[i].height = uint32_t(level_height);
+		index[i].size = levels[i].size();
+		level_width = level_width > 1 ? level_width / 2 : 1;
+		level_height = level_height > 1 ? level_height / 2 : 1;
+	}
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		index[i].offset = offset;
+		offset = AlignTo16(offset + index[i].size);
+	}
+
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(index.data()), sizeof(TextureFileLevel) * index.size());
+
+	static const char padding[16] = {};
+	uint64_t written = sizeof(header) + sizeof(TextureFileLevel) * index.size();
+	for (size_t i = levels.size(); i-- > 0;)
+	{
+		file.write(padding, std::streamsize(index[i].offset - written));
+		file.write(reinterpret_cast<const char*>(levels[i].data()), std::streamsize(levels[i].size()));
+		written = index[i].offset + index[i].size;
+	}
+
+	return bool(file);
+}
+
+bool TextureFileView::Parse(const unsigned char* data, size_t size)
+{
+	this->data = nullptr;
+	if (data == nullptr || size < sizeof(TextureFileHeader))
+		return false;
+
+	const TextureFileHeader* header = reinterpret_cast<const TextureFileHeader*>(data);
+	if (std::memcmp(header->identifier, texture_file_identifier, sizeof(texture_file_identifier)) != 0 ||
+		header->format >= BLOCK_FORMAT_COUNT || header->level_count == 0 || header->level_count > 32)
+		return false;
+
+	if (size < sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * header->level_count)
+		return false;
+
+	const TextureFileLevel* levels = reinterpret_cast<const TextureFileLevel*>(data + sizeof(TextureFileHeader));
+	for (uint32_t i = 0; i < header->level_count; ++i)
+	{
+		if (levels[i].offset > size || levels[i].size > size - levels[i].offset ||
+			levels[i].size != CompressedSize(BlockFormat(header->format), int(levels[i].width), int(levels[i].height)))
+			return false;
+	}
+
+	this->data = data;
+	this->header = header;
+	this->levels = levels;
+	return true;
+}
+
+std::string CookedTexturePath(const std::string& directory, const std::string& image, BlockFormat format)
+{
+	return directory + "/" + image + "." + BlockFormatName(format) + ".tex";
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "texture_compression.h"
+
+/*
+	Texture Container: a KTX2 style file with a fixed header, a level index and the level
+	data, smallest level first and 16 byte aligned so it can be used straight from a
+	memory mapping. No GL, shared by the asset cooker and the runtime.
+*/
+struct TextureFileHeader
+{
+	unsigned char identifier[12];
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t level_count;
+	/* Channels of the source image, 4 means the alpha channel is meaningful */
+	uint32_t source_channels;
+};
+
+struct TextureFileLevel
+{
+	uint64_t offset;
+	uint64_t size;
+	uint32_t width;
+	uint32_t height;
+};
+
+/* levels[0] is the full size level, every following one halves down to 1x1 */
+bool WriteTextureFile(const std::string& path, BlockFormat format, int width, int height, int source_channels, const std::vector<std::vector<unsigned char>>& levels);
+
+/* A parsed view over container bytes, the bytes have to outlive it */
+class TextureFileView
+{
+public:
+	/* False when the identifier, format or any level range is invalid */
+	bool Parse(const unsigned char* data, size_t size);
+
+	BlockFormat Format() const { return BlockFormat(header->format); }
+	int Width() const { return int(header->width); }
+	int Height() const { return int(header->height); }
+	int LevelCount() const { return int(header->level_count); }
+	int SourceChannels() const { return int(header->source_channels); }
+
+	const TextureFileLevel& Level(int level) const { return levels[level]; }
+	const unsigned char* LevelData(int level) const { return data + levels[level].offset; }
+
+private:
+	const unsigned char* data = nullptr;
+	const TextureFileHeader* header = nullptr;
+	const TextureFileLevel* levels = nullptr;
+};
+
+/* Name of the cooked file for an image, e.g. cooked/texture.jpg.bc7.tex */
+std::string CookedTexturePath(const std::string& directory, const std::string& image, BlockFormat format);
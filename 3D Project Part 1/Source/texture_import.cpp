@@ -0,0 +1,234 @@
+#include "texture_import.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include "cube_map.h"
+#include "startup_report.h"
+#include "texture_loader.h"
+
+GLenum SizedInternalFormat(int channels, bool srgb)
+{
+	switch (channels)
+	{
+	case 1: return GL_R8;
+	case 2: return GL_RG8;
+	case 3: return srgb ? GL_SRGB8 : GL_RGB8;
+	default: return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+}
+
+GLenum PixelFormat(int channels)
+{
+	switch (channels)
+	{
+	case 1: return GL_RED;
+	case 2: return GL_RG;
+	case 3: return GL_RGB;
+	default: return GL_RGBA;
+	}
+}
+
+size_t BytesPerTexel(GLenum internal_format)
+{
+	switch (internal_format)
+	{
+	case GL_R8: return 1;
+	case GL_RG8: return 2;
+	case GL_RGB8:
+	case GL_SRGB8: return 3;
+	default: return 4;
+	}
+}
+
+GLuint ImportTexture2D(const std::string& name, const unsigned char* pixels, int width, int height, int channels, bool srgb, PixelUploader& uploader)
+{
+	StartupTimer mip_timer;
+	std::vector<MipLevel> levels = BuildMipChain(pixels, width, height, channels);
+	RecordStartupTiming("texture mips", name, mip_timer.ElapsedMilliseconds());
+
+	GLenum internal_format = SizedInternalFormat(channels, srgb);
+	GLenum format = PixelFormat(channels);
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+	for (size_t i = 0; i < levels.size(); ++i)
+		glTexImage2D(GL_TEXTURE_2D, GLint(i + 1), internal_format, levels[i].width, levels[i].height, 0, format, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(levels.size()));
+
+	/* Measures issuing the copies, the transfer itself finishes in the background */
+	StartupTimer upload_timer;
+	uploader.Upload(GL_TEXTURE_2D, texture, 0, 0, width, height, format, channels, pixels);
+	for (size_t i = 0; i < levels.size(); ++i)
+		uploader.Upload(GL_TEXTURE_2D, texture, GLint(i + 1), 0, levels[i].width, levels[i].height, format, channels, levels[i].pixels.data());
+	RecordStartupTiming("texture upload", name, upload_timer.ElapsedMilliseconds());
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	size_t texels = MipChainTexels(width, height);
+	RecordTextureMemory(name, texels * 4, texels * BytesPerTexel(internal_format));
+
+	return texture;
+}
+
+GLuint ImportCubeMap(const std::string& name, const std::vector<std::vector<unsigned char>>& faces, int face_size, int channels, bool srgb, PixelUploader& uploader)
+{
+	StartupTimer mip_timer;
+	/* One face at a time, BuildMipChain already spreads the large levels over every core */
+	std::vector<std::vector<MipLevel>> levels(cube_face_count);
+	for (int face = 0; face < cube_face_count; ++face)
+		levels[face] = BuildMipChain(faces[face].data(), face_size, face_size, channels);
+	RecordStartupTiming("texture mips", name, mip_timer.ElapsedMilliseconds());
+
+	GLenum internal_format = SizedInternalFormat(channels, srgb);
+	GLenum format = PixelFormat(channels);
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+
+	GLint level_count = GLint(levels[0].size()) + 1;
+	for (int face = 0; face < cube_face_count; ++face)
+	{
+		GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+		glTexImage2D(target, 0, internal_format, face_size, face_size, 0, format, GL_UNSIGNED_BYTE, NULL);
+		for (size_t i = 0; i < levels[face].size(); ++i)
+			glTexImage2D(target, GLint(i + 1), internal_format, levels[face][i].width, levels[face][i].height, 0, format, GL_UNSIGNED_BYTE, NULL);
+	}
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+
+	StartupTimer upload_timer;
+	for (int face = 0; face < cube_face_count; ++face)
+	{
+		GLenum target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + face;
+		uploader.Upload(target, texture, 0, 0, face_size, face_size, format, channels, faces[face].data());
+		for (size_t i = 0; i < levels[face].size(); ++i)
+			uploader.Upload(target, texture, GLint(i + 1), 0, levels[face][i].width, levels[face][i].height, format, channels, levels[face][i].pixels.data());
+	}
+	RecordStartupTiming("texture upload", name, upload_timer.ElapsedMilliseconds());
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	size_t texels = MipChainTexels(face_size, face_size) * cube_face_count;
+	RecordTextureMemory(name, texels * 4, texels * BytesPerTexel(internal_format));
+
+	return texture;
+}
+
+GLenum CompressedInternalFormat(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1: return GLAD_GL_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : 0;
+	case BLOCK_FORMAT_BC3: return GLAD_GL_EXT_texture_compression_s3tc ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : 0;
+	case BLOCK_FORMAT_BC7: return GLAD_GL_ARB_texture_compression_bptc ? GL_COMPRESSED_RGBA_BPTC_UNORM_ARB : 0;
+	case BLOCK_FORMAT_ETC2_RGB: return GLAD_GL_ARB_ES3_compatibility ? GL_COMPRESSED_RGB8_ETC2 : 0;
+	case BLOCK_FORMAT_ETC2_RGBA: return GLAD_GL_ARB_ES3_compatibility ? GL_COMPRESSED_RGBA8_ETC2_EAC : 0;
+	default: return 0;
+	}
+}
+
+bool OpenCookedTexture(const std::string& directory, const std::string& image, AssetData& file, TextureFileView& view, GLenum& internal_format)
+{
+	/* Best quality per byte first, ETC2 is mostly emulated on desktop drivers */
+	static const BlockFormat preference[] =
+	{
+		BLOCK_FORMAT_BC7, BLOCK_FORMAT_BC3, BLOCK_FORMAT_BC1, BLOCK_FORMAT_ETC2_RGBA, BLOCK_FORMAT_ETC2_RGB,
+	};
+
+	for (BlockFormat format : preference)
+	{
+		internal_format = CompressedInternalFormat(format);
+		if (internal_format == 0)
+			continue;
+
+		file = OpenAsset(CookedTexturePath(directory, image, format));
+		if (!file.IsValid())
+			continue;
+		if (!view.Parse(file.Data(), file.Size()) || view.Format() != format)
+		{
+			std::cout << "Cooked texture " << CookedTexturePath(directory, image, format) << " is invalid, skipping it" << std::endl;
+			continue;
+		}
+		return true;
+	}
+	file = AssetData();
+	return false;
+}
+
+GLuint LoadCookedTexture(const std::string& directory, const std::string& image)
+{
+	StartupTimer timer;
+	AssetData file;
+	TextureFileView view;
+	GLenum internal_format;
+	if (!OpenCookedTexture(directory, image, file, view, internal_format))
+		return 0;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	size_t bytes = 0;
+	for (int level = 0; level < view.LevelCount(); ++level)
+	{
+		const TextureFileLevel& info = view.Level(level);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, GLsizei(info.width), GLsizei(info.height), 0, GLsizei(info.size), view.LevelData(level));
+		bytes += size_t(info.size);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, view.LevelCount() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, view.LevelCount() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	std::string name = image + " (" + BlockFormatName(view.Format()) + ")";
+	RecordStartupTiming("texture cooked", name, timer.ElapsedMilliseconds());
+	RecordTextureMemory(name, MipChainTexels(view.Width(), view.Height()) * 4, bytes);
+	return texture;
+}
+
+static struct
+{
+	struct Entry
+	{
+		std::string name;
+		size_t bytes_before;
+		size_t bytes_after;
+	};
+
+	std::mutex mutex;
+	std::vector<Entry> entries;
+} MemoryReport;
+
+void RecordTextureMemory(const std::string& name, size_t bytes_before, size_t bytes_after)
+{
+	std::lock_guard<std::mutex> lock(MemoryReport.mutex);
+	MemoryReport.entries.push_back({ name, bytes_before, bytes_after });
+}
+
+void PrintTextureMemoryReport()
+{
+	std::lock_guard<std::mutex> lock(MemoryReport.mutex);
+
+	std::cout << "Texture memory (KB, unsized GL_RGBA -> sized):" << std::endl;
+	for (const auto& entry : MemoryReport.entries)
+	{
+		long long saved = (long long)entry.bytes_before - (long long)entry.bytes_after;
+		std::cout << "  " << std::left << std::setw(40) << entry.name
+			<< std::right << std::setw(10) << entry.bytes_before / 1024 << " ->"
+			<< std::setw(10) << entry.bytes_after / 1024 << "  saved"
+			<< std::setw(10) << saved / 1024 << std::endl;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "GLAD/glad.h"
+#include "asset_archive.h"
+#include "mip_chain.h"
+#include "texture_compression.h"
+#include "texture_container.h"
+
+class PixelUploader;
+
+/* Sized internal format for 8 bit images, srgb only changes formats with color channels */
+GLenum SizedInternalFormat(int channels, bool srgb);
+
+/* Client pixel format matching the channel count */
+GLenum PixelFormat(int channels);
+
+/* Bytes per texel the format asks for, drivers may still pad 3 channel formats to 4 */
+size_t BytesPerTexel(GLenum internal_format);
+
+/*
+	Creates a 2D texture with a sized format and every mip level uploaded, the texture stays
+	bound. Records its build and upload times and its memory against unsized GL_RGBA.
+*/
+GLuint ImportTexture2D(const std::string& name, const unsigned char* pixels, int width, int height, int channels, bool srgb, PixelUploader& uploader);
+
+/*
+	Creates a cube map from six faces in GL order with every mip level uploaded. The texture
+	stays bound. Records like ImportTexture2D.
+*/
+GLuint ImportCubeMap(const std::string& name, const std::vector<std::vector<unsigned char>>& faces, int face_size, int channels, bool srgb, PixelUploader& uploader);
+
+/* GL internal format of a block format, 0 when the driver does not support it */
+GLenum CompressedInternalFormat(BlockFormat format);
+
+/*
+	Opens the cooked version of the image in the best block format the driver supports,
+	file keeps the mapping view points into. False when there is none.
+*/
+bool OpenCookedTexture(const std::string& directory, const std::string& image, AssetData& file, TextureFileView& view, GLenum& internal_format);
+
+/*
+	Looks for a cooked version of the image in the best block format the driver supports
+	and uploads every level straight from a memory mapping of the file. Returns 0 when
+	there is none, the caller then decodes the image instead. The texture stays bound.
+*/
+GLuint LoadCookedTexture(const std::string& directory, const std::string& image);
+
+/* Adds a line to the memory report, before is the unsized GL_RGBA footprint of the same levels */
+void RecordTextureMemory(const std::string& name, size_t bytes_before, size_t bytes_after);
+
+void PrintTextureMemoryReport();
@@ -0,0 +1,198 @@
+#include "texture_loader.h"
+
+#include <algorithm>
+#include <cstring>
+#include "asset_archive.h"
+#include "startup_report.h"
+#include "stb_image.h"
+
+/* Texture Loader */
+TextureLoader::TextureLoader(unsigned thread_count)
+	: stopping(false)
+{
+	if (thread_count == 0)
+		thread_count = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned i = 0; i < thread_count; ++i)
+		workers.emplace_back(&TextureLoader::Work, this);
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	job_queued.notify_all();
+
+	for (std::thread& worker : workers)
+		worker.join();
+
+	for (auto& job : jobs)
+		stbi_image_free(job->image.pixels);
+}
+
+TextureLoader::Request TextureLoader::Load(const std::string& filename, bool flip_vertically)
+{
+	std::unique_ptr<Job> job(new Job());
+	job->image.filename = filename;
+	job->flip_vertically = flip_vertically;
+	job->done = false;
+
+	Request request;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		request = jobs.size();
+		queue.push_back(job.get());
+		jobs.push_back(std::move(job));
+	}
+	job_queued.notify_one();
+
+	return request;
+}
+
+const DecodedImage& TextureLoader::Wait(Request request)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	Job& job = *jobs[request];
+	job_done.wait(lock, [&job] { return job.done; });
+	return job.image;
+}
+
+void TextureLoader::Release(Request request)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Job& job = *jobs[request];
+	stbi_image_free(job.image.pixels);
+	job.image.pixels = nullptr;
+}
+
+void TextureLoader::Work()
+{
+	for (;;)
+	{
+		Job* job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			job_queued.wait(lock, [this] { return stopping || !queue.empty(); });
+			if (queue.empty())
+				return;
+			job = queue.front();
+			queue.pop_front();
+		}
+
+		StartupTimer timer;
+		DecodedImage& image = job->image;
+
+		/* Decoded straight out of the archive mapping, or a mapping of the loose file */
+		AssetData file = OpenAsset(image.filename);
+		if (!file.IsValid())
+			image.failure_reason = "can't open";
+		else
+		{
+			/* The flip flag is thread local, every worker sets its own */
+			stbi_set_flip_vertically_on_load_thread(job->flip_vertically);
+			image.pixels = stbi_load_from_memory(file.Data(), int(file.Size()), &image.width, &image.height, &image.channels, 0);
+			if (image.pixels == nullptr)
+				image.failure_reason = stbi_failure_reason();
+		}
+
+		RecordStartupTiming("texture decode", image.filename, timer.ElapsedMilliseconds());
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job->done = true;
+		}
+		job_done.notify_all();
+	}
+}
+
+/* Pixel Uploader */
+PixelUploader::PixelUploader(size_t chunk_bytes, int buffer_count)
+	: chunk_bytes(chunk_bytes),
+	slots(buffer_count),
+	next_slot(0),
+	bytes_uploaded(0)
+{
+	for (Slot& slot : slots)
+	{
+		glGenBuffers(1, &slot.buffer);
+		slot.size = 0;
+		slot.fence = 0;
+	}
+}
+
+void PixelUploader::Finish()
+{
+	for (Slot& slot : slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	slots.clear();
+}
+
+void PixelUploader::Upload(GLenum target, GLuint texture, GLint level, GLint layer, int width, int height, GLenum format, int channels, const unsigned char* pixels)
+{
+	if (pixels == nullptr || width <= 0 || height <= 0)
+		return;
+
+	size_t row_bytes = size_t(width) * channels;
+	/* At least one row per chunk, even when a row is larger than a chunk */
+	int rows_per_chunk = int(std::max<size_t>(1, chunk_bytes / row_bytes));
+
+	bool cube_face = target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z;
+	glBindTexture(cube_face ? GL_TEXTURE_CUBE_MAP : target, texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for (int row = 0; row < height; row += rows_per_chunk)
+	{
+		int rows = std::min(rows_per_chunk, height - row);
+		size_t bytes = row_bytes * rows;
+
+		Slot& slot = slots[next_slot];
+		next_slot = (next_slot + 1) % slots.size();
+
+		/* Only waits when the ring wraps around before the GPU read the chunk */
+		if (slot.fence)
+		{
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(slot.fence);
+			slot.fence = 0;
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+		if (slot.size < bytes)
+		{
+			slot.size = std::max(bytes, chunk_bytes);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, slot.size, nullptr, GL_STREAM_DRAW);
+		}
+
+		void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (mapped == nullptr)
+		{
+			/* Falls back to a direct copy from client memory */
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (target == GL_TEXTURE_2D_ARRAY)
+				glTexSubImage3D(target, level, 0, row, layer, width, rows, 1, format, GL_UNSIGNED_BYTE, pixels + row * row_bytes);
+			else
+				glTexSubImage2D(target, level, 0, row, width, rows, format, GL_UNSIGNED_BYTE, pixels + row * row_bytes);
+			continue;
+		}
+		std::memcpy(mapped, pixels + row * row_bytes, bytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		/* With an unpack buffer bound the pointer is an offset into it */
+		if (target == GL_TEXTURE_2D_ARRAY)
+			glTexSubImage3D(target, level, 0, row, layer, width, rows, 1, format, GL_UNSIGNED_BYTE, nullptr);
+		else
+			glTexSubImage2D(target, level, 0, row, width, rows, format, GL_UNSIGNED_BYTE, nullptr);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		bytes_uploaded += bytes;
+	}
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GLAD/glad.h"
+
+/* A decoded image, the pixels belong to the loader until the request is released */
+struct DecodedImage
+{
+	std::string filename;
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	/* NULL when the file could not be read or decoded */
+	unsigned char* pixels = nullptr;
+	const char* failure_reason = nullptr;
+};
+
+/*
+	Texture Loader: decodes images with stb_image on worker threads as soon as they are
+	requested, so every image decodes while the earlier ones are uploaded. Files are opened
+	through OpenAsset and decoded from the mapping. Decode times go to the startup report.
+*/
+class TextureLoader
+{
+public:
+	typedef size_t Request;
+
+	/* 0 threads uses one per hardware thread */
+	explicit TextureLoader(unsigned thread_count = 0);
+	~TextureLoader();
+
+	/* flip_vertically matches stbi_set_flip_vertically_on_load */
+	Request Load(const std::string& filename, bool flip_vertically);
+
+	/* Blocks until the image is decoded */
+	const DecodedImage& Wait(Request request);
+
+	/* Frees the decoded pixels */
+	void Release(Request request);
+
+private:
+	struct Job
+	{
+		DecodedImage image;
+		bool flip_vertically;
+		bool done;
+	};
+
+	void Work();
+
+	std::mutex mutex;
+	std::condition_variable job_queued;
+	std::condition_variable job_done;
+	std::vector<std::unique_ptr<Job>> jobs;
+	std::deque<Job*> queue;
+	std::vector<std::thread> workers;
+	bool stopping;
+};
+
+/*
+	Pixel Uploader: copies pixels to textures through a ring of pixel buffer objects in
+	chunks of whole rows. glTexSubImage reads each chunk from the buffer asynchronously
+	while the CPU fills the next one, a fence per buffer keeps it from being overwritten
+	before the GPU is done with it.
+*/
+class PixelUploader
+{
+public:
+	/* Must be constructed with a current context */
+	PixelUploader(size_t chunk_bytes, int buffer_count);
+
+	/* Deletes the buffers once loading is done, the uploader is unusable afterwards */
+	void Finish();
+
+	/* The level must be allocated already, layer is only used by GL_TEXTURE_2D_ARRAY, cube maps pass the face as target */
+	void Upload(GLenum target, GLuint texture, GLint level, GLint layer, int width, int height, GLenum format, int channels, const unsigned char* pixels);
+
+	size_t BytesUploaded() const { return bytes_uploaded; }
+
+private:
+	struct Slot
+	{
+		GLuint buffer;
+		size_t size;
+		GLsync fence;
+	};
+
+	size_t chunk_bytes;
+	std::vector<Slot> slots;
+	size_t next_slot;
+	size_t bytes_uploaded;
+};
@@ -0,0 +1,496 @@
+#include "texture_streaming.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "mip_chain.h"
+#include "stb_image.h"
+#include "texture_array.h"
+#include "texture_import.h"
+
+/* Levels up to this size are drawn on the first frame */
+static const int preview_size = 64;
+
+static const unsigned char preview_identifier[8] = { 0xAB, 'M', 'P', 'V', ' ', '1', 0xBB, '\n' };
+
+/* A single mip level of an image, written by one launch for the next */
+struct PreviewHeader
+{
+	unsigned char identifier[8];
+	/* Size of the source file, a changed image invalidates its preview */
+	uint64_t source_bytes;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t level;
+	uint32_t level_width;
+	uint32_t level_height;
+};
+
+/* The finest level no larger than preview_size */
+static int PreviewLevel(int width, int height)
+{
+	int level = 0;
+	while (std::max(width, height) > preview_size)
+	{
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		++level;
+	}
+	return level;
+}
+
+static uint64_t FileBytes(const std::string& path)
+{
+	return OpenAsset(path).Size();
+}
+
+static std::string PreviewPath(const std::string& directory, const std::string& image)
+{
+	return directory + "/" + image + ".preview";
+}
+
+/* Empty when there is no preview matching the image and the expected layout */
+static std::vector<unsigned char> ReadPreview(const std::string& directory, const std::string& image, int width, int height, int channels, int level)
+{
+	std::ifstream file(PreviewPath(directory, image), std::ios::binary);
+	PreviewHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return std::vector<unsigned char>();
+
+	int level_width, level_height;
+	MipLevelSize(width, height, level, level_width, level_height);
+	if (std::memcmp(header.identifier, preview_identifier, sizeof(preview_identifier)) != 0 ||
+		header.source_bytes != FileBytes(image) ||
+		header.width != uint32_t(width) || header.height != uint32_t(height) || header.channels != uint32_t(channels) ||
+		header.level != uint32_t(level) || header.level_width != uint32_t(level_width) || header.level_height != uint32_t(level_height))
+		return std::vector<unsigned char>();
+
+	std::vector<unsigned char> pixels(size_t(level_width) * level_height * channels);
+	if (!file.read(reinterpret_cast<char*>(pixels.data()), std::streamsize(pixels.size())))
+		return std::vector<unsigned char>();
+	return pixels;
+}
+
+static void WritePreview(const std::string& directory, const std::string& image, int width, int height, int channels, int level, const std::vector<unsigned char>& pixels)
+{
+	PreviewHeader header;
+	std::memcpy(header.identifier, preview_identifier, sizeof(header.identifier));
+	header.source_bytes = FileBytes(image);
+	header.width = uint32_t(width);
+	header.height = uint32_t(height);
+	header.channels = uint32_t(channels);
+	header.level = uint32_t(level);
+	int level_width, level_height;
+	MipLevelSize(width, height, level, level_width, level_height);
+	header.level_width = uint32_t(level_width);
+	header.level_height = uint32_t(level_height);
+
+	std::ofstream file(PreviewPath(directory, image), std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(pixels.data()), std::streamsize(pixels.size()));
+}
+
+/* Texture Streamer */
+TextureStreamer::TextureStreamer(TextureLoader& loader, const std::string& preview_directory, size_t bytes_per_frame)
+	: loader(loader),
+	preview_directory(preview_directory),
+	bytes_per_frame(bytes_per_frame),
+	uploader(std::min<size_t>(bytes_per_frame, 4 << 20), 3),
+	bytes_streamed(0),
+	next_to_prepare(0),
+	stopping(false)
+{
+#ifdef _WIN32
+	_mkdir(preview_directory.c_str());
+#else
+	mkdir(preview_directory.c_str(), 0755);
+#endif
+	preparer = std::thread(&TextureStreamer::Prepare, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	texture_added.notify_all();
+	preparer.join();
+
+	/* Textures still streaming when the game closes, Update already did this for the rest */
+	uploader.Finish();
+}
+
+GLuint TextureStreamer::LoadCooked(const std::string& directory, const std::string& image)
+{
+	StartupTimer preview_timer;
+	AssetData file;
+	TextureFileView view;
+	GLenum internal_format;
+	if (!OpenCookedTexture(directory, image, file, view, internal_format))
+		return 0;
+
+	std::unique_ptr<Texture> texture(new Texture());
+	texture->name = image + " (" + BlockFormatName(view.Format()) + ")";
+	texture->target = GL_TEXTURE_2D;
+	texture->width = view.Width();
+	texture->height = view.Height();
+	texture->layers = 1;
+	texture->level_count = view.LevelCount();
+	texture->internal_format = internal_format;
+	texture->format = 0;
+	texture->channels = view.SourceChannels();
+	texture->compressed = true;
+	texture->tail_uploaded = true;
+	texture->prepared = true;
+	texture->failed = false;
+
+	/* The small levels are the first bytes of the file */
+	int preview_level = PreviewLevel(texture->width, texture->height);
+	glGenTextures(1, &texture->id);
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+	size_t bytes = 0;
+	for (int level = texture->level_count - 1; level >= preview_level; --level)
+	{
+		const TextureFileLevel& info = view.Level(level);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, internal_format, GLsizei(info.width), GLsizei(info.height), 0, GLsizei(info.size), view.LevelData(level));
+	}
+	for (int level = 0; level < texture->level_count; ++level)
+		bytes += size_t(view.Level(level).size);
+
+	texture->base_level = preview_level;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, preview_level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->level_count - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	texture->file = std::move(file);
+	texture->view = view;
+
+	RecordStartupTiming("texture preview", texture->name, preview_timer.ElapsedMilliseconds());
+	RecordTextureMemory(texture->name, MipChainTexels(texture->width, texture->height) * 4, bytes);
+
+	GLuint id = texture->id;
+	std::lock_guard<std::mutex> lock(mutex);
+	textures.push_back(std::move(texture));
+	return id;
+}
+
+GLuint TextureStreamer::Load2D(const std::string& image)
+{
+	StartupTimer preview_timer;
+
+	/* Only the header is read here, the decode runs on the loader threads */
+	int width, height, channels;
+	AssetData file = OpenAsset(image);
+	bool readable = file.IsValid() && stbi_info_from_memory(file.Data(), int(file.Size()), &width, &height, &channels) != 0;
+	if (!readable)
+	{
+		std::cout << "Texture " << image << " failed to load." << std::endl;
+		std::cout << "Error: " << (file.IsValid() ? stbi_failure_reason() : "can't open") << std::endl;
+		width = height = 1;
+		channels = 3;
+	}
+
+	std::unique_ptr<Texture> texture(new Texture());
+	texture->name = image;
+	texture->target = GL_TEXTURE_2D;
+	texture->width = width;
+	texture->height = height;
+	texture->layers = 1;
+	texture->level_count = MipLevelCount(width, height);
+	texture->internal_format = SizedInternalFormat(channels, false);
+	texture->format = PixelFormat(channels);
+	texture->channels = channels;
+	texture->compressed = false;
+	texture->tail_uploaded = false;
+	texture->prepared = !readable;
+	texture->failed = !readable;
+
+	glGenTextures(1, &texture->id);
+	glBindTexture(GL_TEXTURE_2D, texture->id);
+	for (int level = 0; level < texture->level_count; ++level)
+	{
+		int level_width, level_height;
+		MipLevelSize(width, height, level, level_width, level_height);
+		glTexImage2D(GL_TEXTURE_2D, level, texture->internal_format, level_width, level_height, 0, texture->format, GL_UNSIGNED_BYTE, NULL);
+	}
+
+	int preview_level = PreviewLevel(width, height);
+	int preview_width, preview_height;
+	MipLevelSize(width, height, preview_level, preview_width, preview_height);
+	std::vector<unsigned char> preview = ReadPreview(preview_directory, image, width, height, channels, preview_level);
+	if (preview.empty())
+		preview.assign(size_t(preview_width) * preview_height * channels, 128);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, preview_level, 0, 0, preview_width, preview_height, texture->format, GL_UNSIGNED_BYTE, preview.data());
+
+	texture->base_level = preview_level;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, preview_level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, preview_level);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	if (readable)
+		texture->requests.push_back(loader.Load(image, true));
+
+	RecordStartupTiming("texture preview", image, preview_timer.ElapsedMilliseconds());
+	size_t texels = MipChainTexels(width, height);
+	RecordTextureMemory(image, texels * 4, texels * BytesPerTexel(texture->internal_format));
+
+	GLuint id = texture->id;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		textures.push_back(std::move(texture));
+	}
+	texture_added.notify_one();
+	return id;
+}
+
+GLuint TextureStreamer::LoadArray(const std::vector<std::string>& images)
+{
+	StartupTimer preview_timer;
+
+	int width = 1, height = 1, channels;
+	AssetData file = images.empty() ? AssetData() : OpenAsset(images[0]);
+	if (!file.IsValid() || !stbi_info_from_memory(file.Data(), int(file.Size()), &width, &height, &channels))
+		width = height = 1;
+
+	std::unique_ptr<Texture> texture(new Texture());
+	texture->name = images.empty() ? "texture array" : images[0] + " array";
+	texture->target = GL_TEXTURE_2D_ARRAY;
+	texture->width = width;
+	texture->height = height;
+	texture->layers = std::max<int>(1, int(images.size()));
+	texture->level_count = MipLevelCount(width, height);
+	texture->internal_format = GL_RGBA8;
+	texture->format = GL_RGBA;
+	texture->channels = 4;
+	texture->compressed = false;
+	texture->tail_uploaded = false;
+	texture->prepared = false;
+	texture->failed = false;
+
+	glGenTextures(1, &texture->id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture->id);
+	for (int level = 0; level < texture->level_count; ++level)
+	{
+		int level_width, level_height;
+		MipLevelSize(width, height, level, level_width, level_height);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, level_width, level_height, texture->layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	}
+
+	int preview_level = PreviewLevel(width, height);
+	int preview_width, preview_height;
+	MipLevelSize(width, height, preview_level, preview_width, preview_height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (size_t layer = 0; layer < images.size(); ++layer)
+	{
+		std::vector<unsigned char> preview = ReadPreview(preview_directory, images[layer], width, height, 4, preview_level);
+		if (preview.empty())
+			preview.assign(size_t(preview_width) * preview_height * 4, 128);
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, preview_level, 0, 0, GLint(layer), preview_width, preview_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, preview.data());
+
+		texture->requests.push_back(loader.Load(images[layer], true));
+	}
+
+	texture->base_level = preview_level;
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, preview_level);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, preview_level);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	RecordStartupTiming("texture preview", texture->name, preview_timer.ElapsedMilliseconds());
+	size_t texels = MipChainTexels(width, height) * texture->layers;
+	RecordTextureMemory(texture->name, texels * 4, texels * 4);
+
+	texture->images = images;
+
+	GLuint id = texture->id;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		textures.push_back(std::move(texture));
+	}
+	texture_added.notify_one();
+	return id;
+}
+
+bool TextureStreamer::Complete(const Texture& texture)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!texture.prepared)
+			return false;
+	}
+	/* The preparation thread is done with the texture once it is prepared */
+	return texture.failed || (texture.tail_uploaded && texture.base_level == 0);
+}
+
+bool TextureStreamer::Update()
+{
+	size_t bytes = 0;
+
+	/* One level per texture per round, so every texture sharpens at the same pace */
+	for (bool progress = true; progress && bytes < bytes_per_frame;)
+	{
+		progress = false;
+		for (auto& texture : textures)
+		{
+			if (bytes >= bytes_per_frame)
+				break;
+			bool prepared;
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				prepared = texture->prepared;
+			}
+			if (!prepared || Complete(*texture))
+				continue;
+
+			bytes += UploadNext(*texture);
+			progress = true;
+		}
+	}
+	bytes_streamed += bytes;
+
+	for (auto& texture : textures)
+		if (!Complete(*texture))
+			return true;
+
+	uploader.Finish();
+	std::cout << "Textures complete after " << timer.ElapsedMilliseconds() << " ms, "
+		<< bytes_streamed / 1024 << " KB streamed" << std::endl;
+	return false;
+}
+
+size_t TextureStreamer::UploadNext(Texture& texture)
+{
+	glBindTexture(texture.target, texture.id);
+
+	if (texture.compressed)
+	{
+		int level = texture.base_level - 1;
+		const TextureFileLevel& info = texture.view.Level(level);
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.internal_format, GLsizei(info.width), GLsizei(info.height), 0, GLsizei(info.size), texture.view.LevelData(level));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+		texture.base_level = level;
+
+		/* info points into the mapping, read it before the last level releases the file */
+		size_t bytes = size_t(info.size);
+		if (level == 0)
+			texture.file = AssetData();
+		return bytes;
+	}
+
+	auto uploadLevel = [&](int level) -> size_t
+	{
+		int level_width, level_height;
+		MipLevelSize(texture.width, texture.height, level, level_width, level_height);
+		for (int layer = 0; layer < texture.layers; ++layer)
+			uploader.Upload(texture.target, texture.id, level, layer, level_width, level_height, texture.format, texture.channels, texture.levels[level][layer].data());
+		std::vector<std::vector<unsigned char>>().swap(texture.levels[level]);
+		return size_t(level_width) * level_height * texture.channels * texture.layers;
+	};
+
+	/* The levels below the preview are tiny, they come in together with the preview level replaced */
+	if (!texture.tail_uploaded)
+	{
+		size_t bytes = 0;
+		for (int level = texture.level_count - 1; level >= texture.base_level; --level)
+			bytes += uploadLevel(level);
+		glBindTexture(texture.target, texture.id);
+		glTexParameteri(texture.target, GL_TEXTURE_MAX_LEVEL, texture.level_count - 1);
+		texture.tail_uploaded = true;
+		return bytes;
+	}
+
+	int level = texture.base_level - 1;
+	size_t bytes = uploadLevel(level);
+	glBindTexture(texture.target, texture.id);
+	glTexParameteri(texture.target, GL_TEXTURE_BASE_LEVEL, level);
+	texture.base_level = level;
+	return bytes;
+}
+
+void TextureStreamer::Prepare()
+{
+	for (;;)
+	{
+		Texture* texture;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			texture_added.wait(lock, [this] { return stopping || next_to_prepare < textures.size(); });
+			if (stopping)
+				return;
+			texture = textures[next_to_prepare++].get();
+		}
+
+		if (!texture->prepared)
+			PrepareTexture(*texture);
+	}
+}
+
+void TextureStreamer::PrepareTexture(Texture& texture)
+{
+	std::vector<std::vector<unsigned char>> base(texture.layers);
+	bool failed = false;
+
+	for (int layer = 0; layer < texture.layers; ++layer)
+	{
+		const DecodedImage& image = loader.Wait(texture.requests[layer]);
+		if (image.pixels == nullptr)
+		{
+			std::cout << "Texture " << image.filename << " failed to load." << std::endl;
+			std::cout << "Error: " << image.failure_reason << std::endl;
+		}
+
+		if (texture.target == GL_TEXTURE_2D_ARRAY)
+		{
+			/* Like TextureArray::AddLayer, a failed layer stays black */
+			if (image.pixels)
+				base[layer] = ResampleToRGBA(image.pixels, image.width, image.height, image.channels, texture.width, texture.height);
+			else
+				base[layer].assign(size_t(texture.width) * texture.height * 4, 0);
+		}
+		else if (image.pixels && image.width == texture.width && image.height == texture.height && image.channels == texture.channels)
+			base[layer].assign(image.pixels, image.pixels + size_t(image.width) * image.height * image.channels);
+		else
+			failed = true;
+
+		loader.Release(texture.requests[layer]);
+	}
+
+	std::vector<std::vector<std::vector<unsigned char>>> levels(texture.level_count, std::vector<std::vector<unsigned char>>(texture.layers));
+	if (!failed)
+	{
+		int preview_level = PreviewLevel(texture.width, texture.height);
+		for (int layer = 0; layer < texture.layers; ++layer)
+		{
+			std::vector<MipLevel> mips = BuildMipChain(base[layer].data(), texture.width, texture.height, texture.channels);
+			levels[0][layer] = std::move(base[layer]);
+			for (size_t i = 0; i < mips.size(); ++i)
+				levels[i + 1][layer] = std::move(mips[i].pixels);
+
+			const std::string& image = texture.target == GL_TEXTURE_2D_ARRAY ? texture.images[layer] : texture.name;
+			WritePreview(preview_directory, image, texture.width, texture.height, texture.channels, preview_level, levels[preview_level][layer]);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	texture.levels = std::move(levels);
+	texture.requests.clear();
+	texture.failed = failed;
+	texture.prepared = true;
+}
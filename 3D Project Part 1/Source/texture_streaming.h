@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GLAD/glad.h"
+#include "asset_archive.h"
+#include "startup_report.h"
+#include "texture_container.h"
+#include "texture_loader.h"
+
+/*
+	Texture Streamer: textures that can be drawn right away at a small mip level and gain
+	their finer levels over the following frames, coarse to fine. GL_TEXTURE_BASE_LEVEL and
+	GL_TEXTURE_MAX_LEVEL keep sampling inside the levels that have arrived.
+	- Cooked textures upload their small levels straight from the mapping, the finer ones
+	  follow from the same mapping.
+	- Decoded images start with the preview level an earlier launch stored, or a flat grey
+	  level the first time. A preparation thread waits for the decode, builds the mips
+	  (resampled to the array size for array layers) and stores the preview for next time.
+	- Update uploads finished levels within a byte budget per frame.
+*/
+class TextureStreamer
+{
+public:
+	/* Must be constructed with a current context, the loader has to outlive the streamer */
+	TextureStreamer(TextureLoader& loader, const std::string& preview_directory, size_t bytes_per_frame);
+	/* Deletes the upload buffers, destroy it before the context */
+	~TextureStreamer();
+
+	/* The cooked image in the best supported block format, 0 when there is none */
+	GLuint LoadCooked(const std::string& directory, const std::string& image);
+
+	/* Always returns a texture, it stays at its preview when the image fails to load */
+	GLuint Load2D(const std::string& image);
+
+	/* One RGBA layer per image, in order, all resampled to the size of the first image */
+	GLuint LoadArray(const std::vector<std::string>& images);
+
+	/* Uploads the next levels, false once every texture is complete */
+	bool Update();
+
+	size_t BytesStreamed() const { return bytes_streamed; }
+
+private:
+	struct Texture
+	{
+		std::string name;
+		GLenum target;
+		GLuint id;
+		int width;
+		int height;
+		int layers;
+		int level_count;
+		GLenum internal_format;
+		GLenum format;
+		int channels;
+		bool compressed;
+
+		/* The finest level sampled so far, 0 once complete */
+		int base_level;
+		/* Levels coarser than the preview are uploaded together when the data arrives */
+		bool tail_uploaded;
+
+		/* Array layers, in order */
+		std::vector<std::string> images;
+
+		AssetData file;
+		TextureFileView view;
+
+		/* Decoded textures, filled by the preparation thread, [level][layer] */
+		std::vector<TextureLoader::Request> requests;
+		bool prepared;
+		bool failed;
+		std::vector<std::vector<std::vector<unsigned char>>> levels;
+	};
+
+	bool Complete(const Texture& texture);
+	void Prepare();
+	void PrepareTexture(Texture& texture);
+	size_t UploadNext(Texture& texture);
+
+	TextureLoader& loader;
+	std::string preview_directory;
+	size_t bytes_per_frame;
+	PixelUploader uploader;
+	StartupTimer timer;
+	size_t bytes_streamed;
+
+	std::vector<std::unique_ptr<Texture>> textures;
+
+	std::mutex mutex;
+	std::condition_variable texture_added;
+	size_t next_to_prepare;
+	std::thread preparer;
+	bool stopping;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+
+/*
+	Triple Buffer: hands the latest of a stream of values from one writing thread to one
+	reading thread without locks. The writer fills the back slot and swaps it with the
+	middle one, the reader swaps the middle one with its front slot when a newer value
+	has been published since. Neither side ever waits, values the reader is too slow
+	for are skipped, and the reader keeps its front value for as long as it likes.
+*/
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: middle(1),
+		back(2),
+		front(0)
+	{
+	}
+
+	/* Writer: the slot to fill, it holds whatever was there three publishes ago */
+	T& Back() { return slots[back]; }
+	void Publish() { back = middle.exchange(back | fresh) & index_mask; }
+
+	/* Reader: moves to the newest published value, if any, and returns it */
+	const T& Read()
+	{
+		if (middle.load() & fresh)
+			front = middle.exchange(front) & index_mask;
+		return slots[front];
+	}
+
+private:
+	/* The middle index carries a flag that is set by every publish and cleared by the reader */
+	static const unsigned fresh = 4;
+	static const unsigned index_mask = 3;
+
+	T slots[3];
+	std::atomic<unsigned> middle;
+	/* Only ever touched by their own side */
+	unsigned back;
+	unsigned front;
+};
@@ -0,0 +1,497 @@
+#include "virtual_texture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include "GLM/gtc/type_ptr.hpp"
+
+/* Tiles copied into the cache per frame, each one is about 72 KB at 128 texels plus borders */
+static const size_t upload_budget = 16;
+
+/* Older requests are dropped once the camera moved on, they are asked for again if still needed */
+static const size_t max_queued_tiles = 256;
+
+/* The feedback target is this many times smaller than the screen in each direction */
+static const int feedback_divisor = 8;
+
+/* Never evicted, the coarsest level is the fallback for every other tile */
+static const uint64_t pinned = std::numeric_limits<uint64_t>::max();
+
+static const char* feedback_vertex_source = R"VERTEX(
+#version 330 core
+
+layout(location = 0) in vec3 a_position;
+layout(location = 2) in vec2 a_uvs;
+
+uniform mat4 u_transform;
+
+out vec2 vertex_uvs;
+
+void main()
+{
+	gl_Position = u_transform * vec4(a_position, 1);
+	vertex_uvs = a_uvs;
+}
+)VERTEX";
+
+/* Same level and tile selection as SampleVirtualTexture in the scene shader */
+static const char* feedback_fragment_source = R"FRAGMENT(
+#version 330 core
+
+uniform vec2 u_vt_size;
+uniform float u_vt_tile_size;
+uniform int u_vt_max_level;
+uniform float u_lod_bias;
+
+in vec2 vertex_uvs;
+
+out uvec4 out_request;
+
+void main()
+{
+	vec2 texel = vertex_uvs * u_vt_size;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + u_lod_bias;
+	int level = clamp(int(floor(lod)), 0, u_vt_max_level);
+
+	vec2 level_size = max(floor(u_vt_size / exp2(float(level))), vec2(1));
+	ivec2 tiles = ivec2(ceil(level_size / u_vt_tile_size));
+	ivec2 tile = clamp(ivec2(fract(vertex_uvs) * level_size / u_vt_tile_size), ivec2(0), tiles - 1);
+
+	/* Alpha marks the pixel as covered, cleared pixels stay zero */
+	out_request = uvec4(tile, level, 1);
+}
+)FRAGMENT";
+
+/* Virtual Texture */
+VirtualTexture::VirtualTexture(const std::string& page_file, int cache_tiles_per_side)
+	: valid(false),
+	cache_tiles_per_side(cache_tiles_per_side),
+	cache_texture(0),
+	indirection_texture(0),
+	indirection_width(0),
+	indirection_dirty(true),
+	frame(1),
+	feedback_program(0),
+	feedback_transform_location(-1),
+	feedback_framebuffer(0),
+	feedback_color(0),
+	feedback_depth(0),
+	feedback_size(0),
+	readback_buffers{ 0, 0 },
+	readback_fences{ 0, 0 },
+	readback_sizes{ glm::ivec2(0), glm::ivec2(0) },
+	readback_index(0),
+	stopping(false)
+{
+	file = OpenAsset(page_file);
+	if (!pages.Parse(file.Data(), file.Size()))
+	{
+		std::cout << "Virtual texture " << page_file << " is missing or not a page file." << std::endl;
+		return;
+	}
+
+	const PageFileHeader& header = pages.Header();
+	int padded = pages.PaddedTileSize();
+	int cache_size = cache_tiles_per_side * padded;
+
+	GLint max_texture_size = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture_size);
+	if (cache_size > max_texture_size)
+	{
+		std::cout << "Virtual texture cache of " << cache_size << " texels is larger than the GL limit." << std::endl;
+		return;
+	}
+
+	/* Physical cache, borders are part of every slot so plain bilinear filtering never crosses into a neighbour */
+	glGenTextures(1, &cache_texture);
+	glBindTexture(GL_TEXTURE_2D, cache_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cache_size, cache_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	/* Indirection levels sit side by side, each one tiles_x wide, level 0 sets the height */
+	for (int level = 0; level < pages.LevelCount(); ++level)
+	{
+		level_offsets.push_back(indirection_width);
+		indirection_width += int(pages.Level(level).tiles_x);
+	}
+	int indirection_height = int(pages.Level(0).tiles_y);
+	indirection.assign(size_t(indirection_width) * indirection_height * 4, 0);
+
+	glGenTextures(1, &indirection_texture);
+	glBindTexture(GL_TEXTURE_2D, indirection_texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, indirection_width, indirection_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	tile_slots.assign(pages.TileCount(), -1);
+	tile_pending.assign(pages.TileCount(), 0);
+	slots.assign(size_t(cache_tiles_per_side) * cache_tiles_per_side, Slot{ -1, 0 });
+
+	feedback_program = CreateProgramFromSources(feedback_vertex_source, feedback_fragment_source);
+	feedback_transform_location = glGetUniformLocation(feedback_program, "u_transform");
+	glUseProgram(feedback_program);
+	glUniform2f(glGetUniformLocation(feedback_program, "u_vt_size"), float(header.width), float(header.height));
+	glUniform1f(glGetUniformLocation(feedback_program, "u_vt_tile_size"), float(header.tile_size));
+	glUniform1i(glGetUniformLocation(feedback_program, "u_vt_max_level"), pages.LevelCount() - 1);
+
+	glGenFramebuffers(1, &feedback_framebuffer);
+	glGenTextures(1, &feedback_color);
+	glGenRenderbuffers(1, &feedback_depth);
+	glGenBuffers(2, readback_buffers);
+
+	/* The coarsest level loads right away and is pinned */
+	int coarsest = pages.LevelCount() - 1;
+	const PageFileLevel& top = pages.Level(coarsest);
+	for (uint32_t y = 0; y < top.tiles_y; ++y)
+		for (uint32_t x = 0; x < top.tiles_x; ++x)
+		{
+			uint64_t tile = pages.TileIndex(coarsest, x, y);
+			UploadTile(tile, pages.TileData(tile));
+			if (tile_slots[tile] >= 0)
+				slots[tile_slots[tile]].last_used = pinned;
+		}
+	RebuildIndirection();
+
+	valid = true;
+	streamer = std::thread(&VirtualTexture::Stream, this);
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	tile_requested.notify_all();
+
+	if (streamer.joinable())
+		streamer.join();
+
+	/* Names that were never created are 0, which GL ignores */
+	for (GLsync fence : readback_fences)
+		glDeleteSync(fence);
+	glDeleteBuffers(2, readback_buffers);
+	glDeleteRenderbuffers(1, &feedback_depth);
+	glDeleteTextures(1, &feedback_color);
+	glDeleteFramebuffers(1, &feedback_framebuffer);
+	glDeleteProgram(feedback_program);
+	glDeleteTextures(1, &indirection_texture);
+	glDeleteTextures(1, &cache_texture);
+}
+
+size_t VirtualTexture::MemoryBytes() const
+{
+	size_t cache_size = size_t(cache_tiles_per_side) * pages.PaddedTileSize();
+	return cache_size * cache_size * 4 + indirection.size();
+}
+
+void VirtualTexture::SetupProgram(GLuint program) const
+{
+	const PageFileHeader& header = pages.Header();
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "u_texture"), 0);
+	glUniform1i(glGetUniformLocation(program, "u_indirection"), 1);
+	glUniform2f(glGetUniformLocation(program, "u_vt_size"), float(header.width), float(header.height));
+	glUniform1f(glGetUniformLocation(program, "u_vt_tile_size"), float(header.tile_size));
+	glUniform1f(glGetUniformLocation(program, "u_vt_border"), float(header.border));
+	glUniform1f(glGetUniformLocation(program, "u_vt_cache_size"), float(cache_tiles_per_side * pages.PaddedTileSize()));
+	glUniform1i(glGetUniformLocation(program, "u_vt_max_level"), pages.LevelCount() - 1);
+	glUniform1iv(glGetUniformLocation(program, "u_vt_level_offset"), GLsizei(level_offsets.size()), level_offsets.data());
+}
+
+void VirtualTexture::RenderFeedback(const VAO& mesh, const glm::mat4& transform, glm::ivec2 screen_dimensions)
+{
+	if (!valid)
+		return;
+
+	glm::ivec2 size = glm::max(screen_dimensions / feedback_divisor, glm::ivec2(1));
+	if (size != feedback_size)
+	{
+		feedback_size = size;
+
+		glBindTexture(GL_TEXTURE_2D, feedback_color);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, size.x, size.y, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, feedback_depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.x, size.y);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, feedback_framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedback_color, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback_depth);
+
+		/* Derivatives are feedback_divisor times larger than on screen */
+		glUseProgram(feedback_program);
+		glUniform1f(glGetUniformLocation(feedback_program, "u_lod_bias"), -std::log2(float(screen_dimensions.x) / size.x));
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, feedback_framebuffer);
+	glViewport(0, 0, size.x, size.y);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glDisable(GL_BLEND);
+
+	const GLuint clear_request[4] = { 0, 0, 0, 0 };
+	glClearBufferuiv(GL_COLOR, 0, clear_request);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	glUseProgram(feedback_program);
+	glUniformMatrix4fv(feedback_transform_location, 1, GL_FALSE, glm::value_ptr(transform));
+	glBindVertexArray(mesh.id);
+	glDrawElements(GL_TRIANGLES, mesh.element_array_count, GL_UNSIGNED_INT, NULL);
+
+	/* Read back asynchronously, Update maps it a frame later */
+	int index = readback_index;
+	size_t bytes = size_t(size.x) * size.y * 4 * sizeof(uint16_t);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffers[index]);
+	if (readback_sizes[index] != size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		readback_sizes[index] = size;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT, 2);
+	glReadPixels(0, 0, size.x, size.y, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (readback_fences[index])
+		glDeleteSync(readback_fences[index]);
+	readback_fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readback_index ^= 1;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, screen_dimensions.x, screen_dimensions.y);
+}
+
+VirtualTexture::Stats VirtualTexture::Update()
+{
+	Stats stats = {};
+	if (!valid)
+		return stats;
+
+	/* After RenderFeedback flipped the index it points at the older readback */
+	int index = readback_index;
+	if (readback_fences[index])
+	{
+		GLenum status = glClientWaitSync(readback_fences[index], 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(readback_fences[index]);
+			readback_fences[index] = 0;
+
+			glm::ivec2 size = readback_sizes[index];
+			size_t count = size_t(size.x) * size.y;
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readback_buffers[index]);
+			const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+			if (mapped)
+				ProcessFeedback(static_cast<const uint16_t*>(mapped), count, stats);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+	}
+
+	std::vector<StreamedTile> ready;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t take = std::min(upload_budget, streamed.size());
+		ready.assign(std::make_move_iterator(streamed.begin()), std::make_move_iterator(streamed.begin() + take));
+		streamed.erase(streamed.begin(), streamed.begin() + take);
+	}
+
+	for (StreamedTile& tile : ready)
+	{
+		UploadTile(tile.tile, tile.texels.data());
+		tile_pending[tile.tile] = 0;
+		stats.bytes_uploaded += tile.texels.size();
+	}
+
+	if (indirection_dirty)
+		RebuildIndirection();
+
+	for (const Slot& slot : slots)
+		if (slot.tile >= 0)
+			++stats.resident_tiles;
+	stats.cache_slots = slots.size();
+
+	++frame;
+	return stats;
+}
+
+void VirtualTexture::ProcessFeedback(const uint16_t* texels, size_t count, Stats& stats)
+{
+	std::vector<uint64_t> requested;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const uint16_t* request = texels + i * 4;
+		if (request[3] == 0)
+			continue;
+
+		int level = std::min<int>(request[2], pages.LevelCount() - 1);
+		const PageFileLevel& info = pages.Level(level);
+		if (request[0] >= info.tiles_x || request[1] >= info.tiles_y)
+			continue;
+		requested.push_back(pages.TileIndex(level, request[0], request[1]));
+	}
+
+	std::sort(requested.begin(), requested.end());
+	requested.erase(std::unique(requested.begin(), requested.end()), requested.end());
+	stats.requested_tiles = requested.size();
+
+	/* Coarser levels have larger indices and stream first, they fill in more of the screen per tile */
+	std::vector<uint64_t> missing;
+	for (auto it = requested.rbegin(); it != requested.rend(); ++it)
+	{
+		uint64_t tile = *it;
+		if (tile_slots[tile] >= 0)
+		{
+			Slot& slot = slots[tile_slots[tile]];
+			if (slot.last_used != pinned)
+				slot.last_used = frame;
+			continue;
+		}
+
+		++stats.missed_tiles;
+		if (!tile_pending[tile])
+			missing.push_back(tile);
+	}
+
+	if (missing.empty())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (uint64_t tile : missing)
+		{
+			tile_pending[tile] = 1;
+			stream_queue.push_front(tile);
+		}
+		/* missing was pushed in reverse, restore coarse first at the front */
+		std::reverse(stream_queue.begin(), stream_queue.begin() + missing.size());
+
+		while (stream_queue.size() > max_queued_tiles)
+		{
+			tile_pending[stream_queue.back()] = 0;
+			stream_queue.pop_back();
+		}
+	}
+	tile_requested.notify_one();
+}
+
+void VirtualTexture::Stream()
+{
+	for (;;)
+	{
+		uint64_t tile;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			tile_requested.wait(lock, [this] { return stopping || !stream_queue.empty(); });
+			if (stopping)
+				return;
+
+			tile = stream_queue.front();
+			stream_queue.pop_front();
+		}
+
+		/* Touching the mapping is what pages the tile in from disk, kept off the render thread */
+		StreamedTile streamed_tile;
+		streamed_tile.tile = tile;
+		const unsigned char* texels = pages.TileData(tile);
+		streamed_tile.texels.assign(texels, texels + pages.TileBytes());
+
+		std::lock_guard<std::mutex> lock(mutex);
+		streamed.push_back(std::move(streamed_tile));
+	}
+}
+
+void VirtualTexture::UploadTile(uint64_t tile, const unsigned char* texels)
+{
+	if (tile_slots[tile] >= 0)
+		return;
+
+	/* A free slot, otherwise the least recently used one */
+	size_t victim = 0;
+	for (size_t i = 0; i < slots.size(); ++i)
+	{
+		if (slots[i].tile < 0)
+		{
+			victim = i;
+			break;
+		}
+		if (slots[i].last_used < slots[victim].last_used)
+			victim = i;
+	}
+
+	Slot& slot = slots[victim];
+	/* Everything resident was seen this frame, evicting would only thrash */
+	if (slot.tile >= 0 && (slot.last_used == pinned || slot.last_used >= frame))
+		return;
+
+	if (slot.tile >= 0)
+		tile_slots[slot.tile] = -1;
+	slot.tile = int64_t(tile);
+	slot.last_used = frame;
+	tile_slots[tile] = int32_t(victim);
+
+	int padded = pages.PaddedTileSize();
+	int x = int(victim % cache_tiles_per_side) * padded;
+	int y = int(victim / cache_tiles_per_side) * padded;
+
+	glBindTexture(GL_TEXTURE_2D, cache_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, padded, padded, GL_RGBA, GL_UNSIGNED_BYTE, texels);
+
+	indirection_dirty = true;
+}
+
+void VirtualTexture::RebuildIndirection()
+{
+	/* Coarse to fine, a tile that is not resident copies the entry of the tile above it */
+	for (int level = pages.LevelCount() - 1; level >= 0; --level)
+	{
+		const PageFileLevel& info = pages.Level(level);
+		for (uint32_t y = 0; y < info.tiles_y; ++y)
+			for (uint32_t x = 0; x < info.tiles_x; ++x)
+			{
+				unsigned char* entry = &indirection[(size_t(y) * indirection_width + level_offsets[level] + x) * 4];
+				int32_t slot = tile_slots[pages.TileIndex(level, x, y)];
+				if (slot >= 0)
+				{
+					entry[0] = (unsigned char)(slot % cache_tiles_per_side);
+					entry[1] = (unsigned char)(slot / cache_tiles_per_side);
+					entry[2] = (unsigned char)level;
+					entry[3] = 255;
+				}
+				else if (level + 1 < pages.LevelCount())
+				{
+					const PageFileLevel& parent = pages.Level(level + 1);
+					uint32_t parent_x = std::min(x / 2, parent.tiles_x - 1);
+					uint32_t parent_y = std::min(y / 2, parent.tiles_y - 1);
+					const unsigned char* parent_entry = &indirection[(size_t(parent_y) * indirection_width + level_offsets[level + 1] + parent_x) * 4];
+					std::memcpy(entry, parent_entry, 4);
+				}
+				else
+				{
+					entry[0] = 0;
+					entry[1] = 0;
+					entry[2] = (unsigned char)level;
+					entry[3] = 255;
+				}
+			}
+	}
+
+	glBindTexture(GL_TEXTURE_2D, indirection_texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, indirection_width, int(pages.Level(0).tiles_y), GL_RGBA, GL_UNSIGNED_BYTE, indirection.data());
+
+	indirection_dirty = false;
+}
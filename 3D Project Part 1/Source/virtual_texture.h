@@ -0,0 +1,116 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GLAD/glad.h"
+#include "GLM/glm.hpp"
+#include "asset_archive.h"
+#include "opengl_utilities.h"
+#include "page_file.h"
+
+/*
+	Virtual Texture: draws a texture far larger than GPU memory out of a page file.
+	- A feedback pass renders the surface at 1/8 resolution and writes the tile and mip
+	  level every pixel needs, read back a frame later through pixel buffer objects.
+	- A streaming thread reads the missing tiles out of the page file, mapped through OpenAsset.
+	- Finished tiles are copied into a fixed size physical cache texture, least recently
+	  used tiles are evicted. The coarsest level stays resident as the fallback.
+	- An indirection table holds, for every tile of every level, the cache slot of the
+	  finest resident tile covering it. Programs with SHADER_FEATURE_VIRTUAL_TEXTURE
+	  sample the cache through it.
+*/
+class VirtualTexture
+{
+public:
+	struct Stats
+	{
+		size_t resident_tiles;
+		size_t cache_slots;
+		size_t requested_tiles;
+		size_t missed_tiles;
+		size_t bytes_uploaded;
+	};
+
+	/* Must be constructed with a current context, the cache holds cache_tiles_per_side squared tiles */
+	VirtualTexture(const std::string& page_file, int cache_tiles_per_side);
+	/* Stops the streaming thread and deletes the GL objects, destroy it before the context */
+	~VirtualTexture();
+
+	bool Valid() const { return valid; }
+
+	/* Physical cache for texture unit 0, indirection table for unit 1 */
+	GLuint CacheTexture() const { return cache_texture; }
+	GLuint IndirectionTexture() const { return indirection_texture; }
+
+	/* GPU memory of the cache and the indirection table */
+	size_t MemoryBytes() const;
+
+	/* Sets the constant uniforms of a VIRTUAL_TEXTURE program */
+	void SetupProgram(GLuint program) const;
+
+	/* Draws the mesh into the feedback target, restores the default framebuffer and viewport */
+	void RenderFeedback(const VAO& mesh, const glm::mat4& transform, glm::ivec2 screen_dimensions);
+
+	/* Reads the previous feedback, requests missing tiles and uploads finished ones within the budget */
+	Stats Update();
+
+private:
+	struct Slot
+	{
+		int64_t tile;
+		uint64_t last_used;
+	};
+
+	struct StreamedTile
+	{
+		uint64_t tile;
+		std::vector<unsigned char> texels;
+	};
+
+	void Stream();
+	void UploadTile(uint64_t tile, const unsigned char* texels);
+	void RebuildIndirection();
+	void ProcessFeedback(const uint16_t* texels, size_t count, Stats& stats);
+
+	bool valid;
+	AssetData file;
+	PageFileView pages;
+
+	int cache_tiles_per_side;
+	GLuint cache_texture;
+	GLuint indirection_texture;
+	int indirection_width;
+	std::vector<int> level_offsets;
+	std::vector<unsigned char> indirection;
+	bool indirection_dirty;
+
+	/* Per tile of the page file: its cache slot or -1, and whether it is being streamed */
+	std::vector<int32_t> tile_slots;
+	std::vector<uint8_t> tile_pending;
+	std::vector<Slot> slots;
+	uint64_t frame;
+
+	GLuint feedback_program;
+	GLint feedback_transform_location;
+	GLuint feedback_framebuffer;
+	GLuint feedback_color;
+	GLuint feedback_depth;
+	glm::ivec2 feedback_size;
+	GLuint readback_buffers[2];
+	GLsync readback_fences[2];
+	glm::ivec2 readback_sizes[2];
+	int readback_index;
+
+	std::mutex mutex;
+	std::condition_variable tile_requested;
+	std::deque<uint64_t> stream_queue;
+	std::vector<StreamedTile> streamed;
+	std::thread streamer;
+	bool stopping;
+};
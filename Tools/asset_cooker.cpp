@@ -0,0 +1,281 @@
+/*
+	Asset Cooker: converts the project's images into block compressed textures with
+	pre-built mips, one container file per format, for the runtime to map and upload
+	without decoding, and packs the assets into the archive the game mounts. Needs no GL,
+	from the repository root on Linux:
+
+	g++ -std=c++14 -O2 -pthread -I"3D Project Part 1/Source" Tools/asset_cooker.cpp \
+		"3D Project Part 1/Source/mip_chain.cpp" "3D Project Part 1/Source/mapped_file.cpp" \
+		"3D Project Part 1/Source/texture_compression.cpp" "3D Project Part 1/Source/texture_container.cpp" \
+		"3D Project Part 1/Source/page_file.cpp" "3D Project Part 1/Source/asset_archive.cpp" -o asset_cooker
+
+	Usage, from "3D Project Part 1" so the runtime finds the cooked directory:
+	asset_cooker cook <output directory> <image>...
+	asset_cooker info <cooked file>...
+	asset_cooker tile <image> <page file> [tile size]
+	asset_cooker pack <archive> <file>...
+	asset_cooker list <archive>
+*/
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "asset_archive.h"
+#include "mapped_file.h"
+#include "mip_chain.h"
+#include "page_file.h"
+#include "texture_compression.h"
+#include "texture_container.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+/* Peak signal to noise ratio over the given channels of an RGBA decode, in dB */
+static double PSNR(const unsigned char* source, int channels, const std::vector<unsigned char>& decoded, int first_channel, int channel_count)
+{
+	double squared_error = 0;
+	size_t texels = decoded.size() / 4;
+	for (size_t i = 0; i < texels; ++i)
+		for (int c = first_channel; c < first_channel + channel_count; ++c)
+		{
+			int original = channels >= 3 || c == 3 ? source[i * channels + std::min(c, channels - 1)] : source[i * channels];
+			double d = double(original) - decoded[i * 4 + c];
+			squared_error += d * d;
+		}
+
+	double mean = squared_error / (double(texels) * channel_count);
+	return mean == 0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mean);
+}
+
+static bool Cook(const std::string& directory, const std::string& image)
+{
+	/* Flipped like the runtime loader, rows go to GL bottom first */
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(image.c_str(), &width, &height, &channels, 0);
+	if (pixels == nullptr)
+	{
+		std::cout << "Error: " << image << " failed to load: " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	std::vector<MipLevel> mips = BuildMipChain(pixels, width, height, channels);
+
+	bool alpha = channels == 2 || channels == 4;
+	std::vector<BlockFormat> formats;
+	if (alpha)
+		formats = { BLOCK_FORMAT_BC3, BLOCK_FORMAT_BC7, BLOCK_FORMAT_ETC2_RGBA };
+	else
+		formats = { BLOCK_FORMAT_BC1, BLOCK_FORMAT_BC7, BLOCK_FORMAT_ETC2_RGB };
+
+	std::cout << image << " " << width << "x" << height << " " << channels << " channels, " << mips.size() + 1 << " levels" << std::endl;
+
+	bool success = true;
+	for (BlockFormat format : formats)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		std::vector<std::vector<unsigned char>> levels;
+		levels.push_back(CompressImage(format, pixels, width, height, channels));
+		for (const MipLevel& mip : mips)
+			levels.push_back(CompressImage(format, mip.pixels.data(), mip.width, mip.height, channels));
+
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		std::string path = CookedTexturePath(directory, image, format);
+		if (!WriteTextureFile(path, format, width, height, channels, levels))
+		{
+			std::cout << "Error: could not write " << path << std::endl;
+			success = false;
+			continue;
+		}
+
+		size_t bytes = 0;
+		for (const auto& level : levels)
+			bytes += level.size();
+
+		std::vector<unsigned char> decoded = DecompressImage(format, levels[0].data(), width, height);
+		std::cout << "  " << std::left << std::setw(6) << BlockFormatName(format) << std::right
+			<< std::setw(8) << bytes / 1024 << " KB" << std::fixed << std::setprecision(1)
+			<< std::setw(10) << milliseconds << " ms"
+			<< "  PSNR rgb " << std::setw(5) << PSNR(pixels, channels, decoded, 0, 3);
+		if (alpha)
+			std::cout << "  alpha " << std::setw(5) << PSNR(pixels, channels, decoded, 3, 1);
+		std::cout << std::endl;
+		std::cout.unsetf(std::ios::floatfield);
+	}
+
+	stbi_image_free(pixels);
+	return success;
+}
+
+static bool Info(const std::string& path)
+{
+	MappedFile file;
+	TextureFileView view;
+	if (!file.Open(path) || !view.Parse(file.Data(), file.Size()))
+	{
+		std::cout << "Error: " << path << " is not a valid texture container" << std::endl;
+		return false;
+	}
+
+	std::cout << path << ": " << BlockFormatName(view.Format()) << " " << view.Width() << "x" << view.Height()
+		<< ", " << view.SourceChannels() << " source channels" << std::endl;
+	for (int level = 0; level < view.LevelCount(); ++level)
+	{
+		const TextureFileLevel& info = view.Level(level);
+		std::cout << "  level " << std::setw(2) << level << " " << info.width << "x" << info.height
+			<< " at " << info.offset << ", " << info.size << " bytes" << std::endl;
+	}
+	return true;
+}
+
+/* Cuts the image into a page file for --virtual-texture, tiles get a one texel border */
+static bool Tile(const std::string& image, const std::string& path, int tile_size)
+{
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(image.c_str(), &width, &height, &channels, 4);
+	if (pixels == nullptr)
+	{
+		std::cout << "Error: " << image << " failed to load: " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	bool success = WritePageFile(path, pixels, width, height, tile_size, 1);
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	stbi_image_free(pixels);
+
+	MappedFile file;
+	PageFileView view;
+	if (!success || !file.Open(path) || !view.Parse(file.Data(), file.Size()))
+	{
+		std::cout << "Error: could not write " << path << std::endl;
+		return false;
+	}
+
+	std::cout << image << " " << width << "x" << height << " -> " << path << ", " << view.LevelCount() << " levels, "
+		<< view.TileCount() << " tiles of " << view.PaddedTileSize() << "x" << view.PaddedTileSize() << ", "
+		<< file.Size() / 1024 << " KB in " << std::fixed << std::setprecision(1) << milliseconds << " ms" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	return true;
+}
+
+/* Packs the files for the game to mount, names are the paths as given */
+static bool Pack(const std::string& path, const std::vector<std::string>& files)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::string error;
+	if (!WriteAssetArchive(path, files, error))
+	{
+		std::cout << "Error: " << error << std::endl;
+		return false;
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	AssetArchive archive;
+	if (!archive.Open(path))
+	{
+		std::cout << "Error: could not read back " << path << std::endl;
+		return false;
+	}
+
+	uint64_t input_bytes = 0;
+	for (size_t i = 0; i < archive.EntryCount(); ++i)
+		input_bytes += archive.Entry(i).size;
+
+	std::cout << path << ": " << archive.EntryCount() << " entries, " << input_bytes / 1024 << " KB of files in "
+		<< archive.FileSize() / 1024 << " KB, " << std::fixed << std::setprecision(1) << milliseconds << " ms" << std::endl;
+	std::cout.unsetf(std::ios::floatfield);
+	return true;
+}
+
+static bool List(const std::string& path)
+{
+	AssetArchive archive;
+	if (!archive.Open(path))
+	{
+		std::cout << "Error: " << path << " is not a valid asset archive" << std::endl;
+		return false;
+	}
+
+	std::cout << path << ": " << archive.EntryCount() << " entries, " << archive.FileSize() / 1024 << " KB" << std::endl;
+	for (size_t i = 0; i < archive.EntryCount(); ++i)
+	{
+		const AssetArchiveEntry& entry = archive.Entry(i);
+
+		/* Entries sharing their bytes with an earlier one were deduplicated */
+		bool shared = false;
+		for (size_t j = 0; j < i && !shared; ++j)
+			shared = archive.Entry(j).offset == entry.offset;
+
+		std::cout << "  " << std::hex << std::setfill('0') << std::setw(16) << entry.content_hash << std::dec << std::setfill(' ')
+			<< std::setw(12) << entry.offset << std::setw(10) << entry.size << " bytes  " << archive.EntryName(i)
+			<< (shared ? "  (shared)" : "") << std::endl;
+	}
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string command = argc > 1 ? argv[1] : "";
+
+	if (command == "cook" && argc > 3)
+	{
+		std::string directory = argv[2];
+#ifdef _WIN32
+		_mkdir(directory.c_str());
+#else
+		mkdir(directory.c_str(), 0755);
+#endif
+		bool success = true;
+		for (int i = 3; i < argc; ++i)
+			success = Cook(directory, argv[i]) && success;
+		return success ? 0 : 1;
+	}
+
+	if (command == "info" && argc > 2)
+	{
+		bool success = true;
+		for (int i = 2; i < argc; ++i)
+			success = Info(argv[i]) && success;
+		return success ? 0 : 1;
+	}
+
+	if (command == "tile" && argc > 3)
+	{
+		int tile_size = argc > 4 ? std::atoi(argv[4]) : 128;
+		if (tile_size <= 0 || tile_size > 1024)
+		{
+			std::cout << "Error: tile size must be between 1 and 1024" << std::endl;
+			return 1;
+		}
+		return Tile(argv[2], argv[3], tile_size) ? 0 : 1;
+	}
+
+	if (command == "pack" && argc > 3)
+		return Pack(argv[2], std::vector<std::string>(argv + 3, argv + argc)) ? 0 : 1;
+
+	if (command == "list" && argc > 2)
+		return List(argv[2]) ? 0 : 1;
+
+	std::cout << "Usage:" << std::endl;
+	std::cout << "  asset_cooker cook <output directory> <image>..." << std::endl;
+	std::cout << "  asset_cooker info <cooked file>..." << std::endl;
+	std::cout << "  asset_cooker tile <image> <page file> [tile size, default 128]" << std::endl;
+	std::cout << "  asset_cooker pack <archive> <file>..." << std::endl;
+	std::cout << "  asset_cooker list <archive>" << std::endl;
+	return 1;
+}